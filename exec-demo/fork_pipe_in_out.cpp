@@ -7,6 +7,10 @@
 // The example of using pipe(), fork() and dup2() functions.
 // The parent redirects stdout to pipe and the child redirects stdin from pipe.
 //
+// In aggregate mode (-a) consumer reads large blocks from stdin, parses
+// numbers by bulk parser (int_parse.h) and reports only count, sum,
+// minimum and maximum once per second.
+//
 //***************************************************************************//***************************************************************************
 
 #include <stdio.h>
@@ -16,8 +20,18 @@
 #include <string.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <time.h>
 #include <sys/types.h>
 
+#include "int_parse.h"
+
+#define AGGR_BUF_SIZE           ( 1024 * 1024 )         // block read from pipe
+#define AGGR_REPORT_NS          1000000000LL            // period of report
+
+// aggregate mode of consumer and selected parser
+int g_aggregate = 0;
+const char *g_parser = "auto";
+
 //***************************************************************************
 // log messages
 
@@ -61,25 +75,37 @@ void log_msg( int t_log_level, const char *t_form, ... )
 
 void help( int t_num, char **t_arg )
 {
-    if ( t_num <= 1 ) return;
-
-    if ( !strcmp( t_arg[ 1 ], "-h" ) )
+    for ( int i = 1; i < t_num; i++ )
     {
-        printf(
-            "\n"
-            "  Stdio and stdout redirection. \n"
-            "\n"
-            "  Use: %s\n"
-            "\n"
-            "    -h  this help\n"
-            "    -d  debug mode \n"
-            "\n", t_arg[ 0 ] );
-
-        exit( 0 );
+        if ( !strcmp( t_arg[ i ], "-h" ) )
+        {
+            printf(
+                "\n"
+                "  Stdio and stdout redirection. \n"
+                "\n"
+                "  Use: %s [-h -d -a] [-p parser]\n"
+                "\n"
+                "    -h  this help\n"
+                "    -d  debug mode \n"
+                "    -a  consumer aggregates numbers (count, sum, min, max) \n"
+                "    -p  parser of aggregate mode: scalar, sse4, avx2, auto (default)\n"
+                "\n"
+                "  Aggregate mode counts numbers with more than %d digits as errors,\n"
+                "  sum is computed modulo 2^64.\n"
+                "\n", t_arg[ 0 ], INT_MAX_DIGITS );
+
+            exit( 0 );
+        }
+
+        if ( !strcmp( t_arg[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_arg[ i ], "-a" ) )
+            g_aggregate = 1;
+
+        if ( i + 1 < t_num && !strcmp( t_arg[ i ], "-p" ) )
+            g_parser = t_arg[ ++i ];
     }
-
-    if ( !strcmp( t_arg[ 1 ], "-d" ) )
-        g_debug = LOG_DEBUG;
 }
 //***************************************************************************
 
@@ -104,6 +130,73 @@ void consumer()
     }
 }
 
+long long time_ns()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+void print_stats( const char *t_title, int_stats *t_stats, long long t_bytes, double t_rate )
+{
+    fprintf( stderr, "%s %lld numbers (%lld bytes, %.1f MB/s)  sum (mod 2^64) %lld  min %lld  max %lld  errors %lld\n",
+            t_title, t_stats->count, t_bytes, t_rate, ( long long ) t_stats->sum,
+            t_stats->count ? t_stats->min : 0, t_stats->count ? t_stats->max : 0, t_stats->errors );
+}
+
+void consumer_aggregate()
+// consumer reads large blocks from stdin and aggregates numbers
+{
+    const char *l_name = nullptr;
+    int_parse_fn l_parse = int_parse_select( g_parser, &l_name );
+    if ( !l_parse )
+    {
+        log_msg( LOG_INFO, "Parser '%s' is unknown or not supported by CPU, scalar is used.", g_parser );
+        l_parse = int_parse_select( "scalar", &l_name );
+    }
+    log_msg( LOG_DEBUG, "Consumer uses %s parser.", l_name );
+
+    int_stream l_stream;
+    if ( int_stream_init( &l_stream, AGGR_BUF_SIZE, l_parse ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate buffer!" );
+        exit( 1 );
+    }
+
+    int_stats l_stats;
+    int_stats_init( &l_stats );
+    long long l_total = 0, l_last_total = 0;
+    long long l_last = time_ns();
+    while ( 1 )
+    {
+        size_t l_free;
+        char *l_space = int_stream_space( &l_stream, &l_free );
+        ssize_t ret = read( STDIN_FILENO, l_space, l_free );
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to read from stdin!" );
+            exit( 1 );
+        }
+        if ( ret == 0 ) break;
+
+        int_stream_commit( &l_stream, ret, &l_stats );
+        l_total += ret;
+
+        long long l_now = time_ns();
+        if ( l_now - l_last >= AGGR_REPORT_NS )
+        {
+            print_stats( "Consumer read:", &l_stats, l_total, ( l_total - l_last_total ) * 1000.0 / ( l_now - l_last ) );
+            l_last = l_now;
+            l_last_total = l_total;
+        }
+    }
+
+    int_stream_finish( &l_stream, &l_stats );
+    print_stats( "Consumer total:", &l_stats, l_total, 0 );
+    int_stream_free( &l_stream );
+}
+
 int main( int t_narg, char **t_args )
 {
     help( t_narg, t_args );
@@ -146,7 +239,8 @@ int main( int t_narg, char **t_args )
         close( l_mypipe[ 0 ] );
         close( l_mypipe[ 1 ] );
 
-        consumer();
+        if ( g_aggregate ) consumer_aggregate();
+        else consumer();
     }
 
     return 0;
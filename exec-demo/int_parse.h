@@ -0,0 +1,285 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Bulk parser of integers separated by newlines.
+//
+// Data is read from pipe in large blocks and only complete lines are
+// parsed, incomplete number at the end of block is moved to the start
+// of buffer and completed by the next read. Values are not stored,
+// only count, sum, minimum and maximum are aggregated.
+//
+// Three implementations are selected at run time by CPU features:
+//   scalar - byte by byte,
+//   sse4   - newlines are found in 16 bytes by one compare, number up to
+//            16 digits is checked and converted by SIMD multiply-add:
+//            pairs of digits (maddubs), groups of 4 (madd) and 8 digits,
+//   avx2   - newlines are found in 32 bytes, conversion as sse4.
+// Functions are compiled for given instruction set by target attribute,
+// so the rest of program does not need -mavx2.
+//
+//***************************************************************************
+
+#ifndef __INT_PARSE_H
+#define __INT_PARSE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <immintrin.h>
+
+#define INT_MAX_DIGITS          18              // longer numbers (19 digits too) are errors
+
+struct int_stats
+{
+    long long count;
+    unsigned long long sum;                     // modulo 2^64, no signed overflow
+    long long min;
+    long long max;
+    long long errors;                           // lines which are not number
+};
+
+// Parse complete lines in t_buf and return number of used bytes
+// (up to the last newline).
+typedef size_t ( *int_parse_fn )( const char *t_buf, size_t t_len, int_stats *t_stats );
+
+static inline void int_stats_init( int_stats *t_stats )
+{
+    t_stats->count = 0;
+    t_stats->sum = 0;
+    t_stats->min = LLONG_MAX;
+    t_stats->max = LLONG_MIN;
+    t_stats->errors = 0;
+}
+
+static inline void int_stats_add( int_stats *t_stats, long long t_val )
+{
+    t_stats->count++;
+    t_stats->sum += ( unsigned long long ) t_val;
+    if ( t_val < t_stats->min ) t_stats->min = t_val;
+    if ( t_val > t_stats->max ) t_stats->max = t_val;
+}
+
+//***************************************************************************
+// scalar
+
+// one line without newline, empty line is skipped
+static inline void int_parse_number( const char *t_pos, const char *t_end, int_stats *t_stats )
+{
+    if ( t_pos == t_end ) return;
+    int l_neg = *t_pos == '-';
+    t_pos += l_neg;
+    if ( t_pos == t_end || t_end - t_pos > INT_MAX_DIGITS )
+    {
+        t_stats->errors++;
+        return;
+    }
+
+    long long l_val = 0;
+    for ( ; t_pos < t_end; t_pos++ )
+    {
+        unsigned l_digit = ( unsigned char ) *t_pos - '0';
+        if ( l_digit > 9 )
+        {
+            t_stats->errors++;
+            return;
+        }
+        l_val = l_val * 10 + l_digit;
+    }
+    int_stats_add( t_stats, l_neg ? -l_val : l_val );
+}
+
+static inline size_t int_parse_scalar( const char *t_buf, size_t t_len, int_stats *t_stats )
+{
+    const char *l_line = t_buf;
+    for ( const char *l_pos = t_buf; l_pos < t_buf + t_len; l_pos++ )
+        if ( *l_pos == '\n' )
+        {
+            int_parse_number( l_line, l_pos, t_stats );
+            l_line = l_pos + 1;
+        }
+    return l_line - t_buf;
+}
+
+//***************************************************************************
+// SIMD
+
+// Value of t_len (1-16) digits ending before t_end, 16 bytes before t_end
+// must be readable. Returns -1 when some character is not digit.
+__attribute__(( target( "sse4.1" ) ))
+static inline long long int_digits_sse( const char *t_end, int t_len )
+{
+    __m128i l_raw = _mm_loadu_si128( ( const __m128i * ) ( t_end - 16 ) );
+    __m128i l_digits = _mm_sub_epi8( l_raw, _mm_set1_epi8( '0' ) );
+
+    // number is right aligned, bytes before it are ignored
+    __m128i l_valid = _mm_cmpgt_epi8( _mm_set1_epi8( t_len ),
+            _mm_setr_epi8( 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 ) );
+    __m128i l_digit = _mm_cmpeq_epi8( _mm_max_epu8( l_digits, _mm_set1_epi8( 9 ) ), _mm_set1_epi8( 9 ) );
+    if ( _mm_movemask_epi8( _mm_andnot_si128( l_digit, l_valid ) ) ) return -1;
+    l_digits = _mm_and_si128( l_digits, l_valid );
+
+    // 16 digits -> 8 x 2 digits -> 4 x 4 digits -> 2 x 8 digits
+    __m128i l_pairs = _mm_maddubs_epi16( l_digits,
+            _mm_setr_epi8( 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1 ) );
+    __m128i l_quads = _mm_madd_epi16( l_pairs, _mm_setr_epi16( 100, 1, 100, 1, 100, 1, 100, 1 ) );
+    l_quads = _mm_packus_epi32( l_quads, l_quads );
+    __m128i l_octs = _mm_madd_epi16( l_quads, _mm_setr_epi16( 10000, 1, 10000, 1, 10000, 1, 10000, 1 ) );
+
+    return ( long long ) ( uint32_t ) _mm_cvtsi128_si32( l_octs ) * 100000000LL +
+            ( uint32_t ) _mm_extract_epi32( l_octs, 1 );
+}
+
+// line [t_pos, t_end) of buffer starting at t_buf
+__attribute__(( target( "sse4.1" ) ))
+static inline void int_parse_number_sse( const char *t_buf, const char *t_pos, const char *t_end, int_stats *t_stats )
+{
+    int l_neg = t_pos < t_end && *t_pos == '-';
+    int l_len = t_end - t_pos - l_neg;
+    // long numbers and numbers at the start of buffer are parsed by scalar code
+    if ( l_len <= 0 || l_len > 16 || t_end - 16 < t_buf )
+    {
+        int_parse_number( t_pos, t_end, t_stats );
+        return;
+    }
+
+    long long l_val = int_digits_sse( t_end, l_len );
+    if ( l_val < 0 )
+        t_stats->errors++;
+    else
+        int_stats_add( t_stats, l_neg ? -l_val : l_val );
+}
+
+__attribute__(( target( "sse4.1" ) ))
+static inline size_t int_parse_sse4( const char *t_buf, size_t t_len, int_stats *t_stats )
+{
+    const char *l_line = t_buf;
+    const char *l_pos = t_buf;
+    const __m128i l_nl = _mm_set1_epi8( '\n' );
+    for ( ; l_pos + 16 <= t_buf + t_len; l_pos += 16 )
+    {
+        unsigned l_mask = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( ( const __m128i * ) l_pos ), l_nl ) );
+        while ( l_mask )
+        {
+            const char *l_end = l_pos + __builtin_ctz( l_mask );
+            int_parse_number_sse( t_buf, l_line, l_end, t_stats );
+            l_line = l_end + 1;
+            l_mask &= l_mask - 1;
+        }
+    }
+    for ( ; l_pos < t_buf + t_len; l_pos++ )
+        if ( *l_pos == '\n' )
+        {
+            int_parse_number_sse( t_buf, l_line, l_pos, t_stats );
+            l_line = l_pos + 1;
+        }
+    return l_line - t_buf;
+}
+
+__attribute__(( target( "avx2" ) ))
+static inline size_t int_parse_avx2( const char *t_buf, size_t t_len, int_stats *t_stats )
+{
+    const char *l_line = t_buf;
+    const char *l_pos = t_buf;
+    const __m256i l_nl = _mm256_set1_epi8( '\n' );
+    for ( ; l_pos + 32 <= t_buf + t_len; l_pos += 32 )
+    {
+        unsigned l_mask = _mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( ( const __m256i * ) l_pos ), l_nl ) );
+        while ( l_mask )
+        {
+            const char *l_end = l_pos + __builtin_ctz( l_mask );
+            int_parse_number_sse( t_buf, l_line, l_end, t_stats );
+            l_line = l_end + 1;
+            l_mask &= l_mask - 1;
+        }
+    }
+    return ( l_line - t_buf ) + int_parse_sse4( l_line, t_buf + t_len - l_line, t_stats );
+}
+
+//***************************************************************************
+// selection of implementation
+
+static const char *int_parse_names[] = { "scalar", "sse4", "avx2" };
+
+// Implementation by name or the best one for current CPU (t_name is nullptr
+// or "auto"). Returns nullptr when CPU does not support it.
+static inline int_parse_fn int_parse_select( const char *t_name, const char **t_selected = nullptr )
+{
+    int_parse_fn l_fns[] = { int_parse_scalar, int_parse_sse4, int_parse_avx2 };
+    int l_supported[] = { 1, __builtin_cpu_supports( "sse4.1" ), __builtin_cpu_supports( "avx2" ) };
+
+    int l_index = -1;
+    if ( !t_name || !strcmp( t_name, "auto" ) )
+    {
+        for ( int i = 0; i < 3; i++ )
+            if ( l_supported[ i ] ) l_index = i;
+    }
+    else
+        for ( int i = 0; i < 3; i++ )
+            if ( !strcmp( t_name, int_parse_names[ i ] ) && l_supported[ i ] ) l_index = i;
+
+    if ( l_index < 0 ) return nullptr;
+    if ( t_selected ) *t_selected = int_parse_names[ l_index ];
+    return l_fns[ l_index ];
+}
+
+//***************************************************************************
+// stream of blocks
+
+struct int_stream
+{
+    char *buf;
+    size_t size;
+    size_t used;                // incomplete line at start of buffer
+    int_parse_fn parse;
+};
+
+static inline int int_stream_init( int_stream *t_stream, size_t t_size, int_parse_fn t_parse )
+{
+    t_stream->buf = ( char * ) malloc( t_size );
+    t_stream->size = t_size;
+    t_stream->used = 0;
+    t_stream->parse = t_parse;
+    return t_stream->buf ? 0 : -1;
+}
+
+static inline void int_stream_free( int_stream *t_stream )
+{
+    free( t_stream->buf );
+    t_stream->buf = nullptr;
+}
+
+// free space for new data
+static inline char *int_stream_space( int_stream *t_stream, size_t *t_free )
+{
+    *t_free = t_stream->size - t_stream->used;
+    return t_stream->buf + t_stream->used;
+}
+
+// t_len bytes were stored into free space, parse complete lines
+static inline void int_stream_commit( int_stream *t_stream, size_t t_len, int_stats *t_stats )
+{
+    size_t l_all = t_stream->used + t_len;
+    size_t l_done = t_stream->parse( t_stream->buf, l_all, t_stats );
+    t_stream->used = l_all - l_done;
+    if ( t_stream->used == t_stream->size )
+    {
+        // line longer than buffer is dropped
+        t_stats->errors++;
+        t_stream->used = 0;
+    }
+    else if ( t_stream->used && l_done )
+        memmove( t_stream->buf, t_stream->buf + l_done, t_stream->used );
+}
+
+// end of data, the last line can be without newline
+static inline void int_stream_finish( int_stream *t_stream, int_stats *t_stats )
+{
+    int_parse_number( t_stream->buf, t_stream->buf + t_stream->used, t_stats );
+    t_stream->used = 0;
+}
+
+#endif // __INT_PARSE_H
@@ -0,0 +1,260 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Benchmark of parsing of integers separated by newlines.
+//
+// Text with random numbers is generated in memory and parsed by
+// fscanf( "%lld" ), strtoll() and by bulk parsers of int_parse.h (scalar,
+// sse4 and avx2, if supported by CPU). Bulk parsers get text in blocks
+// like from pipe, block boundaries split numbers. Results of all methods
+// are compared with strtoll().
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "int_parse.h"
+
+#define BLOCK_SIZE              ( 1024 * 1024 )
+
+// parameters of test
+long g_numbers = 5000000;
+int g_digits = 10;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Benchmark of parsing of integers.\n"
+        "\n"
+        "  Use: %s [-h -d] [-n numbers] [-m digits]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -n  count of numbers (default %ld)\n"
+        "    -m  max. digits of number, 1-%d (default %d)\n"
+        "\n"
+        "  Numbers with more than %d digits are counted as errors.\n"
+        "  Sum is computed modulo 2^64.\n"
+        "\n", t_name, g_numbers, INT_MAX_DIGITS, g_digits, INT_MAX_DIGITS );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+long long time_ns()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+// random numbers with 1 to g_digits digits, every 10th is negative
+char *generate( size_t *t_len )
+{
+    char *l_text = ( char * ) malloc( g_numbers * ( INT_MAX_DIGITS + 2 ) );
+    if ( !l_text ) return nullptr;
+
+    unsigned int l_seed = 1;
+    char *l_pos = l_text;
+    for ( long i = 0; i < g_numbers; i++ )
+    {
+        if ( rand_r( &l_seed ) % 10 == 0 ) *l_pos++ = '-';
+        int l_len = 1 + rand_r( &l_seed ) % g_digits;
+        for ( int d = 0; d < l_len; d++ )
+            *l_pos++ = '0' + rand_r( &l_seed ) % 10;
+        *l_pos++ = '\n';
+    }
+    *t_len = l_pos - l_text;
+    return l_text;
+}
+
+void parse_scanf( const char *t_text, size_t t_len, int_stats *t_stats )
+{
+    FILE *l_file = fmemopen( ( void * ) t_text, t_len, "r" );
+    long long l_val;
+    while ( fscanf( l_file, "%lld", &l_val ) == 1 )
+        int_stats_add( t_stats, l_val );
+    fclose( l_file );
+}
+
+void parse_strtol( const char *t_text, size_t t_len, int_stats *t_stats )
+{
+    // text is terminated by newline, strtoll() stops on it
+    const char *l_pos = t_text;
+    while ( l_pos < t_text + t_len )
+    {
+        char *l_end;
+        long long l_val = strtoll( l_pos, &l_end, 10 );
+        if ( l_end == l_pos ) break;
+        int_stats_add( t_stats, l_val );
+        l_pos = l_end + 1;
+    }
+}
+
+// text is passed in blocks of random size up to t_max_block
+void parse_bulk( int_parse_fn t_parse, const char *t_text, size_t t_len, size_t t_max_block, int_stats *t_stats )
+{
+    int_stream l_stream;
+    if ( int_stream_init( &l_stream, BLOCK_SIZE, t_parse ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate buffer!" );
+        exit( 1 );
+    }
+
+    unsigned int l_seed = 2;
+    for ( size_t l_pos = 0; l_pos < t_len; )
+    {
+        size_t l_free;
+        char *l_space = int_stream_space( &l_stream, &l_free );
+        size_t l_block = t_max_block < BLOCK_SIZE ? 1 + rand_r( &l_seed ) % t_max_block : t_max_block;
+        if ( l_block > l_free ) l_block = l_free;
+        if ( l_block > t_len - l_pos ) l_block = t_len - l_pos;
+        memcpy( l_space, t_text + l_pos, l_block );
+        int_stream_commit( &l_stream, l_block, t_stats );
+        l_pos += l_block;
+    }
+    int_stream_finish( &l_stream, t_stats );
+    int_stream_free( &l_stream );
+}
+
+int same_stats( const int_stats *t_a, const int_stats *t_b )
+{
+    return t_a->count == t_b->count && t_a->sum == t_b->sum && t_a->min == t_b->min &&
+           t_a->max == t_b->max && t_a->errors == t_b->errors;
+}
+
+// returns 0 when result differs from t_ref
+int report( const char *t_name, long long t_ns, size_t t_len, const int_stats *t_stats, const int_stats *t_ref )
+{
+    int l_same = !t_ref || same_stats( t_stats, t_ref );
+    printf( "%-8s %8.1f ms  %8.1f MB/s  %7.1f M numbers/s  count %ld  sum (mod 2^64) %lld  min %lld  max %lld  %s\n",
+            t_name, t_ns / 1e6, t_len * 1e3 / t_ns, t_stats->count * 1e3 / t_ns,
+            ( long ) t_stats->count, ( long long ) t_stats->sum, t_stats->min, t_stats->max,
+            l_same ? "OK" : "DIFFERENT" );
+    return l_same;
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-n" ) ) g_numbers = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-m" ) ) g_digits = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_numbers <= 0 || g_digits <= 0 || g_digits > INT_MAX_DIGITS )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    size_t l_len;
+    char *l_text = generate( &l_len );
+    if ( !l_text )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate memory!" );
+        exit( 1 );
+    }
+    log_msg( LOG_INFO, "%ld numbers, %.1f MB of text.", g_numbers, l_len / 1048576.0 );
+
+    int_stats l_ref, l_stats;
+    int_stats_init( &l_ref );
+    long long l_start = time_ns();
+    parse_strtol( l_text, l_len, &l_ref );
+    report( "strtol", time_ns() - l_start, l_len, &l_ref, nullptr );
+
+    int_stats_init( &l_stats );
+    l_start = time_ns();
+    parse_scanf( l_text, l_len, &l_stats );
+    int l_failed = !report( "scanf", time_ns() - l_start, l_len, &l_stats, &l_ref );
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        int_parse_fn l_parse = int_parse_select( int_parse_names[ i ] );
+        if ( !l_parse )
+        {
+            log_msg( LOG_INFO, "Parser %s is not supported by CPU.", int_parse_names[ i ] );
+            continue;
+        }
+
+        int_stats_init( &l_stats );
+        l_start = time_ns();
+        parse_bulk( l_parse, l_text, l_len, BLOCK_SIZE, &l_stats );
+        l_failed |= !report( int_parse_names[ i ], time_ns() - l_start, l_len, &l_stats, &l_ref );
+
+        // small random blocks, many numbers are split between blocks
+        int_stats_init( &l_stats );
+        parse_bulk( l_parse, l_text, l_len, 100, &l_stats );
+        if ( !same_stats( &l_stats, &l_ref ) )
+        {
+            log_msg( LOG_INFO, "Parser %s gives different result for small blocks!", int_parse_names[ i ] );
+            l_failed = 1;
+        }
+        else
+            log_msg( LOG_DEBUG, "Parser %s is correct for small blocks.", int_parse_names[ i ] );
+    }
+
+    free( l_text );
+    return l_failed;
+}
@@ -8,6 +8,10 @@
 // Parent process creates child process and
 // parent passes data to child via pipe.
 //
+// In fast mode (-f) producer formats integers by table of digit pairs
+// into large buffer and whole buffer is written by one write(), consumer
+// reads large blocks. Progress is reported once per second only.
+//
 //***************************************************************************
 
 #include <stdio.h>
@@ -17,8 +21,18 @@
 #include <string.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
 #include <sys/types.h>
 
+#define FAST_BUF_SIZE           ( 1024 * 1024 )         // buffer of fast mode
+#define FAST_PIPE_SIZE          ( 1024 * 1024 )         // requested capacity of pipe
+#define FAST_REPORT_NS          1000000000LL            // period of progress report
+
+// fast mode of producer and consumer
+int g_fast = 0;
+
 //***************************************************************************
 // log messages
 
@@ -62,25 +76,170 @@ void log_msg( int t_log_level, const char *t_form, ... )
 
 void help( int t_num, char **t_arg )
 {
-    if ( t_num <= 1 ) return;
+    for ( int i = 1; i < t_num; i++ )
+    {
+        if ( !strcmp( t_arg[ i ], "-h" ) )
+        {
+            printf(
+                "\n"
+                "  Fork() and pipe() example.\n"
+                "\n"
+                "  Use: %s [-h -d -f]\n"
+                "\n"
+                "    -h  this help\n"
+                "    -d  debug mode \n"
+                "    -f  fast mode, large buffers and periodic progress \n"
+                "\n", t_arg[ 0 ] );
+
+            exit( 0 );
+        }
+
+        if ( !strcmp( t_arg[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_arg[ i ], "-f" ) )
+            g_fast = 1;
+    }
+}
+
+//***************************************************************************
+// fast mode
+
+long long time_ns()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+// "00", "01", ... "99"
+static const char g_digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
 
-    if ( !strcmp( t_arg[ 1 ], "-h" ) )
+// Format t_val into t_out, returns end of number.
+// Two digits are converted by one division and one table lookup.
+static inline char *format_uint( char *t_out, uint64_t t_val )
+{
+    char l_tmp[ 20 ];
+    char *l_pos = l_tmp + sizeof( l_tmp );
+    while ( t_val >= 100 )
     {
-        printf(
-            "\n"
-            "  Fork() and pipe() example.\n"
-            "\n"
-            "  Use: %s [-h -d]\n"
-            "\n"
-            "    -h  this help\n"
-            "    -d  debug mode \n"
-            "\n", t_arg[ 0 ] );
-
-        exit( 0 );
+        unsigned l_pair = ( t_val % 100 ) * 2;
+        t_val /= 100;
+        l_pos -= 2;
+        memcpy( l_pos, g_digit_pairs + l_pair, 2 );
     }
+    if ( t_val >= 10 )
+    {
+        l_pos -= 2;
+        memcpy( l_pos, g_digit_pairs + t_val * 2, 2 );
+    }
+    else
+        *--l_pos = '0' + t_val;
 
-    if ( !strcmp( t_arg[ 1 ], "-d" ) )
-        g_debug = LOG_DEBUG;
+    size_t l_len = l_tmp + sizeof( l_tmp ) - l_pos;
+    memcpy( t_out, l_pos, l_len );
+    return t_out + l_len;
+}
+
+// write whole buffer, write() into pipe can be partial
+void write_all( int t_handle, const char *t_buf, size_t t_len )
+{
+    while ( t_len )
+    {
+        ssize_t ret = write( t_handle, t_buf, t_len );
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to write to pipe (fd %d)!", t_handle );
+            exit( 1 );
+        }
+        log_msg( LOG_DEBUG, "Function writes to pipe (fd %d) %d bytes", t_handle, ( int ) ret );
+        t_buf += ret;
+        t_len -= ret;
+    }
+}
+
+void producer_fast( int t_handle )
+// The producer fills large buffer by integers and writes it by one write().
+// Progress is sent to stdout once per FAST_REPORT_NS.
+{
+    char *l_buf = ( char * ) malloc( FAST_BUF_SIZE );
+    if ( !l_buf )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate buffer!" );
+        exit( 1 );
+    }
+
+    uint64_t l_count = 0;
+    long long l_total = 0, l_last_total = 0;
+    long long l_last = time_ns();
+
+    while ( 1 )
+    {
+        // the longest number has 20 digits and newline
+        char *l_pos = l_buf;
+        char *l_limit = l_buf + FAST_BUF_SIZE - 21;
+        while ( l_pos < l_limit )
+        {
+            l_pos = format_uint( l_pos, l_count++ );
+            *l_pos++ = '\n';
+        }
+
+        write_all( t_handle, l_buf, l_pos - l_buf );
+        l_total += l_pos - l_buf;
+
+        long long l_now = time_ns();
+        if ( l_now - l_last >= FAST_REPORT_NS )
+        {
+            fprintf( stdout, "Generated %lld bytes, %.1f MB/s.\n", l_total,
+                    ( l_total - l_last_total ) * 1000.0 / ( l_now - l_last ) );
+            fflush( stdout );
+            l_last = l_now;
+            l_last_total = l_total;
+        }
+    }
+}
+
+void consumer_fast( int t_handle )
+// The consumer reads large blocks and reports amount of data once per FAST_REPORT_NS.
+{
+    char *l_buf = ( char * ) malloc( FAST_BUF_SIZE );
+    if ( !l_buf )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate buffer!" );
+        exit( 1 );
+    }
+
+    long long l_total = 0, l_last_total = 0;
+    long long l_last = time_ns();
+
+    while ( 1 )
+    {
+        int ret = read( t_handle, l_buf, FAST_BUF_SIZE );
+        if ( ret < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to read from pipe - (fd %d)!", t_handle );
+            exit( 1 );
+        }
+        if ( ret == 0 ) break;
+        log_msg( LOG_DEBUG, "Functions read (fd %d) %d bytes", t_handle, ret );
+
+        l_total += ret;
+
+        long long l_now = time_ns();
+        if ( l_now - l_last >= FAST_REPORT_NS )
+        {
+            fprintf( stderr, "          Consumed %lld bytes, %.1f MB/s.\n", l_total,
+                    ( l_total - l_last_total ) * 1000.0 / ( l_now - l_last ) );
+            l_last = l_now;
+            l_last_total = l_total;
+        }
+    }
+    exit( 0 );
 }
 
 //***************************************************************************
@@ -148,6 +307,10 @@ int main( int t_num, char **t_arg )
         exit( 1 );
     }
 
+    // larger pipe means less switching between processes, failure is ignored
+    if ( g_fast )
+        fcntl( l_mypipe[ 1 ], F_SETPIPE_SZ, FAST_PIPE_SIZE );
+
     int l_child = fork();
 
     if ( l_child < 0 )
@@ -159,12 +322,14 @@ int main( int t_num, char **t_arg )
     if ( l_child != 0 )
     { // parent
         close( l_mypipe[ 0 ] );
-        producer( l_mypipe[ 1 ] );
+        if ( g_fast ) producer_fast( l_mypipe[ 1 ] );
+        else producer( l_mypipe[ 1 ] );
     }
     else
     { // child
         close( l_mypipe[ 1 ] );
-        consumer( l_mypipe[ 0 ] );
+        if ( g_fast ) consumer_fast( l_mypipe[ 0 ] );
+        else consumer( l_mypipe[ 0 ] );
     }
 
     return 0;
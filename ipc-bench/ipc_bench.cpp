@@ -0,0 +1,522 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Comparison of IPC transports: pipe, posix message queue, Unix socket,
+// ring buffer in shared memory and shared memory with eventfd.
+//
+// The same workload is run over every transport for all combinations
+// of message size, batch size (messages per send/receive call) and
+// placement of processes to CPUs:
+//   none   - no affinity, scheduler decides,
+//   same   - both processes on the same CPU,
+//   smt    - sibling hyper-threads of one core,
+//   core   - different cores of one socket,
+//   socket - different sockets.
+// Placements not available on current machine are skipped.
+//
+// Throughput: producer sends batches for given time, consumer counts
+// received messages. Latency: ping-pong, consumer measures one-way
+// latency from timestamp in message (CLOCK_MONOTONIC is common for all
+// processes), producer measures round trip. Results are printed as one
+// CSV line (or JSON object) per combination.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <vector>
+#include <algorithm>
+
+#include "ipc_transport.h"
+
+#define MAX_VALUES              32
+#define MIN_MSGSIZE             8               // timestamp in message
+
+#define PLACE_NONE              0
+#define PLACE_SAME              1
+#define PLACE_SMT               2
+#define PLACE_CORE              3
+#define PLACE_SOCKET            4
+#define PLACEMENTS              5
+
+const char *g_place_names[ PLACEMENTS ] = { "none", "same", "smt", "core", "socket" };
+
+// CPUs of placement, -1 = no affinity
+struct placement
+{
+    int available;
+    int cpu_a, cpu_b;
+};
+
+// parameters of test
+int g_transports[ IPC_TRANSPORTS ] = { 1, 1, 1, 1, 1 };
+int g_places[ PLACEMENTS ] = { 1, 1, 1, 1, 1 };
+long g_sizes[ MAX_VALUES ] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+int g_nsizes = 7;
+long g_batches[ MAX_VALUES ] = { 1, 16 };
+int g_nbatches = 2;
+int g_millis = 300;
+int g_roundtrips = 10000;
+int g_json = 0;
+
+placement g_placement[ PLACEMENTS ];
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    // results are on stdout, messages go to stderr
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stderr, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Benchmark of IPC transports.\n"
+        "\n"
+        "  Use: %s [-h -d -j] [-x transports] [-s sizes] [-b batches] [-a placements]\n"
+        "         [-t ms] [-n roundtrips]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -j  JSON output, one object per line (default CSV)\n"
+        "    -x  list of transports: pipe,mq,unix,shm,eventfd (default all)\n"
+        "    -s  list of message sizes, suffix k or m (default 8,64,512,4k,32k,256k,1m)\n"
+        "    -b  list of batch sizes (default 1,16)\n"
+        "    -a  list of placements: none,same,smt,core,socket (default all available)\n"
+        "    -t  duration of throughput test in ms (default %d)\n"
+        "    -n  max. number of round trips (default %d)\n"
+        "\n", t_name, g_millis, g_roundtrips );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+// parsing of parameters
+
+// number with optional suffix k or m
+long parse_size( const char *t_str )
+{
+    char *l_end;
+    long l_val = strtol( t_str, &l_end, 10 );
+    if ( *l_end == 'k' || *l_end == 'K' ) l_val *= 1024;
+    if ( *l_end == 'm' || *l_end == 'M' ) l_val *= 1024 * 1024;
+    return l_val;
+}
+
+int parse_list( char *t_str, long *t_values )
+{
+    int l_count = 0;
+    for ( char *l_tok = strtok( t_str, "," ); l_tok && l_count < MAX_VALUES; l_tok = strtok( nullptr, "," ) )
+        t_values[ l_count++ ] = parse_size( l_tok );
+    return l_count;
+}
+
+// select names from t_names, returns -1 for unknown name
+int parse_names( char *t_str, const char **t_names, int t_count, int *t_selected )
+{
+    for ( int i = 0; i < t_count; i++ )
+        t_selected[ i ] = 0;
+    for ( char *l_tok = strtok( t_str, "," ); l_tok; l_tok = strtok( nullptr, "," ) )
+    {
+        int i = 0;
+        while ( i < t_count && strcmp( l_tok, t_names[ i ] ) ) i++;
+        if ( i == t_count ) return -1;
+        t_selected[ i ] = 1;
+    }
+    return 0;
+}
+
+//***************************************************************************
+// topology of CPUs
+
+int read_topology( int t_cpu, const char *t_item )
+{
+    char l_path[ 128 ];
+    sprintf( l_path, "/sys/devices/system/cpu/cpu%d/topology/%s", t_cpu, t_item );
+    FILE *l_file = fopen( l_path, "r" );
+    if ( !l_file ) return -1;
+    int l_val = -1;
+    if ( fscanf( l_file, "%d", &l_val ) != 1 ) l_val = -1;
+    fclose( l_file );
+    return l_val;
+}
+
+// find pair of allowed CPUs for every placement
+void detect_placements()
+{
+    cpu_set_t l_set;
+    CPU_ZERO( &l_set );
+    sched_getaffinity( 0, sizeof( l_set ), &l_set );
+
+    std::vector<int> l_cpus;
+    for ( int i = 0; i < CPU_SETSIZE; i++ )
+        if ( CPU_ISSET( i, &l_set ) ) l_cpus.push_back( i );
+
+    for ( int i = 0; i < PLACEMENTS; i++ )
+        g_placement[ i ] = { 0, -1, -1 };
+    g_placement[ PLACE_NONE ].available = 1;
+    if ( l_cpus.empty() ) return;
+
+    int l_first = l_cpus[ 0 ];
+    int l_core = read_topology( l_first, "core_id" );
+    int l_pkg = read_topology( l_first, "physical_package_id" );
+    g_placement[ PLACE_SAME ] = { 1, l_first, l_first };
+
+    for ( size_t i = 1; i < l_cpus.size(); i++ )
+    {
+        int l_cpu = l_cpus[ i ];
+        int l_place = PLACE_SOCKET;
+        if ( read_topology( l_cpu, "physical_package_id" ) == l_pkg )
+            l_place = read_topology( l_cpu, "core_id" ) == l_core ? PLACE_SMT : PLACE_CORE;
+        if ( !g_placement[ l_place ].available )
+            g_placement[ l_place ] = { 1, l_first, l_cpu };
+    }
+
+    for ( int i = 0; i < PLACEMENTS; i++ )
+        log_msg( LOG_DEBUG, "Placement %-6s %s cpu %d and %d.", g_place_names[ i ],
+                g_placement[ i ].available ? "available," : "unavailable,",
+                g_placement[ i ].cpu_a, g_placement[ i ].cpu_b );
+}
+
+void set_cpu( int t_cpu, cpu_set_t *t_all )
+{
+    cpu_set_t l_set;
+    if ( t_cpu < 0 )
+        l_set = *t_all;
+    else
+    {
+        CPU_ZERO( &l_set );
+        CPU_SET( t_cpu, &l_set );
+    }
+    if ( sched_setaffinity( 0, sizeof( l_set ), &l_set ) < 0 )
+        log_msg( LOG_ERROR, "Unable to set affinity to cpu %d!", t_cpu );
+}
+
+//***************************************************************************
+// tests
+
+struct result
+{
+    double msgs_per_sec;
+    double mb_per_sec;
+    long long oneway[ 4 ];              // p50, p99, p99.9, max in ns
+    long long rtt[ 4 ];
+    long samples;
+};
+
+void percentiles( std::vector<long long> &t_values, long long *t_out )
+{
+    if ( t_values.empty() )
+    {
+        t_out[ 0 ] = t_out[ 1 ] = t_out[ 2 ] = t_out[ 3 ] = 0;
+        return;
+    }
+    std::sort( t_values.begin(), t_values.end() );
+    size_t l_n = t_values.size();
+    t_out[ 0 ] = t_values[ l_n * 50 / 100 ];
+    t_out[ 1 ] = t_values[ l_n * 99 / 100 ];
+    t_out[ 2 ] = t_values[ l_n * 999 / 1000 ];
+    t_out[ 3 ] = t_values[ l_n - 1 ];
+}
+
+// timestamp is stored in the first 8 bytes of every message in batch
+void stamp( char *t_buf, int t_size, int t_batch, long long t_ns )
+{
+    for ( int i = 0; i < t_batch; i++ )
+        memcpy( t_buf + ( size_t ) i * t_size, &t_ns, sizeof( t_ns ) );
+}
+
+long long stamp_of( const char *t_buf )
+{
+    long long l_ns;
+    memcpy( &l_ns, t_buf, sizeof( l_ns ) );
+    return l_ns;
+}
+
+pid_t start_child( int t_cpu, cpu_set_t *t_all )
+{
+    fflush( stdout );
+    fflush( stderr );
+    pid_t l_pid = fork();
+    if ( l_pid < 0 )
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+    if ( l_pid == 0 )
+        set_cpu( t_cpu, t_all );
+    return l_pid;
+}
+
+// Returns -1 when transport is not usable for given size.
+int test_throughput( int t_type, int t_size, int t_batch, placement *t_place, cpu_set_t *t_all, result *t_res )
+{
+    ipc_channel l_ch;
+    if ( ipc_channel_create( &l_ch, t_type, t_size ) < 0 )
+    {
+        ipc_channel_close( &l_ch );
+        return -1;
+    }
+    std::vector<char> l_buf( ( size_t ) t_size * t_batch );
+
+    pid_t l_pid = start_child( t_place->cpu_b, t_all );
+    if ( l_pid < 0 ) exit( 1 );
+    if ( l_pid == 0 )
+    {
+        // consumer, batch with zero timestamp is end of test
+        while ( ipc_recv( &l_ch, l_buf.data(), t_batch ) == 0 && stamp_of( l_buf.data() ) ) {}
+        exit( 0 );
+    }
+
+    long l_messages = 0;
+    long long l_start = time_ns(), l_end = l_start + g_millis * 1000000LL;
+    while ( 1 )
+    {
+        long long l_now = time_ns();
+        if ( l_now >= l_end ) break;
+        stamp( l_buf.data(), t_size, t_batch, l_now );
+        if ( ipc_send( &l_ch, l_buf.data(), t_batch ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to send message!" );
+            break;
+        }
+        l_messages += t_batch;
+    }
+    stamp( l_buf.data(), t_size, t_batch, 0 );
+    ipc_send( &l_ch, l_buf.data(), t_batch );
+    waitpid( l_pid, nullptr, 0 );
+
+    // consumer has received all messages when it exits
+    double l_time = ( time_ns() - l_start ) / 1e9;
+    t_res->msgs_per_sec = l_messages / l_time;
+    t_res->mb_per_sec = l_messages * ( double ) t_size / l_time / ( 1024 * 1024 );
+    ipc_channel_close( &l_ch );
+    return 0;
+}
+
+int test_latency( int t_type, int t_size, int t_batch, placement *t_place, cpu_set_t *t_all, result *t_res )
+{
+    ipc_channel l_ping, l_pong;
+    int l_ret1 = ipc_channel_create( &l_ping, t_type, t_size );
+    int l_ret2 = l_ret1 < 0 ? -1 : ipc_channel_create( &l_pong, t_type, t_size );
+    if ( l_ret1 < 0 || l_ret2 < 0 )
+    {
+        ipc_channel_close( &l_ping );
+        if ( l_ret1 == 0 ) ipc_channel_close( &l_pong );
+        return -1;
+    }
+    std::vector<char> l_buf( ( size_t ) t_size * t_batch );
+
+    // one-way latencies measured by consumer
+    size_t l_shm_size = ( g_roundtrips + 1 ) * sizeof( long long );
+    long long *l_oneway = ( long long * ) mmap( nullptr, l_shm_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_oneway == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    pid_t l_pid = start_child( t_place->cpu_b, t_all );
+    if ( l_pid < 0 ) exit( 1 );
+    if ( l_pid == 0 )
+    {
+        long l_count = 0;
+        while ( ipc_recv( &l_ping, l_buf.data(), t_batch ) == 0 )
+        {
+            long long l_sent = stamp_of( l_buf.data() );
+            if ( !l_sent ) break;
+            if ( l_count < g_roundtrips ) l_oneway[ ++l_count ] = time_ns() - l_sent;
+            if ( ipc_send( &l_pong, l_buf.data(), t_batch ) < 0 ) break;
+        }
+        l_oneway[ 0 ] = l_count;
+        exit( 0 );
+    }
+
+    // number of round trips is limited by time of test too
+    std::vector<long long> l_rtt;
+    long long l_end = time_ns() + g_millis * 1000000LL;
+    while ( ( int ) l_rtt.size() < g_roundtrips && time_ns() < l_end )
+    {
+        long long l_start = time_ns();
+        stamp( l_buf.data(), t_size, t_batch, l_start );
+        if ( ipc_send( &l_ping, l_buf.data(), t_batch ) < 0 || ipc_recv( &l_pong, l_buf.data(), t_batch ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to transfer message!" );
+            break;
+        }
+        l_rtt.push_back( time_ns() - l_start );
+    }
+    stamp( l_buf.data(), t_size, t_batch, 0 );
+    ipc_send( &l_ping, l_buf.data(), t_batch );
+    waitpid( l_pid, nullptr, 0 );
+
+    std::vector<long long> l_ow( l_oneway + 1, l_oneway + 1 + l_oneway[ 0 ] );
+    percentiles( l_ow, t_res->oneway );
+    percentiles( l_rtt, t_res->rtt );
+    t_res->samples = l_rtt.size();
+
+    munmap( l_oneway, l_shm_size );
+    ipc_channel_close( &l_ping );
+    ipc_channel_close( &l_pong );
+    return 0;
+}
+
+//***************************************************************************
+// output
+
+void print_header()
+{
+    if ( g_json ) return;
+    printf( "transport,size,batch,placement,msgs_per_sec,mb_per_sec,samples,"
+            "oneway_p50_ns,oneway_p99_ns,oneway_p999_ns,oneway_max_ns,"
+            "rtt_p50_ns,rtt_p99_ns,rtt_p999_ns,rtt_max_ns\n" );
+}
+
+void print_result( int t_type, int t_size, int t_batch, int t_place, result *t_res )
+{
+    if ( g_json )
+        printf( "{\"transport\":\"%s\",\"size\":%d,\"batch\":%d,\"placement\":\"%s\","
+                "\"msgs_per_sec\":%.0f,\"mb_per_sec\":%.2f,\"samples\":%ld,"
+                "\"oneway_ns\":{\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld},"
+                "\"rtt_ns\":{\"p50\":%lld,\"p99\":%lld,\"p999\":%lld,\"max\":%lld}}\n",
+                ipc_names[ t_type ], t_size, t_batch, g_place_names[ t_place ],
+                t_res->msgs_per_sec, t_res->mb_per_sec, t_res->samples,
+                t_res->oneway[ 0 ], t_res->oneway[ 1 ], t_res->oneway[ 2 ], t_res->oneway[ 3 ],
+                t_res->rtt[ 0 ], t_res->rtt[ 1 ], t_res->rtt[ 2 ], t_res->rtt[ 3 ] );
+    else
+        printf( "%s,%d,%d,%s,%.0f,%.2f,%ld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n",
+                ipc_names[ t_type ], t_size, t_batch, g_place_names[ t_place ],
+                t_res->msgs_per_sec, t_res->mb_per_sec, t_res->samples,
+                t_res->oneway[ 0 ], t_res->oneway[ 1 ], t_res->oneway[ 2 ], t_res->oneway[ 3 ],
+                t_res->rtt[ 0 ], t_res->rtt[ 1 ], t_res->rtt[ 2 ], t_res->rtt[ 3 ] );
+    fflush( stdout );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-j" ) )
+            g_json = 1;
+
+        if ( i + 1 < t_narg )
+        {
+            int l_ok = 1;
+            if ( !strcmp( t_args[ i ], "-x" ) )
+                l_ok = parse_names( t_args[ ++i ], ipc_names, IPC_TRANSPORTS, g_transports ) == 0;
+            else if ( !strcmp( t_args[ i ], "-a" ) )
+                l_ok = parse_names( t_args[ ++i ], g_place_names, PLACEMENTS, g_places ) == 0;
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_nsizes = parse_list( t_args[ ++i ], g_sizes );
+            else if ( !strcmp( t_args[ i ], "-b" ) ) g_nbatches = parse_list( t_args[ ++i ], g_batches );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_millis = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_roundtrips = atoi( t_args[ ++i ] );
+            if ( !l_ok )
+            {
+                log_msg( LOG_INFO, "Unknown name in list '%s'!", t_args[ i ] );
+                help( *t_args );
+            }
+        }
+    }
+
+    int l_bad = !g_nsizes || !g_nbatches || g_millis <= 0 || g_roundtrips <= 0;
+    for ( int i = 0; i < g_nsizes; i++ )
+        if ( g_sizes[ i ] < MIN_MSGSIZE || g_sizes[ i ] > 64 * 1024 * 1024 ) l_bad = 1;
+    for ( int i = 0; i < g_nbatches; i++ )
+        if ( g_batches[ i ] <= 0 || g_batches[ i ] > 1024 ) l_bad = 1;
+    if ( l_bad )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    cpu_set_t l_all;
+    CPU_ZERO( &l_all );
+    sched_getaffinity( 0, sizeof( l_all ), &l_all );
+    detect_placements();
+
+    print_header();
+    for ( int p = 0; p < PLACEMENTS; p++ )
+    {
+        if ( !g_places[ p ] ) continue;
+        if ( !g_placement[ p ].available )
+        {
+            log_msg( LOG_INFO, "Placement '%s' is not available on this machine, skipped.", g_place_names[ p ] );
+            continue;
+        }
+        set_cpu( g_placement[ p ].cpu_a, &l_all );
+
+        for ( int t = 0; t < IPC_TRANSPORTS; t++ )
+        {
+            if ( !g_transports[ t ] ) continue;
+            for ( int s = 0; s < g_nsizes; s++ )
+                for ( int b = 0; b < g_nbatches; b++ )
+                {
+                    result l_res;
+                    memset( &l_res, 0, sizeof( l_res ) );
+                    log_msg( LOG_DEBUG, "Test %s size %ld batch %ld placement %s.", ipc_names[ t ],
+                            g_sizes[ s ], g_batches[ b ], g_place_names[ p ] );
+                    if ( test_throughput( t, g_sizes[ s ], g_batches[ b ], &g_placement[ p ], &l_all, &l_res ) < 0 ||
+                         test_latency( t, g_sizes[ s ], g_batches[ b ], &g_placement[ p ], &l_all, &l_res ) < 0 )
+                    {
+                        log_msg( LOG_INFO, "Transport %s does not support size %ld, skipped.",
+                                ipc_names[ t ], g_sizes[ s ] );
+                        continue;
+                    }
+                    print_result( t, g_sizes[ s ], g_batches[ b ], p, &l_res );
+                }
+        }
+    }
+    set_cpu( -1, &l_all );
+    return 0;
+}
@@ -0,0 +1,268 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// One-way channel between two processes over several IPC transports.
+//
+// Channel is created before fork(), one process sends and the other
+// receives fixed-size messages. Several messages can be sent and
+// received by one call (batch):
+//   pipe    - pipe(), batch is written by one write(),
+//   mq      - posix message queue, one message per mq_send(),
+//   unix    - stream Unix socket (socketpair), batch by one write(),
+//   shm     - ring buffer in shared memory (shm_ring.h), futex wake-up,
+//   eventfd - slots in shared memory, eventfd counts full and free slots,
+//             receiver is notified once per batch.
+//
+//***************************************************************************
+
+#ifndef __IPC_TRANSPORT_H
+#define __IPC_TRANSPORT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "shm_ring.h"
+
+#define IPC_PIPE                0
+#define IPC_MQ                  1
+#define IPC_UNIX                2
+#define IPC_SHM                 3
+#define IPC_EVENTFD             4
+#define IPC_TRANSPORTS          5
+
+#define IPC_PIPE_SIZE           ( 1024 * 1024 ) // requested capacity of pipe
+#define IPC_MQ_MAXMSG           10
+#define IPC_EVENTFD_SLOTS       16
+
+static const char *ipc_names[ IPC_TRANSPORTS ] = { "pipe", "mq", "unix", "shm", "eventfd" };
+
+static int g_ipc_mq_serial = 0;         // unique names of queues
+
+struct ipc_channel
+{
+    int type;
+    int msgsize;
+    int rfd, wfd;               // pipe, socket; eventfd: full and free slots
+    mqd_t mq;
+    shm_ring *ring;
+    size_t map_size;
+    char *slots;                // slots of eventfd channel
+    long pos;                   // next slot, local for sender and receiver
+};
+
+// Create channel for messages of t_msgsize bytes. Returns -1 on error (errno).
+static inline int ipc_channel_create( ipc_channel *t_ch, int t_type, int t_msgsize )
+{
+    memset( t_ch, 0, sizeof( *t_ch ) );
+    t_ch->type = t_type;
+    t_ch->msgsize = t_msgsize;
+    t_ch->rfd = t_ch->wfd = -1;
+    t_ch->mq = -1;
+
+    switch ( t_type )
+    {
+    case IPC_PIPE:
+    {
+        int l_fds[ 2 ];
+        if ( pipe( l_fds ) < 0 ) return -1;
+        t_ch->rfd = l_fds[ 0 ];
+        t_ch->wfd = l_fds[ 1 ];
+        // larger pipe is not necessary, failure is ignored
+        fcntl( t_ch->wfd, F_SETPIPE_SZ, IPC_PIPE_SIZE );
+        return 0;
+    }
+    case IPC_UNIX:
+    {
+        int l_fds[ 2 ];
+        if ( socketpair( AF_UNIX, SOCK_STREAM, 0, l_fds ) < 0 ) return -1;
+        t_ch->rfd = l_fds[ 0 ];
+        t_ch->wfd = l_fds[ 1 ];
+        return 0;
+    }
+    case IPC_MQ:
+    {
+        char l_name[ 64 ];
+        sprintf( l_name, "/ipc_bench_%d_%d", getpid(), g_ipc_mq_serial++ );
+        mq_attr l_mqa;
+        memset( &l_mqa, 0, sizeof( l_mqa ) );
+        l_mqa.mq_maxmsg = IPC_MQ_MAXMSG;
+        l_mqa.mq_msgsize = t_msgsize;
+        t_ch->mq = mq_open( l_name, O_RDWR | O_CREAT | O_EXCL, 0600, &l_mqa );
+        if ( t_ch->mq < 0 ) return -1;
+        // descriptor is inherited by fork(), name is not needed
+        mq_unlink( l_name );
+        return 0;
+    }
+    case IPC_SHM:
+    {
+        // capacity is power of 2 for several messages
+        uint64_t l_cap = 64 * 1024;
+        while ( l_cap < 4 * ( ( uint64_t ) t_msgsize + 16 ) )
+            l_cap *= 2;
+        t_ch->map_size = shm_ring_bytes( l_cap );
+        void *l_ptr = mmap( nullptr, t_ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+        if ( l_ptr == MAP_FAILED ) return -1;
+        t_ch->ring = ( shm_ring * ) l_ptr;
+        shm_ring_init( t_ch->ring, l_cap );
+        return 0;
+    }
+    case IPC_EVENTFD:
+    {
+        t_ch->map_size = ( size_t ) IPC_EVENTFD_SLOTS * t_msgsize;
+        void *l_ptr = mmap( nullptr, t_ch->map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+        if ( l_ptr == MAP_FAILED ) return -1;
+        t_ch->slots = ( char * ) l_ptr;
+        t_ch->rfd = eventfd( 0, EFD_SEMAPHORE );
+        t_ch->wfd = eventfd( IPC_EVENTFD_SLOTS, EFD_SEMAPHORE );
+        return t_ch->rfd < 0 || t_ch->wfd < 0 ? -1 : 0;
+    }
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+static inline void ipc_channel_close( ipc_channel *t_ch )
+{
+    if ( t_ch->rfd >= 0 ) close( t_ch->rfd );
+    if ( t_ch->wfd >= 0 ) close( t_ch->wfd );
+    if ( t_ch->mq >= 0 ) mq_close( t_ch->mq );
+    if ( t_ch->ring ) munmap( t_ch->ring, t_ch->map_size );
+    if ( t_ch->slots ) munmap( t_ch->slots, t_ch->map_size );
+    t_ch->rfd = t_ch->wfd = -1;
+    t_ch->mq = -1;
+    t_ch->ring = nullptr;
+    t_ch->slots = nullptr;
+}
+
+static inline int ipc_write_full( int t_fd, const char *t_buf, size_t t_len )
+{
+    while ( t_len )
+    {
+        ssize_t l_ret = write( t_fd, t_buf, t_len );
+        if ( l_ret < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return -1;
+        }
+        t_buf += l_ret;
+        t_len -= l_ret;
+    }
+    return 0;
+}
+
+static inline int ipc_read_full( int t_fd, char *t_buf, size_t t_len )
+{
+    while ( t_len )
+    {
+        ssize_t l_ret = read( t_fd, t_buf, t_len );
+        if ( l_ret <= 0 )
+        {
+            if ( l_ret < 0 && errno == EINTR ) continue;
+            return -1;
+        }
+        t_buf += l_ret;
+        t_len -= l_ret;
+    }
+    return 0;
+}
+
+static inline int ipc_eventfd_add( int t_fd, uint64_t t_val )
+{
+    while ( write( t_fd, &t_val, sizeof( t_val ) ) < 0 )
+        if ( errno != EINTR ) return -1;
+    return 0;
+}
+
+// decrease counter by 1 (EFD_SEMAPHORE), wait while it is 0
+static inline int ipc_eventfd_take( int t_fd )
+{
+    uint64_t l_val;
+    while ( read( t_fd, &l_val, sizeof( l_val ) ) < 0 )
+        if ( errno != EINTR ) return -1;
+    return 0;
+}
+
+// Send t_count messages stored one after another in t_buf. Returns -1 on error.
+static inline int ipc_send( ipc_channel *t_ch, const char *t_buf, int t_count )
+{
+    int l_size = t_ch->msgsize;
+    switch ( t_ch->type )
+    {
+    case IPC_PIPE:
+    case IPC_UNIX:
+        return ipc_write_full( t_ch->wfd, t_buf, ( size_t ) l_size * t_count );
+
+    case IPC_MQ:
+        for ( int i = 0; i < t_count; i++ )
+            while ( mq_send( t_ch->mq, t_buf + ( size_t ) i * l_size, l_size, 0 ) < 0 )
+                if ( errno != EINTR ) return -1;
+        return 0;
+
+    case IPC_SHM:
+        for ( int i = 0; i < t_count; i++ )
+            if ( shm_ring_push( t_ch->ring, t_buf + ( size_t ) i * l_size, l_size ) < 0 ) return -1;
+        return 0;
+
+    case IPC_EVENTFD:
+        // batch is sent in parts which fit into slots, receiver
+        // is notified once per part
+        for ( int i = 0; i < t_count; )
+        {
+            int l_part = t_count - i < IPC_EVENTFD_SLOTS ? t_count - i : IPC_EVENTFD_SLOTS;
+            for ( int k = 0; k < l_part; k++, i++ )
+            {
+                if ( ipc_eventfd_take( t_ch->wfd ) < 0 ) return -1;
+                memcpy( t_ch->slots + ( t_ch->pos++ % IPC_EVENTFD_SLOTS ) * l_size, t_buf + ( size_t ) i * l_size, l_size );
+            }
+            if ( ipc_eventfd_add( t_ch->rfd, l_part ) < 0 ) return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// Receive t_count messages into t_buf. Returns -1 on error or end of channel.
+static inline int ipc_recv( ipc_channel *t_ch, char *t_buf, int t_count )
+{
+    int l_size = t_ch->msgsize;
+    switch ( t_ch->type )
+    {
+    case IPC_PIPE:
+    case IPC_UNIX:
+        return ipc_read_full( t_ch->rfd, t_buf, ( size_t ) l_size * t_count );
+
+    case IPC_MQ:
+        for ( int i = 0; i < t_count; i++ )
+            while ( mq_receive( t_ch->mq, t_buf + ( size_t ) i * l_size, l_size, nullptr ) != l_size )
+                if ( errno != EINTR ) return -1;
+        return 0;
+
+    case IPC_SHM:
+        for ( int i = 0; i < t_count; i++ )
+            shm_ring_pop( t_ch->ring, t_buf + ( size_t ) i * l_size, l_size );
+        return 0;
+
+    case IPC_EVENTFD:
+        for ( int i = 0; i < t_count; i++ )
+        {
+            if ( ipc_eventfd_take( t_ch->rfd ) < 0 ) return -1;
+            memcpy( t_buf + ( size_t ) i * l_size, t_ch->slots + ( t_ch->pos++ % IPC_EVENTFD_SLOTS ) * l_size, l_size );
+            if ( ipc_eventfd_add( t_ch->wfd, 1 ) < 0 ) return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+#endif // __IPC_TRANSPORT_H
@@ -0,0 +1,185 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Tracing of message latency through several IPC hops.
+//
+// Message carries small trace header with timestamps: time of creation,
+// time of sending into current hop and time of receiving from it.
+// Receiver of every hop adds into histograms of its hop queueing time
+// (from send to receive, i.e. transport and waiting in queue) and
+// processing time (from receive to the end of processing). The last
+// receiver adds end-to-end time. Only every N-th message can be traced
+// (sampling), header of untraced message is ignored.
+//
+// Histograms are kept in shared memory TRACE_NAME, every hop is
+// identified by its name and every process has its own slot, so no
+// counter is shared between processes. Statistics are read
+// by trace_read.
+//
+//***************************************************************************
+
+#ifndef __LAT_TRACE_H
+#define __LAT_TRACE_H
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <atomic>
+
+#include "futex.h"
+#include "lat_hist.h"
+
+#define TRACE_NAME              "/ipc_trace"
+#define TRACE_HOPS              8
+#define TRACE_PROCS             16
+#define TRACE_NAME_LEN          32
+
+// state of hop entry
+#define TRACE_FREE              0
+#define TRACE_INIT              1
+#define TRACE_READY             2
+
+// flags of message header
+#define TRACE_ON                1
+
+// header embedded in message
+struct msg_trace
+{
+    uint32_t flags;
+    uint32_t hops;              // number of passed hops
+    int64_t origin_ns;          // creation of message
+    int64_t enqueue_ns;         // sent into current hop
+    int64_t dequeue_ns;         // received from current hop
+};
+
+// statistics of one process for one hop, written by owner only
+struct trace_slot
+{
+    alignas( CACHE_LINE ) std::atomic<int> pid;         // 0 = free
+    lat_hist queue;
+    lat_hist proc;
+    lat_hist total;                                     // end-to-end, the last hop only
+};
+
+struct trace_hop
+{
+    alignas( CACHE_LINE ) std::atomic<int> state;
+    int order;                                          // position in pipeline
+    char name[ TRACE_NAME_LEN ];
+    trace_slot slots[ TRACE_PROCS ];
+};
+
+struct trace_shm
+{
+    trace_hop hops[ TRACE_HOPS ];
+};
+
+// Attach shared memory (create when needed) and return nullptr on error.
+// New memory is filled by zeros, it is valid empty table.
+static inline trace_shm *trace_attach( int t_create )
+{
+    int l_fd = shm_open( TRACE_NAME, O_RDWR | ( t_create ? O_CREAT : 0 ), 0660 );
+    if ( l_fd < 0 ) return nullptr;
+    if ( t_create && ftruncate( l_fd, sizeof( trace_shm ) ) < 0 )
+    {
+        close( l_fd );
+        return nullptr;
+    }
+    void *l_ptr = mmap( nullptr, sizeof( trace_shm ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    return l_ptr == MAP_FAILED ? nullptr : ( trace_shm * ) l_ptr;
+}
+
+// Find or register hop t_name (t_order is its position in pipeline)
+// and claim slot for this process. Slot of finished process is reused,
+// its statistics are kept. Returns nullptr when tables are full, then
+// tracing of hop is disabled.
+static inline trace_slot *trace_open( trace_shm *t_shm, const char *t_name, int t_order )
+{
+    if ( !t_shm ) return nullptr;
+
+    trace_hop *l_hop = nullptr;
+    for ( int i = 0; i < TRACE_HOPS && !l_hop; i++ )
+    {
+        trace_hop *l_cur = &t_shm->hops[ i ];
+        int l_state = TRACE_FREE;
+        if ( l_cur->state.compare_exchange_strong( l_state, TRACE_INIT ) )
+        {
+            strncpy( l_cur->name, t_name, TRACE_NAME_LEN - 1 );
+            l_cur->order = t_order;
+            l_cur->state.store( TRACE_READY, std::memory_order_release );
+            l_hop = l_cur;
+            break;
+        }
+        // other process registers hop just now
+        while ( l_cur->state.load( std::memory_order_acquire ) == TRACE_INIT )
+            sched_yield();
+        if ( !strncmp( l_cur->name, t_name, TRACE_NAME_LEN - 1 ) )
+            l_hop = l_cur;
+    }
+    if ( !l_hop ) return nullptr;
+
+    int l_pid = getpid();
+    for ( int i = 0; i < TRACE_PROCS; i++ )
+    {
+        trace_slot *l_slot = &l_hop->slots[ i ];
+        int l_old = l_slot->pid.load();
+        if ( l_old && ( kill( l_old, 0 ) == 0 || errno != ESRCH ) ) continue;
+        if ( l_slot->pid.compare_exchange_strong( l_old, l_pid ) )
+            return l_slot;
+    }
+    return nullptr;
+}
+
+static inline void trace_close( trace_slot *t_slot )
+{
+    if ( t_slot ) t_slot->pid.store( 0 );
+}
+
+// New message, it is traced when t_sampled is not 0.
+static inline void trace_start( msg_trace *t_trace, int t_sampled )
+{
+    t_trace->flags = t_sampled ? TRACE_ON : 0;
+    t_trace->hops = 0;
+    t_trace->origin_ns = t_sampled ? time_ns() : 0;
+    t_trace->enqueue_ns = t_trace->dequeue_ns = 0;
+}
+
+// Message is being sent into next hop.
+static inline void trace_enqueue( msg_trace *t_trace )
+{
+    if ( t_trace->flags & TRACE_ON ) t_trace->enqueue_ns = time_ns();
+}
+
+// Message was received from hop of t_slot.
+static inline void trace_dequeue( trace_slot *t_slot, msg_trace *t_trace )
+{
+    if ( !( t_trace->flags & TRACE_ON ) ) return;
+    t_trace->dequeue_ns = time_ns();
+    t_trace->hops++;
+    if ( t_slot ) hist_add( &t_slot->queue, t_trace->dequeue_ns - t_trace->enqueue_ns );
+}
+
+// Message received from hop of t_slot was processed.
+static inline void trace_processed( trace_slot *t_slot, msg_trace *t_trace )
+{
+    if ( !( t_trace->flags & TRACE_ON ) || !t_slot ) return;
+    hist_add( &t_slot->proc, time_ns() - t_trace->dequeue_ns );
+}
+
+// Message reached the end of pipeline.
+static inline void trace_finish( trace_slot *t_slot, msg_trace *t_trace )
+{
+    if ( !( t_trace->flags & TRACE_ON ) || !t_slot ) return;
+    hist_add( &t_slot->total, time_ns() - t_trace->origin_ns );
+}
+
+#endif // __LAT_TRACE_H
@@ -0,0 +1,270 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Pipeline of processes with latency tracing (lat_trace.h).
+//
+// Producer creates messages and sends them through three hops:
+//   producer -> mq -> stage 1 -> pipe -> stage 2 -> shm ring -> stage 3
+// Every stage simulates work of given length. Messages carry trace header,
+// stages record queueing and processing time of their hop into shared
+// memory and the last stage records end-to-end latency. Breakdown per hop
+// is printed by trace_read.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "ipc_transport.h"
+#include "lat_trace.h"
+
+#define STAGES                  3
+
+struct record
+{
+    msg_trace trace;
+    long seq;                           // -1 = end of test
+};
+
+const int g_hop_types[ STAGES ] = { IPC_MQ, IPC_PIPE, IPC_SHM };
+
+// parameters of test
+long g_messages = 200000;
+int g_size = 64;
+int g_sample = 1;
+int g_work_us[ STAGES ] = { 0, 0, 0 };
+int g_rate = 0;
+
+ipc_channel g_hops[ STAGES ];
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Pipeline mq -> pipe -> shm with latency tracing.\n"
+        "\n"
+        "  Use: %s [-h -d] [-n messages] [-s size] [-S sample] [-w us,us,us] [-R rate]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -n  number of messages (default %ld)\n"
+        "    -s  size of message (min. %d, default %d)\n"
+        "    -S  trace every S-th message, 0 = tracing off (default %d)\n"
+        "    -w  work of stages 1, 2 and 3 in us (default 0,0,0)\n"
+        "    -R  messages per second, 0 = as fast as possible (default %d)\n"
+        "\n"
+        "  Statistics are printed by trace_read.\n"
+        "\n", t_name, g_messages, ( int ) sizeof( record ), g_size, g_sample, g_rate );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void work( int t_us )
+{
+    if ( !t_us ) return;
+    long long l_end = time_ns() + t_us * 1000LL;
+    while ( time_ns() < l_end )
+        cpu_relax();
+}
+
+// stage t_stage receives from hop t_stage and sends into the next one
+void stage( trace_shm *t_shm, int t_stage )
+{
+    trace_slot *l_slot = t_shm ? trace_open( t_shm, ipc_names[ g_hop_types[ t_stage ] ], t_stage ) : nullptr;
+    if ( t_shm && !l_slot )
+        log_msg( LOG_INFO, "Stage %d: table of tracing is full, hop is not traced.", t_stage + 1 );
+
+    char *l_buf = ( char * ) malloc( g_size );
+    record *l_rec = ( record * ) l_buf;
+    long l_count = 0;
+    while ( 1 )
+    {
+        if ( ipc_recv( &g_hops[ t_stage ], l_buf, 1 ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Stage %d: unable to receive message!", t_stage + 1 );
+            exit( 1 );
+        }
+        int l_end = l_rec->seq < 0;
+        if ( !l_end )
+        {
+            trace_dequeue( l_slot, &l_rec->trace );
+            work( g_work_us[ t_stage ] );
+            trace_processed( l_slot, &l_rec->trace );
+            l_count++;
+        }
+
+        if ( t_stage == STAGES - 1 )
+        {
+            if ( l_end ) break;
+            trace_finish( l_slot, &l_rec->trace );
+            continue;
+        }
+
+        trace_enqueue( &l_rec->trace );
+        if ( ipc_send( &g_hops[ t_stage + 1 ], l_buf, 1 ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Stage %d: unable to send message!", t_stage + 1 );
+            exit( 1 );
+        }
+        if ( l_end ) break;
+    }
+
+    log_msg( LOG_DEBUG, "Stage %d: %ld messages processed.", t_stage + 1, l_count );
+    trace_close( l_slot );
+    free( l_buf );
+    exit( 0 );
+}
+
+void producer()
+{
+    char *l_buf = ( char * ) malloc( g_size );
+    memset( l_buf, 0, g_size );
+    record *l_rec = ( record * ) l_buf;
+
+    long long l_interval = g_rate ? 1000000000LL / g_rate : 0;
+    long long l_start = time_ns(), l_next = l_start;
+    for ( long i = 0; i <= g_messages; i++ )
+    {
+        if ( l_interval && i < g_messages )
+        {
+            l_next += l_interval;
+            long long l_now = time_ns();
+            if ( l_next > l_now )
+            {
+                timespec l_ts = { ( l_next - l_now ) / 1000000000LL, ( l_next - l_now ) % 1000000000LL };
+                nanosleep( &l_ts, nullptr );
+            }
+        }
+
+        // the last message is end of test
+        l_rec->seq = i < g_messages ? i : -1;
+        trace_start( &l_rec->trace, g_sample && i < g_messages && i % g_sample == 0 );
+        trace_enqueue( &l_rec->trace );
+        if ( ipc_send( &g_hops[ 0 ], l_buf, 1 ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to send message!" );
+            exit( 1 );
+        }
+    }
+
+    for ( int i = 0; i < STAGES; i++ )
+        wait( nullptr );
+    double l_time = ( time_ns() - l_start ) / 1e9;
+    log_msg( LOG_INFO, "%ld messages of %d bytes in %.3f s, %.0f msgs/s.", g_messages, g_size, l_time, g_messages / l_time );
+    free( l_buf );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-n" ) ) g_messages = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_size = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-S" ) ) g_sample = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-R" ) ) g_rate = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-w" ) )
+                sscanf( t_args[ ++i ], "%d,%d,%d", &g_work_us[ 0 ], &g_work_us[ 1 ], &g_work_us[ 2 ] );
+        }
+    }
+
+    if ( g_messages <= 0 || g_size < ( int ) sizeof( record ) || g_sample < 0 || g_rate < 0 ||
+         g_work_us[ 0 ] < 0 || g_work_us[ 1 ] < 0 || g_work_us[ 2 ] < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    trace_shm *l_shm = nullptr;
+    if ( g_sample )
+    {
+        l_shm = trace_attach( 1 );
+        if ( !l_shm ) log_msg( LOG_ERROR, "Unable to attach statistics of tracing, tracing is off!" );
+    }
+
+    for ( int i = 0; i < STAGES; i++ )
+        if ( ipc_channel_create( &g_hops[ i ], g_hop_types[ i ], g_size ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create %s channel!", ipc_names[ g_hop_types[ i ] ] );
+            exit( 1 );
+        }
+
+    fflush( stdout );
+    for ( int i = 0; i < STAGES; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            stage( l_shm, i );
+    }
+
+    producer();
+
+    for ( int i = 0; i < STAGES; i++ )
+        ipc_channel_close( &g_hops[ i ] );
+    if ( l_shm ) munmap( l_shm, sizeof( trace_shm ) );
+    return 0;
+}
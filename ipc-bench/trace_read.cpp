@@ -0,0 +1,216 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Reader of latency tracing (lat_trace.h).
+//
+// Hops are printed in order of pipeline. For every hop percentiles
+// of queueing and processing time are printed together with share of
+// hop on the sum of mean times of all hops, so the slowest stage is
+// visible at first sight. End-to-end latency is printed at the end.
+// With -p every process is printed too, with -i statistics are printed
+// periodically.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "lat_trace.h"
+
+int g_interval = 0;
+int g_per_proc = 0;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Reader of latency tracing.\n"
+        "\n"
+        "  Use: %s [-h -d -r -p] [-i seconds]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean statistics (remove shared memory) \n"
+        "    -p  print statistics of every process \n"
+        "    -i  print statistics periodically \n"
+        "\n", t_name );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+double hist_mean( const lat_hist *t_hist )
+{
+    uint64_t l_count = t_hist->count.load( std::memory_order_relaxed );
+    return l_count ? ( double ) t_hist->sum.load( std::memory_order_relaxed ) / l_count : 0.0;
+}
+
+void print_line( const char *t_name, const lat_hist *t_queue, const lat_hist *t_proc, double t_all )
+{
+    double l_mean = hist_mean( t_queue ) + hist_mean( t_proc );
+    printf( "%-20s %10lu msgs  %5.1f %%  "
+            "queue p50 %9lu  p99 %9lu  p99.9 %9lu  max %10lu ns  "
+            "proc p50 %9lu  p99 %9lu  max %10lu ns\n",
+            t_name, ( unsigned long ) t_queue->count.load(), t_all > 0 ? 100.0 * l_mean / t_all : 0.0,
+            ( unsigned long ) hist_percentile( t_queue, 50 ), ( unsigned long ) hist_percentile( t_queue, 99 ),
+            ( unsigned long ) hist_percentile( t_queue, 99.9 ), ( unsigned long ) t_queue->max.load(),
+            ( unsigned long ) hist_percentile( t_proc, 50 ), ( unsigned long ) hist_percentile( t_proc, 99 ),
+            ( unsigned long ) t_proc->max.load() );
+}
+
+void print_stats( trace_shm *t_shm )
+{
+    static lat_hist l_queue[ TRACE_HOPS ], l_proc[ TRACE_HOPS ], l_total;
+    trace_hop *l_hops[ TRACE_HOPS ];
+    int l_nhops = 0;
+
+    // merge slots of all processes, hops are sorted by order
+    hist_clear( &l_total );
+    double l_all = 0;
+    for ( int h = 0; h < TRACE_HOPS; h++ )
+    {
+        trace_hop *l_hop = &t_shm->hops[ h ];
+        if ( l_hop->state.load( std::memory_order_acquire ) != TRACE_READY ) continue;
+
+        int l_pos = l_nhops++;
+        while ( l_pos > 0 && l_hops[ l_pos - 1 ]->order > l_hop->order )
+        {
+            l_hops[ l_pos ] = l_hops[ l_pos - 1 ];
+            l_pos--;
+        }
+        l_hops[ l_pos ] = l_hop;
+    }
+    for ( int h = 0; h < l_nhops; h++ )
+    {
+        hist_clear( &l_queue[ h ] );
+        hist_clear( &l_proc[ h ] );
+        for ( int i = 0; i < TRACE_PROCS; i++ )
+        {
+            trace_slot *l_slot = &l_hops[ h ]->slots[ i ];
+            hist_merge( &l_queue[ h ], &l_slot->queue );
+            hist_merge( &l_proc[ h ], &l_slot->proc );
+            hist_merge( &l_total, &l_slot->total );
+        }
+        l_all += hist_mean( &l_queue[ h ] ) + hist_mean( &l_proc[ h ] );
+    }
+
+    for ( int h = 0; h < l_nhops; h++ )
+    {
+        print_line( l_hops[ h ]->name, &l_queue[ h ], &l_proc[ h ], l_all );
+        if ( !g_per_proc ) continue;
+        for ( int i = 0; i < TRACE_PROCS; i++ )
+        {
+            trace_slot *l_slot = &l_hops[ h ]->slots[ i ];
+            if ( !l_slot->queue.count.load( std::memory_order_relaxed ) ) continue;
+            char l_name[ 32 ];
+            int l_pid = l_slot->pid.load();
+            if ( l_pid ) sprintf( l_name, "  pid %d", l_pid );
+            else sprintf( l_name, "  finished (slot %d)", i );
+            print_line( l_name, &l_slot->queue, &l_slot->proc, l_all );
+        }
+    }
+
+    printf( "%-20s %10lu msgs  mean %9.0f  p50 %9lu  p99 %9lu  p99.9 %9lu  max %10lu ns\n",
+            "end-to-end", ( unsigned long ) l_total.count.load(), hist_mean( &l_total ),
+            ( unsigned long ) hist_percentile( &l_total, 50 ), ( unsigned long ) hist_percentile( &l_total, 99 ),
+            ( unsigned long ) hist_percentile( &l_total, 99.9 ), ( unsigned long ) l_total.max.load() );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-p" ) )
+            g_per_proc = 1;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( TRACE_NAME );
+            log_msg( LOG_INFO, "Statistics cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg && !strcmp( t_args[ i ], "-i" ) )
+            g_interval = atoi( t_args[ ++i ] );
+    }
+
+    if ( g_interval < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    trace_shm *l_shm = trace_attach( 0 );
+    if ( !l_shm )
+    {
+        log_msg( LOG_ERROR, "Unable to attach statistics of tracing!" );
+        exit( 1 );
+    }
+
+    while ( 1 )
+    {
+        print_stats( l_shm );
+        if ( !g_interval ) break;
+        printf( "\n" );
+        fflush( stdout );
+        sleep( g_interval );
+    }
+
+    munmap( l_shm, sizeof( trace_shm ) );
+    return 0;
+}
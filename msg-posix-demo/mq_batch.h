@@ -0,0 +1,152 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Batching of small records into messages of posix message queue.
+//
+// Every mq_send/mq_receive is syscall with copy of message, so sending
+// of many small records one by one is limited by syscall overhead.
+// Sender appends records into buffer and buffer is sent as one message
+// when it is full (max. bytes or max. records) or when the oldest
+// record waits longer than linger time. Every record in message is
+// preceded by its length, receiver splits message back into records.
+//
+// Message size of queue limits size of batch. Default limits of Linux
+// are /proc/sys/fs/mqueue/msgsize_max (8192) and msg_max (10).
+//
+//***************************************************************************
+
+#ifndef __MQ_BATCH_H
+#define __MQ_BATCH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+
+struct mq_batch
+{
+    mqd_t mq;
+    char *buf;
+    int size;                   // max. bytes in message (mq_msgsize)
+    int max_records;            // max. records in message
+    long long linger_ns;        // max. delay of the first record
+    int used;                   // bytes in buffer
+    int records;                // records in buffer
+    long long first_ns;         // time of the first record in buffer
+    long messages;              // statistics: sent messages
+};
+
+typedef uint16_t mq_rec_len_t;
+
+static inline long long mq_batch_time_ns()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+// Open queue t_name with given geometry, it is created when needed.
+// Existing queue keeps its geometry, real one is returned in t_attr.
+static inline mqd_t mq_batch_open( const char *t_name, int t_flags, long t_maxmsg, long t_msgsize, mq_attr *t_attr )
+{
+    mq_attr l_mqa;
+    memset( &l_mqa, 0, sizeof( l_mqa ) );
+    l_mqa.mq_maxmsg = t_maxmsg;
+    l_mqa.mq_msgsize = t_msgsize;
+
+    mqd_t l_mq = mq_open( t_name, t_flags | O_CREAT, 0660, &l_mqa );
+    if ( l_mq >= 0 && t_attr ) mq_getattr( l_mq, t_attr );
+    return l_mq;
+}
+
+// Returns -1 when buffer can not be allocated.
+static inline int mq_batch_init( mq_batch *t_batch, mqd_t t_mq, int t_size, int t_max_records, long long t_linger_ns )
+{
+    t_batch->mq = t_mq;
+    t_batch->buf = ( char * ) malloc( t_size );
+    t_batch->size = t_size;
+    t_batch->max_records = t_max_records;
+    t_batch->linger_ns = t_linger_ns;
+    t_batch->used = 0;
+    t_batch->records = 0;
+    t_batch->first_ns = 0;
+    t_batch->messages = 0;
+    return t_batch->buf ? 0 : -1;
+}
+
+static inline void mq_batch_free( mq_batch *t_batch )
+{
+    free( t_batch->buf );
+    t_batch->buf = nullptr;
+}
+
+// Send buffered records as one message. Returns -1 on error (errno).
+static inline int mq_batch_flush( mq_batch *t_batch, unsigned int t_prio = 0 )
+{
+    if ( !t_batch->records ) return 0;
+
+    int l_ret;
+    while ( ( l_ret = mq_send( t_batch->mq, t_batch->buf, t_batch->used, t_prio ) ) < 0 && errno == EINTR );
+    if ( l_ret < 0 ) return -1;
+
+    t_batch->used = 0;
+    t_batch->records = 0;
+    t_batch->messages++;
+    return 0;
+}
+
+// Flush buffer when the oldest record waits too long. Sender which
+// does not add records for a long time must call it periodically.
+static inline int mq_batch_poll( mq_batch *t_batch )
+{
+    if ( t_batch->records && mq_batch_time_ns() - t_batch->first_ns >= t_batch->linger_ns )
+        return mq_batch_flush( t_batch );
+    return 0;
+}
+
+// Append record. Returns -1 on error (errno), EMSGSIZE for too long record.
+static inline int mq_batch_add( mq_batch *t_batch, const void *t_data, int t_len )
+{
+    int l_need = sizeof( mq_rec_len_t ) + t_len;
+    if ( l_need > t_batch->size || t_len > UINT16_MAX )
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if ( t_batch->used + l_need > t_batch->size && mq_batch_flush( t_batch ) < 0 )
+        return -1;
+
+    if ( !t_batch->records ) t_batch->first_ns = mq_batch_time_ns();
+
+    mq_rec_len_t l_len = t_len;
+    memcpy( t_batch->buf + t_batch->used, &l_len, sizeof( l_len ) );
+    memcpy( t_batch->buf + t_batch->used + sizeof( l_len ), t_data, t_len );
+    t_batch->used += l_need;
+    t_batch->records++;
+
+    if ( t_batch->records >= t_batch->max_records )
+        return mq_batch_flush( t_batch );
+    return mq_batch_poll( t_batch );
+}
+
+// Iterate records in received message t_msg of t_len bytes.
+// *t_pos must be 0 at start. Returns length of record or -1 at end.
+static inline int mq_batch_next( const char *t_msg, int t_len, int *t_pos, const char **t_rec )
+{
+    mq_rec_len_t l_len;
+    if ( *t_pos + ( int ) sizeof( l_len ) > t_len ) return -1;
+    memcpy( &l_len, t_msg + *t_pos, sizeof( l_len ) );
+    if ( *t_pos + ( int ) sizeof( l_len ) + l_len > t_len ) return -1;
+
+    *t_rec = t_msg + *t_pos + sizeof( l_len );
+    *t_pos += sizeof( l_len ) + l_len;
+    return l_len;
+}
+
+#endif // __MQ_BATCH_H
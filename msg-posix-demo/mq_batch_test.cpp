@@ -0,0 +1,266 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Batching of records in posix message queue (mq_batch.h).
+//
+// Producer sends records (time of creation and sequence number) to child
+// process through message queue. Records are packed into messages by
+// several batch sizes, batch is sent when it is full or when linger time
+// expires. Consumer reports records per second and percentiles of latency
+// from creation of record to its receiving.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <mqueue.h>
+#include <vector>
+#include <algorithm>
+
+#include "mq_batch.h"
+
+#define MQ_NAME                 "/mq_batch_test"
+
+struct record
+{
+    long long created_ns;
+    long seq;
+};
+
+// parameters of test
+long g_records = 1000000;
+long g_maxmsg = 10;
+long g_msgsize = 8192;
+int g_linger_us = 1000;
+int g_gap_ns = 0;
+int g_batch = 0;                        // 0 = several batch sizes
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Batching of records in message queue.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-n records] [-b batch] [-l linger_us] [-i gap_ns]\n"
+        "         [-m maxmsg] [-s msgsize]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean message queue \n"
+        "    -n  number of records in one test (default %ld)\n"
+        "    -b  records in one message (default 1, 4, 16 ... max.)\n"
+        "    -l  max. delay of record in batch in us (default %d)\n"
+        "    -i  time between records in ns (default %d)\n"
+        "    -m  max. messages in queue (default %ld)\n"
+        "    -s  max. size of message (default %ld)\n"
+        "\n", t_name, g_records, g_linger_us, g_gap_ns, g_maxmsg, g_msgsize );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void consumer( mqd_t t_mq, int t_batch )
+{
+    std::vector<long long> l_lat;
+    l_lat.reserve( g_records );
+    char *l_msg = ( char * ) malloc( g_msgsize );
+    long l_messages = 0, l_expected = 0, l_lost = 0;
+    long long l_first = 0;
+
+    while ( 1 )
+    {
+        int l_len = mq_receive( t_mq, l_msg, g_msgsize, nullptr );
+        if ( l_len < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to receive message!" );
+            exit( 1 );
+        }
+        // empty message is end of test
+        if ( !l_len ) break;
+        l_messages++;
+
+        long long l_now = mq_batch_time_ns();
+        const char *l_rec;
+        int l_pos = 0, l_rlen;
+        while ( ( l_rlen = mq_batch_next( l_msg, l_len, &l_pos, &l_rec ) ) >= 0 )
+        {
+            record l_data;
+            memcpy( &l_data, l_rec, sizeof( l_data ) );
+            if ( !l_first ) l_first = l_data.created_ns;
+            if ( l_data.seq != l_expected ) l_lost++;
+            l_expected = l_data.seq + 1;
+            l_lat.push_back( l_now - l_data.created_ns );
+        }
+    }
+
+    long long l_time = mq_batch_time_ns() - l_first;
+    long l_count = l_lat.size();
+    std::sort( l_lat.begin(), l_lat.end() );
+    printf( "batch %4d  %8ld messages  %11.0f records/s  latency p50 %9lld  p99 %9lld  max %10lld ns%s\n",
+            t_batch, l_messages, l_time > 0 ? l_count * 1e9 / l_time : 0.0,
+            l_count ? l_lat[ l_count / 2 ] : 0, l_count ? l_lat[ l_count * 99 / 100 ] : 0,
+            l_count ? l_lat[ l_count - 1 ] : 0,
+            l_count == g_records && !l_lost ? "" : "  RECORDS LOST!" );
+    free( l_msg );
+    exit( 0 );
+}
+
+void producer( mqd_t t_mq, int t_batch )
+{
+    mq_batch l_batch;
+    if ( mq_batch_init( &l_batch, t_mq, g_msgsize, t_batch, g_linger_us * 1000LL ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate buffer!" );
+        exit( 1 );
+    }
+
+    long long l_next = mq_batch_time_ns();
+    for ( long i = 0; i < g_records; i++ )
+    {
+        if ( g_gap_ns )
+        {
+            // records come slowly, linger time must be checked while waiting
+            l_next += g_gap_ns;
+            while ( mq_batch_time_ns() < l_next )
+                mq_batch_poll( &l_batch );
+        }
+
+        record l_data = { mq_batch_time_ns(), i };
+        if ( mq_batch_add( &l_batch, &l_data, sizeof( l_data ) ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to send message!" );
+            exit( 1 );
+        }
+    }
+
+    mq_batch_flush( &l_batch );
+    log_msg( LOG_DEBUG, "Sent %ld messages.", l_batch.messages );
+    mq_batch_free( &l_batch );
+
+    while ( mq_send( t_mq, "", 0, 0 ) < 0 && errno == EINTR );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            log_msg( LOG_INFO, "Clean message queue." );
+            mq_unlink( MQ_NAME );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-n" ) ) g_records = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-b" ) ) g_batch = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-l" ) ) g_linger_us = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-i" ) ) g_gap_ns = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-m" ) ) g_maxmsg = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_msgsize = atol( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_records <= 0 || g_batch < 0 || g_linger_us < 0 || g_gap_ns < 0 || g_maxmsg <= 0 ||
+         g_msgsize < ( long ) ( sizeof( mq_rec_len_t ) + sizeof( record ) ) )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    // queue is created again with required geometry
+    mq_unlink( MQ_NAME );
+    mq_attr l_attr;
+    mqd_t l_mq = mq_batch_open( MQ_NAME, O_RDWR, g_maxmsg, g_msgsize, &l_attr );
+    if ( l_mq < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create message queue (see /proc/sys/fs/mqueue/)!" );
+        exit( 1 );
+    }
+    log_msg( LOG_INFO, "Queue has %ld messages of %ld bytes.", l_attr.mq_maxmsg, l_attr.mq_msgsize );
+
+    int l_max = g_msgsize / ( sizeof( mq_rec_len_t ) + sizeof( record ) );
+    for ( int l_size = g_batch ? g_batch : 1; l_size <= l_max; l_size *= 4 )
+    {
+        fflush( stdout );
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            consumer( l_mq, l_size );
+
+        producer( l_mq, l_size );
+        waitpid( l_pid, nullptr, 0 );
+        if ( g_batch ) break;
+    }
+
+    mq_close( l_mq );
+    mq_unlink( MQ_NAME );
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Pool of large messages (blobs) in shared memory.
+//
+// Message queue copies every message into kernel and back and size
+// of message is limited. Large payload is written once into free slot
+// of pool in shared memory and only small descriptor (slot, generation,
+// offset, length) is sent through message queue. Receiver reads payload
+// directly from shared memory and releases slot. Generation of slot is
+// increased by every release, so stale descriptor is recognized.
+// Free slots are counted by process-shared semaphore, sender waits
+// when all slots are used.
+//
+//***************************************************************************
+
+#ifndef __MQ_BLOB_H
+#define __MQ_BLOB_H
+
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+
+#define BLOB_MAX_SLOTS          64
+#define BLOB_PAGE               4096
+
+// state of slot
+#define BLOB_FREE               0
+#define BLOB_USED               1
+
+struct blob_desc
+{
+    uint32_t slot;
+    uint32_t generation;
+    uint64_t offset;            // offset of payload in pool
+    uint64_t length;
+};
+
+struct blob_slot
+{
+    std::atomic<int> state;
+    std::atomic<uint32_t> generation;
+};
+
+struct blob_pool
+{
+    uint32_t slots;
+    uint64_t slot_size;
+    uint64_t data_offset;       // offset of the first slot from start of pool
+    uint64_t map_size;          // size of shared memory
+    sem_t free_slots;
+    blob_slot slot[ BLOB_MAX_SLOTS ];
+};
+
+static inline size_t blob_header_size()
+{
+    return ( sizeof( blob_pool ) + BLOB_PAGE - 1 ) / BLOB_PAGE * BLOB_PAGE;
+}
+
+static inline blob_pool *blob_map( int t_fd, size_t t_size )
+{
+    void *l_ptr = mmap( nullptr, t_size, PROT_READ | PROT_WRITE, MAP_SHARED, t_fd, 0 );
+    close( t_fd );
+    return l_ptr == MAP_FAILED ? nullptr : ( blob_pool * ) l_ptr;
+}
+
+// Create new pool t_name with t_slots slots of t_slot_size bytes.
+// Returns nullptr on error (errno).
+static inline blob_pool *blob_pool_create( const char *t_name, int t_slots, uint64_t t_slot_size )
+{
+    if ( t_slots <= 0 || t_slots > BLOB_MAX_SLOTS )
+    {
+        errno = EINVAL;
+        return nullptr;
+    }
+    t_slot_size = ( t_slot_size + BLOB_PAGE - 1 ) / BLOB_PAGE * BLOB_PAGE;
+    size_t l_size = blob_header_size() + t_slots * t_slot_size;
+
+    shm_unlink( t_name );
+    int l_fd = shm_open( t_name, O_RDWR | O_CREAT | O_EXCL, 0660 );
+    if ( l_fd < 0 ) return nullptr;
+    if ( ftruncate( l_fd, l_size ) < 0 )
+    {
+        close( l_fd );
+        shm_unlink( t_name );
+        return nullptr;
+    }
+
+    blob_pool *l_pool = blob_map( l_fd, l_size );
+    if ( !l_pool ) return nullptr;
+    l_pool->map_size = l_size;
+    l_pool->slots = t_slots;
+    l_pool->slot_size = t_slot_size;
+    l_pool->data_offset = blob_header_size();
+    for ( int i = 0; i < t_slots; i++ )
+    {
+        l_pool->slot[ i ].state.store( BLOB_FREE );
+        l_pool->slot[ i ].generation.store( 0 );
+    }
+    sem_init( &l_pool->free_slots, 1, t_slots );
+    return l_pool;
+}
+
+// Attach existing pool, size is taken from shared memory object.
+static inline blob_pool *blob_pool_attach( const char *t_name )
+{
+    int l_fd = shm_open( t_name, O_RDWR, 0 );
+    if ( l_fd < 0 ) return nullptr;
+    struct stat l_stat;
+    if ( fstat( l_fd, &l_stat ) < 0 || l_stat.st_size < ( off_t ) blob_header_size() )
+    {
+        close( l_fd );
+        errno = EINVAL;
+        return nullptr;
+    }
+    return blob_map( l_fd, l_stat.st_size );
+}
+
+static inline void blob_pool_detach( blob_pool *t_pool )
+{
+    munmap( t_pool, t_pool->map_size );
+}
+
+// Allocate slot for payload of t_length bytes, wait for free slot.
+// Returns address for payload and fills descriptor, nullptr on error.
+static inline char *blob_alloc( blob_pool *t_pool, uint64_t t_length, blob_desc *t_desc )
+{
+    if ( t_length > t_pool->slot_size )
+    {
+        errno = EMSGSIZE;
+        return nullptr;
+    }
+
+    while ( sem_wait( &t_pool->free_slots ) < 0 )
+        if ( errno != EINTR ) return nullptr;
+
+    // semaphore guarantees that one slot is free
+    for ( uint32_t i = 0; ; i = ( i + 1 ) % t_pool->slots )
+    {
+        int l_free = BLOB_FREE;
+        if ( !t_pool->slot[ i ].state.compare_exchange_strong( l_free, BLOB_USED ) ) continue;
+
+        t_desc->slot = i;
+        t_desc->generation = t_pool->slot[ i ].generation.load();
+        t_desc->offset = t_pool->data_offset + i * t_pool->slot_size;
+        t_desc->length = t_length;
+        return ( char * ) t_pool + t_desc->offset;
+    }
+}
+
+// Address of received payload, nullptr for invalid or stale descriptor.
+static inline const char *blob_get( blob_pool *t_pool, const blob_desc *t_desc )
+{
+    if ( t_desc->slot >= t_pool->slots || t_desc->length > t_pool->slot_size ||
+         t_desc->offset + t_desc->length > t_pool->map_size ||
+         t_pool->slot[ t_desc->slot ].state.load() != BLOB_USED ||
+         t_pool->slot[ t_desc->slot ].generation.load() != t_desc->generation )
+        return nullptr;
+    return ( const char * ) t_pool + t_desc->offset;
+}
+
+// Receiver returns slot into pool.
+static inline void blob_release( blob_pool *t_pool, const blob_desc *t_desc )
+{
+    if ( t_desc->slot >= t_pool->slots ) return;
+    blob_slot *l_slot = &t_pool->slot[ t_desc->slot ];
+    uint32_t l_gen = t_desc->generation;
+    // only the first release of descriptor is valid
+    if ( !l_slot->generation.compare_exchange_strong( l_gen, l_gen + 1 ) ) return;
+    l_slot->state.store( BLOB_FREE );
+    sem_post( &t_pool->free_slots );
+}
+
+#endif // __MQ_BLOB_H
@@ -0,0 +1,304 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Large messages through posix message queue.
+//
+// Producer sends payloads of given size to consumer (child process):
+//   copy - payload is split into messages of max. size of queue
+//          and every message is copied into kernel and back,
+//   blob - payload is written into slot of shared memory pool (mq_blob.h)
+//          and only descriptor of payload goes through queue.
+// Consumer reads whole payload (sum of its words) and reports payloads
+// per second and throughput. Payloads are 4 KB - 16 MB by default.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <mqueue.h>
+
+#include "mq_batch.h"
+#include "mq_blob.h"
+
+#define MQ_NAME                 "/mq_blob_test"
+#define POOL_NAME               "/mq_blob_pool"
+
+#define MODE_COPY               0
+#define MODE_BLOB               1
+
+// parameters of test
+long g_total_mb = 512;
+long g_payload = 0;                     // 0 = 4 KB .. 16 MB
+int g_slots = 8;
+
+mq_attr g_attr;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Large messages through message queue.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-s payload_bytes] [-m total_MB] [-n slots]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean message queue and pool \n"
+        "    -s  size of payload (default 4 KB, 64 KB, 1 MB and 16 MB)\n"
+        "    -m  data sent in one test in MB (default %ld)\n"
+        "    -n  slots in pool (max. %d, default %d)\n"
+        "\n", t_name, g_total_mb, BLOB_MAX_SLOTS, g_slots );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+uint64_t sum_words( const char *t_data, long t_len )
+{
+    uint64_t l_sum = 0;
+    long l_words = t_len / sizeof( uint64_t );
+    const uint64_t *l_ptr = ( const uint64_t * ) t_data;
+    for ( long i = 0; i < l_words; i++ )
+        l_sum += l_ptr[ i ];
+    return l_sum;
+}
+
+void consumer( mqd_t t_mq, int t_mode, long t_payload, long t_count )
+{
+    char *l_msg = ( char * ) malloc( g_attr.mq_msgsize );
+    char *l_buf = t_mode == MODE_COPY ? ( char * ) malloc( t_payload ) : nullptr;
+    blob_pool *l_pool = t_mode == MODE_BLOB ? blob_pool_attach( POOL_NAME ) : nullptr;
+    if ( !l_msg || ( t_mode == MODE_COPY && !l_buf ) || ( t_mode == MODE_BLOB && !l_pool ) )
+    {
+        log_msg( LOG_ERROR, "Unable to prepare consumer!" );
+        exit( 1 );
+    }
+
+    uint64_t l_sum = 0;
+    long l_errors = 0;
+    for ( long p = 0; p < t_count; p++ )
+    {
+        if ( t_mode == MODE_COPY )
+        {
+            // payload is split into several messages
+            for ( long l_pos = 0; l_pos < t_payload; )
+            {
+                int l_len = mq_receive( t_mq, l_msg, g_attr.mq_msgsize, nullptr );
+                if ( l_len < 0 )
+                {
+                    if ( errno == EINTR ) continue;
+                    log_msg( LOG_ERROR, "Unable to receive message!" );
+                    exit( 1 );
+                }
+                memcpy( l_buf + l_pos, l_msg, l_len );
+                l_pos += l_len;
+            }
+            l_sum += sum_words( l_buf, t_payload );
+        }
+        else
+        {
+            blob_desc l_desc;
+            int l_len = mq_receive( t_mq, l_msg, g_attr.mq_msgsize, nullptr );
+            if ( l_len < 0 && errno == EINTR ) { p--; continue; }
+            memcpy( &l_desc, l_msg, sizeof( l_desc ) );
+            const char *l_data = l_len == sizeof( l_desc ) ? blob_get( l_pool, &l_desc ) : nullptr;
+            if ( !l_data )
+            {
+                l_errors++;
+                continue;
+            }
+            l_sum += sum_words( l_data, l_desc.length );
+            blob_release( l_pool, &l_desc );
+        }
+    }
+
+    log_msg( LOG_DEBUG, "Sum of data %lx.", ( unsigned long ) l_sum );
+    if ( l_errors ) log_msg( LOG_INFO, "%ld invalid descriptors!", l_errors );
+    exit( l_errors ? 1 : 0 );
+}
+
+void run_test( mqd_t t_mq, int t_mode, long t_payload )
+{
+    const char *l_names[] = { "copy", "blob" };
+    long l_count = g_total_mb * 1024 * 1024 / t_payload;
+    if ( l_count < 1 ) l_count = 1;
+
+    blob_pool *l_pool = nullptr;
+    char *l_buf = nullptr;
+    if ( t_mode == MODE_BLOB )
+        l_pool = blob_pool_create( POOL_NAME, g_slots, t_payload );
+    else
+        l_buf = ( char * ) malloc( t_payload );
+    if ( !l_pool && !l_buf )
+    {
+        log_msg( LOG_ERROR, "Unable to allocate memory for payload!" );
+        exit( 1 );
+    }
+
+    fflush( stdout );
+    int l_pid = fork();
+    if ( l_pid < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+    if ( l_pid == 0 )
+        consumer( t_mq, t_mode, t_payload, l_count );
+
+    long long l_start = mq_batch_time_ns();
+    for ( long p = 0; p < l_count; p++ )
+    {
+        if ( t_mode == MODE_COPY )
+        {
+            // payload is produced once and copied by every message
+            memset( l_buf, p, t_payload );
+            for ( long l_pos = 0; l_pos < t_payload; l_pos += g_attr.mq_msgsize )
+            {
+                long l_len = t_payload - l_pos < g_attr.mq_msgsize ? t_payload - l_pos : g_attr.mq_msgsize;
+                while ( mq_send( t_mq, l_buf + l_pos, l_len, 0 ) < 0 && errno == EINTR );
+            }
+        }
+        else
+        {
+            blob_desc l_desc;
+            char *l_data = blob_alloc( l_pool, t_payload, &l_desc );
+            if ( !l_data )
+            {
+                log_msg( LOG_ERROR, "Unable to allocate blob!" );
+                exit( 1 );
+            }
+            memset( l_data, p, t_payload );
+            while ( mq_send( t_mq, ( const char * ) &l_desc, sizeof( l_desc ), 0 ) < 0 && errno == EINTR );
+        }
+    }
+
+    int l_status;
+    waitpid( l_pid, &l_status, 0 );
+    double l_time = ( mq_batch_time_ns() - l_start ) / 1e9;
+
+    printf( "%s  payload %9ld B  %9ld payloads  %10.0f payloads/s  %9.1f MB/s%s\n",
+            l_names[ t_mode ], t_payload, l_count, l_count / l_time,
+            l_count * ( double ) t_payload / l_time / 1024 / 1024,
+            WIFEXITED( l_status ) && !WEXITSTATUS( l_status ) ? "" : "  CONSUMER FAILED!" );
+
+    if ( l_pool )
+    {
+        blob_pool_detach( l_pool );
+        shm_unlink( POOL_NAME );
+    }
+    free( l_buf );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            log_msg( LOG_INFO, "Clean message queue and pool." );
+            mq_unlink( MQ_NAME );
+            shm_unlink( POOL_NAME );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-s" ) ) g_payload = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-m" ) ) g_total_mb = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_slots = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_payload < 0 || g_total_mb <= 0 || g_slots <= 0 || g_slots > BLOB_MAX_SLOTS )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    // the largest messages allowed by system
+    mq_unlink( MQ_NAME );
+    mqd_t l_mq = mq_batch_open( MQ_NAME, O_RDWR, 10, 8192, &g_attr );
+    if ( l_mq < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create message queue!" );
+        exit( 1 );
+    }
+    log_msg( LOG_INFO, "Queue has %ld messages of %ld bytes.", g_attr.mq_maxmsg, g_attr.mq_msgsize );
+
+    long l_sizes[] = { 4096, 65536, 1048576, 16777216 };
+    int l_nsizes = 4;
+    if ( g_payload )
+    {
+        l_sizes[ 0 ] = g_payload;
+        l_nsizes = 1;
+    }
+
+    for ( int s = 0; s < l_nsizes; s++ )
+        for ( int l_mode = MODE_COPY; l_mode <= MODE_BLOB; l_mode++ )
+            run_test( l_mq, l_mode, l_sizes[ s ] );
+
+    mq_close( l_mq );
+    mq_unlink( MQ_NAME );
+
+    return 0;
+}
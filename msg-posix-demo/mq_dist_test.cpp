@@ -0,0 +1,383 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Distribution of work from one producer to several consumers.
+//
+// Tasks simulate work by sleeping, the last consumer is slower.
+// Some tasks are urgent, they are sent with higher priority of message
+// and they overtake normal tasks in queue. Tasks are distributed:
+//   shared   - all consumers compete for one queue (msg_posix_test),
+//   round    - every consumer has own queue, round robin,
+//   weighted - every consumer has own queue, producer chooses queue with
+//              the shortest expected wait (backlog / observed throughput).
+// Consumers keep statistics in shared memory: processed tasks, busy time
+// and histograms of queueing delay. Load of consumers and percentiles
+// of delay are reported.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <mqueue.h>
+
+#include "futex.h"
+#include "mq_batch.h"
+#include "lat_hist.h"
+
+#define MQ_NAME                 "/mq_dist_%d"
+#define MAX_CONSUMERS           32
+#define PRIO_NORMAL             0
+#define PRIO_URGENT             10
+
+#define MODE_SHARED             0
+#define MODE_ROUND              1
+#define MODE_WEIGHTED           2
+
+struct task
+{
+    long long created_ns;
+    long seq;                           // -1 = end of test
+    int work_us;
+    int prio;
+};
+
+// statistics of one consumer, written by consumer only
+struct consumer_stats
+{
+    alignas( CACHE_LINE ) std::atomic<long> processed; // own cache line
+    std::atomic<long> urgent;
+    std::atomic<long long> busy_ns;
+    lat_hist delay;                     // from creation to start of work
+    lat_hist delay_urgent;
+};
+
+struct shm_data
+{
+    consumer_stats consumers[ MAX_CONSUMERS ];
+};
+
+// parameters of test
+int g_consumers = 4;
+int g_work_us = 500;
+int g_slow = 4;
+int g_urgent_pm = 50;
+int g_load = 70;
+int g_seconds = 2;
+
+mqd_t g_mq[ MAX_CONSUMERS ];
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Distribution of work to several consumers.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-c consumers] [-w work_us] [-s slow] [-u urgent]\n"
+        "         [-l load] [-t seconds]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean message queues \n"
+        "    -c  number of consumers (max. %d, default %d)\n"
+        "    -w  work of one task in us (default %d)\n"
+        "    -s  the last consumer is s times slower (default %d)\n"
+        "    -u  urgent tasks per mille (default %d)\n"
+        "    -l  load of consumers in %% (default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "\n", t_name, MAX_CONSUMERS, g_consumers, g_work_us, g_slow, g_urgent_pm, g_load, g_seconds );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void mq_name( char *t_buf, int t_index )
+{
+    sprintf( t_buf, MQ_NAME, t_index );
+}
+
+int slowdown( int t_consumer )
+{
+    return t_consumer == g_consumers - 1 ? g_slow : 1;
+}
+
+void consumer( shm_data *t_data, int t_index, mqd_t t_mq )
+{
+    consumer_stats *l_stats = &t_data->consumers[ t_index ];
+    long l_processed = 0, l_urgent = 0;
+    long long l_busy = 0;
+
+    while ( 1 )
+    {
+        task l_task;
+        if ( mq_receive( t_mq, ( char * ) &l_task, sizeof( l_task ), nullptr ) != sizeof( l_task ) )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to receive task!" );
+            exit( 1 );
+        }
+        if ( l_task.seq < 0 ) break;
+
+        long long l_start = mq_batch_time_ns();
+        hist_add( l_task.prio == PRIO_URGENT ? &l_stats->delay_urgent : &l_stats->delay, l_start - l_task.created_ns );
+
+        usleep( l_task.work_us * slowdown( t_index ) );
+
+        // statistics are read by producer during test
+        l_busy += mq_batch_time_ns() - l_start;
+        l_processed++;
+        if ( l_task.prio == PRIO_URGENT ) l_urgent++;
+        l_stats->busy_ns.store( l_busy, std::memory_order_relaxed );
+        l_stats->urgent.store( l_urgent, std::memory_order_relaxed );
+        l_stats->processed.store( l_processed, std::memory_order_release );
+    }
+    exit( 0 );
+}
+
+// queue with the shortest expected waiting: backlog / throughput
+int choose_weighted( shm_data *t_data, long *t_sent )
+{
+    int l_best = 0;
+    double l_best_wait = 0;
+    for ( int i = 0; i < g_consumers; i++ )
+    {
+        consumer_stats *l_stats = &t_data->consumers[ i ];
+        long l_processed = l_stats->processed.load( std::memory_order_acquire );
+        long long l_busy = l_stats->busy_ns.load( std::memory_order_relaxed );
+        // consumer without history is expected to be as fast as possible
+        double l_per_task = l_processed ? ( double ) l_busy / l_processed : 1.0;
+        double l_wait = ( t_sent[ i ] - l_processed + 1 ) * l_per_task;
+        if ( i == 0 || l_wait < l_best_wait )
+        {
+            l_best = i;
+            l_best_wait = l_wait;
+        }
+    }
+    return l_best;
+}
+
+void run_test( shm_data *t_data, int t_mode )
+{
+    const char *l_names[] = { "shared", "round", "weighted" };
+    int l_queues = t_mode == MODE_SHARED ? 1 : g_consumers;
+
+    for ( int i = 0; i < MAX_CONSUMERS; i++ )
+    {
+        consumer_stats *l_stats = &t_data->consumers[ i ];
+        l_stats->processed = 0;
+        l_stats->urgent = 0;
+        l_stats->busy_ns = 0;
+        hist_clear( &l_stats->delay );
+        hist_clear( &l_stats->delay_urgent );
+    }
+    for ( int i = 0; i < l_queues; i++ )
+    {
+        char l_name[ 64 ];
+        mq_name( l_name, i );
+        mq_unlink( l_name );
+        g_mq[ i ] = mq_batch_open( l_name, O_RDWR, 10, sizeof( task ), nullptr );
+        if ( g_mq[ i ] < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create message queue!" );
+            exit( 1 );
+        }
+    }
+
+    fflush( stdout );
+    for ( int i = 0; i < g_consumers; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            consumer( t_data, i, g_mq[ t_mode == MODE_SHARED ? 0 : i ] );
+    }
+
+    // tasks arrive regularly, load is given by capacity of all consumers
+    double l_capacity = 0;
+    for ( int i = 0; i < g_consumers; i++ )
+        l_capacity += 1e9 / ( g_work_us * 1000.0 * slowdown( i ) );
+    long long l_interval = 1e9 / ( l_capacity * g_load / 100.0 );
+
+    long l_sent[ MAX_CONSUMERS ] = { 0 };
+    long long l_start = mq_batch_time_ns(), l_end = l_start + g_seconds * 1000000000LL;
+    long long l_next = l_start;
+    long l_seq = 0, l_max_backlog = 0;
+    unsigned int l_seed = 1;
+    while ( l_next < l_end )
+    {
+        l_next += l_interval;
+        long long l_now = mq_batch_time_ns();
+        if ( l_next > l_now )
+        {
+            timespec l_ts = { ( l_next - l_now ) / 1000000000LL, ( l_next - l_now ) % 1000000000LL };
+            nanosleep( &l_ts, nullptr );
+        }
+
+        task l_task = { mq_batch_time_ns(), l_seq++, g_work_us,
+                ( int ) ( rand_r( &l_seed ) % 1000 ) < g_urgent_pm ? PRIO_URGENT : PRIO_NORMAL };
+
+        int l_queue = 0;
+        if ( t_mode == MODE_ROUND ) l_queue = l_seq % g_consumers;
+        else if ( t_mode == MODE_WEIGHTED ) l_queue = choose_weighted( t_data, l_sent );
+
+        // full queue blocks producer
+        while ( mq_send( g_mq[ l_queue ], ( const char * ) &l_task, sizeof( l_task ), l_task.prio ) < 0 && errno == EINTR );
+        l_sent[ l_queue ]++;
+
+        long l_backlog = l_sent[ l_queue ] - ( t_mode == MODE_SHARED ? 0 : t_data->consumers[ l_queue ].processed.load() );
+        if ( t_mode != MODE_SHARED && l_backlog > l_max_backlog ) l_max_backlog = l_backlog;
+    }
+
+    for ( int i = 0; i < g_consumers; i++ )
+    {
+        task l_stop = { 0, -1, 0, PRIO_NORMAL };
+        mq_send( g_mq[ t_mode == MODE_SHARED ? 0 : i ], ( const char * ) &l_stop, sizeof( l_stop ), PRIO_NORMAL );
+    }
+    for ( int i = 0; i < g_consumers; i++ )
+        wait( nullptr );
+    double l_time = ( mq_batch_time_ns() - l_start ) / 1e9;
+
+    static lat_hist l_all, l_all_urgent;
+    hist_clear( &l_all );
+    hist_clear( &l_all_urgent );
+    for ( int i = 0; i < g_consumers; i++ )
+    {
+        consumer_stats *l_stats = &t_data->consumers[ i ];
+        hist_merge( &l_all, &l_stats->delay );
+        hist_merge( &l_all_urgent, &l_stats->delay_urgent );
+        printf( "%-8s  consumer %2d  slow %dx  %6ld tasks  %5.1f %% of tasks  busy %5.1f %%  "
+                "delay p50 %9lu  p99 %9lu ns  urgent p99 %9lu ns\n",
+                l_names[ t_mode ], i, slowdown( i ), l_stats->processed.load(),
+                100.0 * l_stats->processed / ( l_seq ? l_seq : 1 ), l_stats->busy_ns / l_time / 1e7,
+                ( unsigned long ) hist_percentile( &l_stats->delay, 50 ),
+                ( unsigned long ) hist_percentile( &l_stats->delay, 99 ),
+                ( unsigned long ) hist_percentile( &l_stats->delay_urgent, 99 ) );
+    }
+    printf( "%-8s  all          %6ld tasks  %7.0f tasks/s  max. backlog %3ld  "
+            "delay p50 %9lu  p99 %9lu ns  urgent p50 %9lu  p99 %9lu ns\n\n",
+            l_names[ t_mode ], l_seq, l_seq / l_time, l_max_backlog,
+            ( unsigned long ) hist_percentile( &l_all, 50 ), ( unsigned long ) hist_percentile( &l_all, 99 ),
+            ( unsigned long ) hist_percentile( &l_all_urgent, 50 ),
+            ( unsigned long ) hist_percentile( &l_all_urgent, 99 ) );
+
+    for ( int i = 0; i < l_queues; i++ )
+    {
+        char l_name[ 64 ];
+        mq_name( l_name, i );
+        mq_close( g_mq[ i ] );
+        mq_unlink( l_name );
+    }
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            log_msg( LOG_INFO, "Clean message queues." );
+            char l_name[ 64 ];
+            for ( int q = 0; q < MAX_CONSUMERS; q++ )
+            {
+                mq_name( l_name, q );
+                mq_unlink( l_name );
+            }
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-c" ) ) g_consumers = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-w" ) ) g_work_us = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_slow = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-u" ) ) g_urgent_pm = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-l" ) ) g_load = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_consumers <= 0 || g_consumers > MAX_CONSUMERS || g_work_us <= 0 || g_slow <= 0 ||
+         g_urgent_pm < 0 || g_load <= 0 || g_seconds <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    for ( int l_mode = MODE_SHARED; l_mode <= MODE_WEIGHTED; l_mode++ )
+        run_test( l_data, l_mode );
+
+    munmap( l_data, sizeof( shm_data ) );
+    return 0;
+}
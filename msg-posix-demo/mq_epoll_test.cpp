@@ -0,0 +1,363 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Waiting for messages in several posix message queues.
+//
+// Producer sends messages with time of sending into several queues
+// in given intervals. Consumer (child process) receives messages:
+//   timed - one thread for every queue, mq_timedreceive with timeout
+//           1 s, after timeout usleep( 500 ms ) and blocking receive,
+//   epoll - one thread for all queues, queues are non-blocking and
+//           registered in epoll (mqd_t is file descriptor in Linux),
+//           all available messages are received after every wake-up.
+// Latency from sending to receiving and CPU time of consumer are reported.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <mqueue.h>
+#include <vector>
+#include <algorithm>
+
+#include "mq_batch.h"
+
+#define MQ_NAME                 "/mq_epoll_test_%d"
+#define MAX_QUEUES              64
+
+#define MODE_TIMED              0
+#define MODE_EPOLL              1
+
+struct message
+{
+    long long sent_ns;
+    long seq;                   // -1 = end of test
+};
+
+// parameters of test
+int g_queues = 4;
+int g_messages = 0;             // 0 = default scenarios
+int g_interval_us = 0;
+
+mqd_t g_mq[ MAX_QUEUES ];
+std::vector<long long> g_lat[ MAX_QUEUES ];
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Waiting for messages in several message queues.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-q queues] [-n messages -i interval_us]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean message queues \n"
+        "    -q  number of queues (max. %d, default %d)\n"
+        "    -n  number of messages (default 2000 in 1 ms and 4 in 1.2 s)\n"
+        "    -i  interval between messages in us\n"
+        "\n", t_name, MAX_QUEUES, g_queues );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void mq_name( char *t_buf, int t_index )
+{
+    sprintf( t_buf, MQ_NAME, t_index );
+}
+
+// process message, returns 0 at end of test
+int consume( int t_queue, message *t_msg )
+{
+    if ( t_msg->seq < 0 ) return 0;
+    g_lat[ t_queue ].push_back( mq_batch_time_ns() - t_msg->sent_ns );
+    return 1;
+}
+
+// the original way of waiting, one thread for every queue
+void *timed_thread( void *t_arg )
+{
+    int l_queue = ( intptr_t ) t_arg;
+    message l_msg;
+
+    while ( 1 )
+    {
+        timeval l_curtime;
+        gettimeofday( &l_curtime, nullptr );
+        timespec l_tout = { l_curtime.tv_sec + 1, l_curtime.tv_usec * 1000 };
+
+        int l_ret = mq_timedreceive( g_mq[ l_queue ], ( char * ) &l_msg, sizeof( l_msg ), nullptr, &l_tout );
+        if ( l_ret < 0 )
+        {
+            if ( errno != ETIMEDOUT )
+            {
+                log_msg( LOG_ERROR, "Unable to receive message!" );
+                exit( 1 );
+            }
+            log_msg( LOG_DEBUG, "No message in queue %d. Wait for message without timeout ...", l_queue );
+            usleep( 500000 );
+            l_ret = mq_receive( g_mq[ l_queue ], ( char * ) &l_msg, sizeof( l_msg ), nullptr );
+        }
+        if ( l_ret == sizeof( l_msg ) && !consume( l_queue, &l_msg ) ) break;
+    }
+    return nullptr;
+}
+
+void consumer_timed()
+{
+    pthread_t l_threads[ MAX_QUEUES ];
+    for ( int i = 0; i < g_queues; i++ )
+        pthread_create( &l_threads[ i ], nullptr, timed_thread, ( void * ) ( intptr_t ) i );
+    for ( int i = 0; i < g_queues; i++ )
+        pthread_join( l_threads[ i ], nullptr );
+}
+
+// one thread waits in epoll for all queues
+void consumer_epoll()
+{
+    int l_epoll = epoll_create1( 0 );
+    for ( int i = 0; i < g_queues; i++ )
+    {
+        epoll_event l_event;
+        bzero( &l_event, sizeof( l_event ) );
+        l_event.events = EPOLLIN;
+        l_event.data.u32 = i;
+        if ( l_epoll < 0 || epoll_ctl( l_epoll, EPOLL_CTL_ADD, g_mq[ i ], &l_event ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to register queue in epoll!" );
+            exit( 1 );
+        }
+    }
+
+    int l_running = g_queues;
+    while ( l_running )
+    {
+        epoll_event l_events[ MAX_QUEUES ];
+        int l_count = epoll_wait( l_epoll, l_events, MAX_QUEUES, -1 );
+        if ( l_count < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            log_msg( LOG_ERROR, "Unable to wait for messages!" );
+            exit( 1 );
+        }
+
+        for ( int e = 0; e < l_count; e++ )
+        {
+            int l_queue = l_events[ e ].data.u32;
+            message l_msg;
+            // receive all available messages
+            while ( mq_receive( g_mq[ l_queue ], ( char * ) &l_msg, sizeof( l_msg ), nullptr ) == sizeof( l_msg ) )
+                if ( !consume( l_queue, &l_msg ) )
+                {
+                    epoll_ctl( l_epoll, EPOLL_CTL_DEL, g_mq[ l_queue ], nullptr );
+                    l_running--;
+                    break;
+                }
+        }
+    }
+    close( l_epoll );
+}
+
+void consumer( int t_mode )
+{
+    // own open queues, flags of descriptors inherited from parent are shared
+    for ( int i = 0; i < g_queues; i++ )
+    {
+        char l_name[ 64 ];
+        mq_name( l_name, i );
+        mq_close( g_mq[ i ] );
+        g_mq[ i ] = mq_open( l_name, O_RDONLY | ( t_mode == MODE_EPOLL ? O_NONBLOCK : 0 ) );
+        if ( g_mq[ i ] < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to open message queue!" );
+            exit( 1 );
+        }
+    }
+
+    if ( t_mode == MODE_TIMED ) consumer_timed();
+    else consumer_epoll();
+
+    std::vector<long long> l_all;
+    for ( int i = 0; i < g_queues; i++ )
+        l_all.insert( l_all.end(), g_lat[ i ].begin(), g_lat[ i ].end() );
+    std::sort( l_all.begin(), l_all.end() );
+    long l_count = l_all.size();
+
+    printf( "latency p50 %9lld  p99 %9lld  max %10lld ns",
+            l_count ? l_all[ l_count / 2 ] : 0, l_count ? l_all[ l_count * 99 / 100 ] : 0,
+            l_count ? l_all[ l_count - 1 ] : 0 );
+    fflush( stdout );
+    exit( 0 );
+}
+
+void run_test( int t_mode, int t_messages, int t_interval_us )
+{
+    const char *l_names[] = { "timed", "epoll" };
+
+    printf( "%-6s %2d queues  %5d messages every %8d us  ", l_names[ t_mode ], g_queues, t_messages, t_interval_us );
+    fflush( stdout );
+
+    int l_pid = fork();
+    if ( l_pid < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+    if ( l_pid == 0 )
+        consumer( t_mode );
+
+    // consumer must wait already
+    usleep( 100000 );
+
+    for ( int i = 0; i < t_messages; i++ )
+    {
+        usleep( t_interval_us );
+        message l_msg = { mq_batch_time_ns(), i };
+        mq_send( g_mq[ i % g_queues ], ( const char * ) &l_msg, sizeof( l_msg ), 0 );
+    }
+    for ( int i = 0; i < g_queues; i++ )
+    {
+        message l_msg = { 0, -1 };
+        mq_send( g_mq[ i ], ( const char * ) &l_msg, sizeof( l_msg ), 0 );
+    }
+
+    // CPU time of consumer
+    rusage l_usage;
+    wait4( l_pid, nullptr, 0, &l_usage );
+    printf( "  consumer CPU %6.1f ms\n", ( l_usage.ru_utime.tv_sec + l_usage.ru_stime.tv_sec ) * 1000.0 +
+            ( l_usage.ru_utime.tv_usec + l_usage.ru_stime.tv_usec ) / 1000.0 );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            log_msg( LOG_INFO, "Clean message queues." );
+            char l_name[ 64 ];
+            for ( int q = 0; q < MAX_QUEUES; q++ )
+            {
+                mq_name( l_name, q );
+                mq_unlink( l_name );
+            }
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-q" ) ) g_queues = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_messages = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-i" ) ) g_interval_us = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_queues <= 0 || g_queues > MAX_QUEUES || g_messages < 0 || g_interval_us < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    for ( int i = 0; i < g_queues; i++ )
+    {
+        char l_name[ 64 ];
+        mq_name( l_name, i );
+        mq_unlink( l_name );
+        g_mq[ i ] = mq_batch_open( l_name, O_RDWR, 10, sizeof( message ), nullptr );
+        if ( g_mq[ i ] < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create message queue!" );
+            exit( 1 );
+        }
+    }
+
+    // busy queues and queues idle for longer time than timeout
+    int l_messages[] = { 2000, 4 };
+    int l_intervals[] = { 1000, 1200000 };
+    int l_scenarios = 2;
+    if ( g_messages )
+    {
+        l_messages[ 0 ] = g_messages;
+        l_intervals[ 0 ] = g_interval_us;
+        l_scenarios = 1;
+    }
+
+    for ( int s = 0; s < l_scenarios; s++ )
+        for ( int l_mode = MODE_TIMED; l_mode <= MODE_EPOLL; l_mode++ )
+            run_test( l_mode, l_messages[ s ], l_intervals[ s ] );
+
+    for ( int i = 0; i < g_queues; i++ )
+    {
+        char l_name[ 64 ];
+        mq_name( l_name, i );
+        mq_close( g_mq[ i ] );
+        mq_unlink( l_name );
+    }
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+//***************************************************************************
+//
+// Program example for labs Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Spill-over of messages to disk when message queue is full.
+//
+// Producer does not block on full queue, messages are appended into
+// sequential log file instead. Records are collected in large buffer
+// and written by one write() and data is synchronized by fdatasync()
+// only once per SPILL_SYNC_BYTES. When log is not empty, all new messages
+// must be appended to log too, so order of messages is kept. Log is
+// drained back into queue (non-blocking) in order while there is free
+// space in queue, empty log is truncated.
+//
+//***************************************************************************
+
+#ifndef __MQ_SPILL_H
+#define __MQ_SPILL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+
+#define SPILL_BUF_SIZE          ( 1024 * 1024 )
+#define SPILL_SYNC_BYTES        ( 16 * 1024 * 1024 )
+#define SPILL_IO_ERROR          -2              // result of spill_drain()
+
+struct spill_rec
+{
+    uint32_t len;
+    uint32_t prio;
+};
+
+struct mq_spill
+{
+    int fd;
+    char *wbuf;                 // records not written yet
+    long wused;
+    char *rbuf;                 // records read from file
+    long rlen, rpos;
+    long long file_size;        // written into file
+    long long read_pos;         // position of rbuf in file
+    long long unsynced;         // written, but not synchronized
+    long count;                 // messages in log
+    long long bytes;            // size of records in log
+    long spilled, drained;      // statistics
+};
+
+// size of record in log, records are aligned to 8 bytes
+static inline long spill_rec_size( uint32_t t_len )
+{
+    return ( sizeof( spill_rec ) + t_len + 7 ) & ~7L;
+}
+
+static inline void spill_close( mq_spill *t_spill )
+{
+    if ( t_spill->fd >= 0 ) close( t_spill->fd );
+    free( t_spill->wbuf );
+    free( t_spill->rbuf );
+    t_spill->fd = -1;
+    t_spill->wbuf = t_spill->rbuf = nullptr;
+}
+
+// Open (and truncate) log file. Returns -1 on error (errno), then
+// nothing is allocated and file is removed.
+static inline int spill_open( mq_spill *t_spill, const char *t_path )
+{
+    memset( t_spill, 0, sizeof( *t_spill ) );
+    t_spill->fd = open( t_path, O_RDWR | O_CREAT | O_TRUNC, 0660 );
+    if ( t_spill->fd < 0 ) return -1;
+    t_spill->wbuf = ( char * ) malloc( SPILL_BUF_SIZE );
+    t_spill->rbuf = ( char * ) malloc( SPILL_BUF_SIZE );
+    if ( !t_spill->wbuf || !t_spill->rbuf )
+    {
+        spill_close( t_spill );
+        unlink( t_path );
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+static inline int spill_empty( mq_spill *t_spill )
+{
+    return !t_spill->count;
+}
+
+// write buffer into file, data is synchronized after SPILL_SYNC_BYTES
+static inline int spill_write( mq_spill *t_spill )
+{
+    for ( long l_pos = 0; l_pos < t_spill->wused; )
+    {
+        ssize_t l_ret = pwrite( t_spill->fd, t_spill->wbuf + l_pos, t_spill->wused - l_pos,
+                t_spill->file_size + l_pos );
+        if ( l_ret < 0 )
+        {
+            if ( errno == EINTR ) continue;
+            return -1;
+        }
+        l_pos += l_ret;
+    }
+    t_spill->file_size += t_spill->wused;
+    t_spill->unsynced += t_spill->wused;
+    t_spill->wused = 0;
+
+    if ( t_spill->unsynced >= SPILL_SYNC_BYTES )
+    {
+        fdatasync( t_spill->fd );
+        t_spill->unsynced = 0;
+    }
+    return 0;
+}
+
+// Append message to log. Returns -1 on error (errno).
+static inline int spill_append( mq_spill *t_spill, const char *t_msg, uint32_t t_len, unsigned int t_prio )
+{
+    spill_rec l_rec = { t_len, t_prio };
+    long l_need = spill_rec_size( t_len );
+    if ( l_need > SPILL_BUF_SIZE )
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if ( t_spill->wused + l_need > SPILL_BUF_SIZE && spill_write( t_spill ) < 0 )
+        return -1;
+
+    memcpy( t_spill->wbuf + t_spill->wused, &l_rec, sizeof( l_rec ) );
+    memcpy( t_spill->wbuf + t_spill->wused + sizeof( l_rec ), t_msg, t_len );
+    t_spill->wused += l_need;
+    t_spill->count++;
+    t_spill->bytes += l_need;
+    t_spill->spilled++;
+    return 0;
+}
+
+// Next record from file. Log is not empty, so nullptr is I/O error (errno),
+// short read of file is reported as EIO.
+static inline spill_rec *spill_peek( mq_spill *t_spill )
+{
+    if ( t_spill->rpos + ( long ) sizeof( spill_rec ) <= t_spill->rlen )
+    {
+        spill_rec *l_rec = ( spill_rec * ) ( t_spill->rbuf + t_spill->rpos );
+        if ( t_spill->rpos + spill_rec_size( l_rec->len ) <= t_spill->rlen )
+            return l_rec;
+    }
+
+    // read next part of file, records in write buffer must be in file
+    long long l_pos = t_spill->read_pos + t_spill->rpos;
+    if ( l_pos >= t_spill->file_size && spill_write( t_spill ) < 0 ) return nullptr;
+    ssize_t l_len;
+    while ( ( l_len = pread( t_spill->fd, t_spill->rbuf, SPILL_BUF_SIZE, l_pos ) ) < 0 && errno == EINTR );
+    if ( l_len < 0 ) return nullptr;
+    if ( l_len < ( ssize_t ) sizeof( spill_rec ) )
+    {
+        errno = EIO;
+        return nullptr;
+    }
+    t_spill->read_pos = l_pos;
+    t_spill->rpos = 0;
+    t_spill->rlen = l_len;
+
+    spill_rec *l_rec = ( spill_rec * ) t_spill->rbuf;
+    if ( spill_rec_size( l_rec->len ) > l_len )
+    {
+        errno = EIO;
+        return nullptr;
+    }
+    return l_rec;
+}
+
+// Move messages from log into queue t_mq while it is not full.
+// Queue must be non-blocking. Returns number of moved messages or -1
+// (errno) when mq_send() fails and SPILL_IO_ERROR when log can not be read.
+static inline long spill_drain( mq_spill *t_spill, mqd_t t_mq )
+{
+    long l_moved = 0;
+    while ( t_spill->count )
+    {
+        spill_rec *l_rec = spill_peek( t_spill );
+        if ( !l_rec ) return SPILL_IO_ERROR;
+        if ( mq_send( t_mq, ( const char * ) ( l_rec + 1 ), l_rec->len, l_rec->prio ) < 0 )
+        {
+            if ( errno == EAGAIN ) break;
+            if ( errno == EINTR ) continue;
+            return -1;
+        }
+        t_spill->rpos += spill_rec_size( l_rec->len );
+        t_spill->count--;
+        t_spill->bytes -= spill_rec_size( l_rec->len );
+        t_spill->drained++;
+        l_moved++;
+    }
+
+    if ( !t_spill->count && t_spill->file_size )
+    {
+        // log is empty, space is reused
+        if ( ftruncate( t_spill->fd, 0 ) < 0 ) return SPILL_IO_ERROR;
+        t_spill->file_size = t_spill->read_pos = t_spill->unsynced = 0;
+        t_spill->rlen = t_spill->rpos = t_spill->wused = 0;
+    }
+    return l_moved;
+}
+
+#endif // __MQ_SPILL_H
@@ -8,7 +8,12 @@
 //
 // The first process creates message queue and it start to work as producer.
 // All others processes will connect to message queue and they will consume
-// data from queue.
+// data from queue. Consumer does not poll queue with timeout, queue is
+// non-blocking and consumer sleeps in epoll until message arrives, then
+// it receives all available messages.
+// Producer does not block when queue is full, messages are appended
+// into log file (mq_spill.h) and they are moved back into queue in order
+// when consumers catch up.
 //
 //***************************************************************************
 
@@ -23,9 +28,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
 #include <mqueue.h>
 
+#include "mq_spill.h"
+
 #define MQ_NAME                 "/mq_example"
+#define SPILL_NAME              "/tmp/mq_example.spill"
+#define SPILL_MAX_BYTES         ( 256L * 1024 * 1024 )
 
 // message queue fd
 mqd_t g_glb_msg_fd = -1;
@@ -33,6 +43,12 @@ mqd_t g_glb_msg_fd = -1;
 // first process?
 int g_glb_first = 0;
 
+// epoll of consumer, mqd_t is file descriptor in Linux
+int g_glb_epoll_fd = -1;
+
+// log of producer for full queue
+mq_spill g_glb_spill = { -1 };
+
 //***************************************************************************
 // log messages
 
@@ -82,6 +98,11 @@ void clean( void )
 
     if ( g_glb_first )
     {
+        if ( !spill_empty( &g_glb_spill ) )
+            log_msg( LOG_INFO, "%ld messages in log are lost.", g_glb_spill.count );
+        spill_close( &g_glb_spill );
+        unlink( SPILL_NAME );
+
         log_msg( LOG_INFO, "This process was first and now it will try remove queue ..." );
 
         if ( mq_unlink( MQ_NAME ) < 0 )
@@ -134,36 +155,86 @@ void help( int t_narg, char **t_args )
 
 //***************************************************************************
 
+double now_sec()
+{
+    timeval l_curtime;
+    gettimeofday( &l_curtime, nullptr );
+    return l_curtime.tv_sec + l_curtime.tv_usec / 1000000.0;
+}
+
+// move messages from log into queue, returns number of moved messages
+long drain_log()
+{
+    long l_moved = spill_drain( &g_glb_spill, g_glb_msg_fd );
+    if ( l_moved == SPILL_IO_ERROR )
+    {
+        log_msg( LOG_ERROR, "Unable to read messages from log %s!", SPILL_NAME );
+        exit( 1 );
+    }
+    if ( l_moved < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to move messages from log into queue!" );
+        exit( 1 );
+    }
+    return l_moved;
+}
+
 void producer()
 {
     static int l_count = 0;
+    static double l_spill_start = 0, l_drain_start = 0;
+    static long long l_spill_max = 0;
 
     printf( "Produced %d\r", ++l_count );
     fflush( stdout );
 
     int l_data = rand() % 1000;
 
-    log_msg( LOG_DEBUG, "Producer will send message with timeout ..." );
+    // messages in log must be sent before new one
+    long l_moved = drain_log();
+    if ( l_moved && !l_drain_start ) l_drain_start = now_sec();
 
-    timeval l_curtime;
-    gettimeofday( &l_curtime, nullptr );
-    timespec l_tout = { l_curtime.tv_sec + 1, l_curtime.tv_usec * 1000 };
-
-    int l_ret = mq_timedsend( g_glb_msg_fd, ( const char * ) &l_data, sizeof( l_data ), 0, &l_tout );
-    if ( l_ret < 0 )
+    if ( spill_empty( &g_glb_spill ) )
     {
-        if ( errno == ETIMEDOUT )
+        if ( l_spill_start )
         {
+            double l_now = now_sec();
             printf( "\n" );
-            log_msg( LOG_INFO, "Message queue is full. Send without timeout ..." );
-            l_ret = mq_send( g_glb_msg_fd, ( const char * ) &l_data, sizeof( l_data ), 0 );
+            log_msg( LOG_INFO, "Log is empty. Spilled %ld messages (max. %lld bytes) in %.3f s, drained %.0f messages/s.",
+                    g_glb_spill.spilled, l_spill_max, l_now - l_spill_start,
+                    g_glb_spill.drained / ( l_now - l_drain_start + 1e-9 ) );
+            l_spill_start = l_drain_start = 0;
         }
-        else
+
+        log_msg( LOG_DEBUG, "Producer will send message ..." );
+        if ( mq_send( g_glb_msg_fd, ( const char * ) &l_data, sizeof( l_data ), 0 ) == 0 )
+            return;
+        if ( errno != EAGAIN )
         {
             log_msg( LOG_ERROR, "Unable to send message!" );
             exit( 1 );
         }
+
+        printf( "\n" );
+        log_msg( LOG_INFO, "Message queue is full. Messages are stored into log ..." );
+        l_spill_start = now_sec();
+        l_spill_max = 0;
+        g_glb_spill.spilled = g_glb_spill.drained = 0;
+    }
+
+    // log is full, producer must wait for consumers
+    while ( g_glb_spill.bytes >= SPILL_MAX_BYTES )
+    {
+        usleep( 10000 );
+        drain_log();
+    }
+
+    if ( spill_append( &g_glb_spill, ( const char * ) &l_data, sizeof( l_data ), 0 ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to store message into log!" );
+        exit( 1 );
     }
+    if ( g_glb_spill.bytes > l_spill_max ) l_spill_max = g_glb_spill.bytes;
 }
 
 
@@ -172,33 +243,34 @@ void consumer()
     static int l_count = 0;
 
     int l_data;
+    int l_received = 0;
 
-    log_msg( LOG_DEBUG, "Receive message with timeout ..." );
+    // receive all available messages
+    while ( mq_receive( g_glb_msg_fd, ( char * ) &l_data, sizeof( l_data ), nullptr ) >= 0 )
+        l_received++;
 
-    timeval l_curtime;
-    gettimeofday( &l_curtime, nullptr );
-    timespec l_tout = { l_curtime.tv_sec + 1, l_curtime.tv_usec * 1000 };
-
-    int l_ret = mq_timedreceive( g_glb_msg_fd, ( char * ) &l_data, sizeof( l_data ), nullptr, &l_tout );
+    if ( errno != EAGAIN && errno != EINTR )
+    {
+        log_msg( LOG_ERROR, "Unable to receive message!" );
+        exit( 1 );
+    }
 
-    if ( l_ret < 0 )
+    if ( l_received )
     {
-        if ( errno == ETIMEDOUT )
-        {
-            printf( "\n" );
-            log_msg( LOG_INFO, "No message. Wait for message without timeout ..." );
-            usleep( 500000 );
-            l_ret = mq_receive( g_glb_msg_fd, ( char * ) &l_data, sizeof( l_data ), nullptr );
-        }
-        else
-        {
-            log_msg( LOG_ERROR, "Unable to receive message!" );
-            exit( 1 );
-        }
+        l_count += l_received;
+        printf( "Consumed %d messages\r", l_count );
+        fflush( stdout );
+        return;
     }
 
-    printf( "Consumed %d messages\r", ++l_count );
-    fflush( stdout );
+    log_msg( LOG_DEBUG, "No message. Wait for message ..." );
+
+    epoll_event l_event;
+    if ( epoll_wait( g_glb_epoll_fd, &l_event, 1, -1 ) < 0 && errno != EINTR )
+    {
+        log_msg( LOG_ERROR, "Unable to wait for message!" );
+        exit( 1 );
+    }
 }
 
 int main( int t_narg, char **t_args )
@@ -220,13 +292,19 @@ int main( int t_narg, char **t_args )
         l_mqa.mq_msgsize = sizeof( int );
 
         // message queue creation
-        g_glb_msg_fd = mq_open( MQ_NAME, O_RDWR | O_CREAT, 0660, &l_mqa );
+        g_glb_msg_fd = mq_open( MQ_NAME, O_RDWR | O_CREAT | O_NONBLOCK, 0660, &l_mqa );
         if ( g_glb_msg_fd < 0 )
         {
             log_msg( LOG_ERROR, "Unable to create message queue!" );
             return 1;
         }
 
+        if ( spill_open( &g_glb_spill, SPILL_NAME ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create log for full queue!" );
+            return 1;
+        }
+
         // this process created mq and it will delete it at exit.
         g_glb_first = 1;
         log_msg( LOG_INFO, "This process created message queue and it will work as 'producer'." );
@@ -235,6 +313,24 @@ int main( int t_narg, char **t_args )
 
     log_msg( LOG_DEBUG, "FD of message queue is %d", g_glb_msg_fd );
 
+    if ( !g_glb_first )
+    {
+        // consumer reads queue without blocking and waits in epoll
+        mq_attr l_mqa;
+        bzero( &l_mqa, sizeof( l_mqa ) );
+        l_mqa.mq_flags = O_NONBLOCK;
+        epoll_event l_event;
+        bzero( &l_event, sizeof( l_event ) );
+        l_event.events = EPOLLIN;
+        g_glb_epoll_fd = epoll_create1( 0 );
+        if ( mq_setattr( g_glb_msg_fd, &l_mqa, nullptr ) < 0 || g_glb_epoll_fd < 0 ||
+             epoll_ctl( g_glb_epoll_fd, EPOLL_CTL_ADD, g_glb_msg_fd, &l_event ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to prepare waiting for messages!" );
+            return 1;
+        }
+    }
+
     struct sigaction l_sa;
     bzero( &l_sa, sizeof( l_sa ) );
     l_sa.sa_handler = catch_sig;
@@ -0,0 +1,157 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Fair (FIFO) locks for processes, placed in shared memory.
+//
+// Ticket lock: process takes ticket number and waits until it is
+// served. All waiters poll (or sleep on) one shared counter.
+//
+// MCS lock: waiting processes form queue of nodes, every process has
+// its own node in its own cache line and polls only this node.
+// Pointers can not be used in shared memory, node is identified by
+// index (process slot), tail contains index + 1 (0 = no queue).
+//
+// Both locks spin shortly and then sleep on futex, so preempted
+// or sleeping waiters do not consume CPU. Lock is handed over
+// in order of arrival, waiting time of process is bounded.
+//
+//***************************************************************************
+
+#ifndef __FAIR_LOCK_H
+#define __FAIR_LOCK_H
+
+#include <sched.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define FAIR_SPIN               200
+#define MCS_MAX_NODES           128
+
+//***************************************************************************
+// ticket lock
+
+struct ticket_lock
+{
+    alignas( CACHE_LINE ) std::atomic<int> next;
+    alignas( CACHE_LINE ) std::atomic<int> serving;
+    std::atomic<int> sleepers;
+};
+
+static inline void ticket_init( ticket_lock *t_lock )
+{
+    t_lock->next.store( 0 );
+    t_lock->serving.store( 0 );
+    t_lock->sleepers.store( 0 );
+}
+
+static inline void ticket_lock_acquire( ticket_lock *t_lock )
+{
+    int l_ticket = t_lock->next.fetch_add( 1, std::memory_order_relaxed );
+
+    for ( int l_spin = 0; ; l_spin++ )
+    {
+        int l_serving = t_lock->serving.load( std::memory_order_acquire );
+        if ( l_serving == l_ticket ) return;
+
+        if ( l_spin < FAIR_SPIN )
+        {
+            cpu_relax();
+            continue;
+        }
+
+        // every change of serving wakes all sleepers, each checks its ticket
+        t_lock->sleepers.fetch_add( 1, std::memory_order_seq_cst );
+        futex_wait( &t_lock->serving, l_serving );
+        t_lock->sleepers.fetch_sub( 1, std::memory_order_relaxed );
+    }
+}
+
+static inline void ticket_lock_release( ticket_lock *t_lock )
+{
+    t_lock->serving.fetch_add( 1, std::memory_order_release );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( t_lock->sleepers.load( std::memory_order_relaxed ) )
+        futex_wake( &t_lock->serving );
+}
+
+//***************************************************************************
+// MCS queue lock
+
+#define MCS_WAIT                1
+#define MCS_SLEEP               2
+#define MCS_GO                  0
+
+struct mcs_node
+{
+    alignas( CACHE_LINE ) std::atomic<int> next;        // index + 1 of successor
+    std::atomic<int> state;                             // MCS_WAIT, MCS_SLEEP or MCS_GO
+};
+
+struct mcs_lock
+{
+    alignas( CACHE_LINE ) std::atomic<int> tail;        // index + 1 of last node
+    mcs_node nodes[ MCS_MAX_NODES ];
+};
+
+static inline void mcs_init( mcs_lock *t_lock )
+{
+    t_lock->tail.store( 0 );
+    for ( int i = 0; i < MCS_MAX_NODES; i++ )
+    {
+        t_lock->nodes[ i ].next.store( 0 );
+        t_lock->nodes[ i ].state.store( MCS_GO );
+    }
+}
+
+// t_index is unique index of process (0 .. MCS_MAX_NODES-1)
+static inline void mcs_lock_acquire( mcs_lock *t_lock, int t_index )
+{
+    mcs_node *l_node = &t_lock->nodes[ t_index ];
+    l_node->next.store( 0, std::memory_order_relaxed );
+    l_node->state.store( MCS_WAIT, std::memory_order_relaxed );
+
+    int l_prev = t_lock->tail.exchange( t_index + 1, std::memory_order_acq_rel );
+    if ( !l_prev ) return;
+
+    t_lock->nodes[ l_prev - 1 ].next.store( t_index + 1, std::memory_order_release );
+
+    // poll own node only
+    for ( int l_spin = 0; l_node->state.load( std::memory_order_acquire ) != MCS_GO; l_spin++ )
+    {
+        if ( l_spin < FAIR_SPIN )
+        {
+            cpu_relax();
+            continue;
+        }
+        int l_wait = MCS_WAIT;
+        if ( l_node->state.compare_exchange_strong( l_wait, MCS_SLEEP ) || l_wait == MCS_SLEEP )
+            futex_wait( &l_node->state, MCS_SLEEP );
+    }
+}
+
+static inline void mcs_lock_release( mcs_lock *t_lock, int t_index )
+{
+    mcs_node *l_node = &t_lock->nodes[ t_index ];
+    int l_next = l_node->next.load( std::memory_order_acquire );
+
+    if ( !l_next )
+    {
+        // no successor, queue is empty when tail is still this node
+        int l_self = t_index + 1;
+        if ( t_lock->tail.compare_exchange_strong( l_self, 0, std::memory_order_release ) ) return;
+
+        // successor is just linking itself, it can be preempted
+        for ( int l_spin = 1; !( l_next = l_node->next.load( std::memory_order_acquire ) ); l_spin++ )
+            if ( l_spin % 64 ) cpu_relax(); else sched_yield();
+    }
+
+    mcs_node *l_succ = &t_lock->nodes[ l_next - 1 ];
+    if ( l_succ->state.exchange( MCS_GO, std::memory_order_release ) == MCS_SLEEP )
+        futex_wake( &l_succ->state, 1 );
+}
+
+#endif // __FAIR_LOCK_H
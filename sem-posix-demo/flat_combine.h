@@ -0,0 +1,142 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Flat combining for processes, placed in shared memory.
+//
+// Process does not execute its operation on shared data itself, but it
+// publishes operation into its own slot. Process which takes the lock
+// (combiner) executes pending operations of all processes in one pass
+// and stores results into their slots. Lock and shared data stay in
+// cache of one CPU and lock is handed over much less often.
+//
+// Function pointers are not valid in other processes (ASLR), so
+// operation is identified by number and every process passes the same
+// function which applies operation. Waiters spin shortly and then sleep
+// on lock word, unlock wakes them to check results.
+//
+//***************************************************************************
+
+#ifndef __FLAT_COMBINE_H
+#define __FLAT_COMBINE_H
+
+#include <atomic>
+
+#include "futex.h"
+
+#define FC_MAX_SLOTS            128
+#define FC_SPIN                 200
+#define FC_PASSES               3               // max. passes of one combiner
+
+// state of slot
+#define FC_IDLE                 0
+#define FC_REQUEST              1
+#define FC_DONE                 2
+
+// lock word
+#define FC_LOCKED               1
+#define FC_WAITERS              2
+
+// operation t_op with argument t_arg applied to shared data t_ctx
+typedef long ( *fc_apply_t )( void *t_ctx, int t_op, long t_arg );
+
+struct fc_slot
+{
+    alignas( CACHE_LINE ) std::atomic<int> state;
+    int op;
+    long arg;
+    long result;
+};
+
+struct flat_combine
+{
+    alignas( CACHE_LINE ) std::atomic<int> lock;
+    int nslots;                                 // used slots
+    std::atomic<long> combines;                 // statistics: passes of combiners
+    std::atomic<long> combined;                 //   and executed operations
+    fc_slot slots[ FC_MAX_SLOTS ];
+};
+
+static inline void fc_init( flat_combine *t_fc, int t_nslots )
+{
+    t_fc->lock.store( 0 );
+    t_fc->nslots = t_nslots < FC_MAX_SLOTS ? t_nslots : FC_MAX_SLOTS;
+    t_fc->combines.store( 0 );
+    t_fc->combined.store( 0 );
+    for ( int i = 0; i < FC_MAX_SLOTS; i++ )
+        t_fc->slots[ i ].state.store( FC_IDLE );
+}
+
+// executed by lock owner only
+static inline void fc_combine( flat_combine *t_fc, fc_apply_t t_apply, void *t_ctx )
+{
+    long l_count = 0;
+    for ( int l_pass = 0; l_pass < FC_PASSES; l_pass++ )
+    {
+        int l_found = 0;
+        for ( int i = 0; i < t_fc->nslots; i++ )
+        {
+            fc_slot *l_slot = &t_fc->slots[ i ];
+            if ( l_slot->state.load( std::memory_order_acquire ) != FC_REQUEST ) continue;
+            l_slot->result = t_apply( t_ctx, l_slot->op, l_slot->arg );
+            l_slot->state.store( FC_DONE, std::memory_order_release );
+            l_found++;
+        }
+        l_count += l_found;
+        // next pass is useful only when other processes are active
+        if ( l_found < 2 ) break;
+    }
+    t_fc->combines.store( t_fc->combines.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    t_fc->combined.store( t_fc->combined.load( std::memory_order_relaxed ) + l_count, std::memory_order_relaxed );
+}
+
+// Execute operation t_op( t_arg ), t_index is unique index of process.
+// Returns result of operation.
+static inline long fc_execute( flat_combine *t_fc, int t_index, int t_op, long t_arg,
+        fc_apply_t t_apply, void *t_ctx )
+{
+    fc_slot *l_slot = &t_fc->slots[ t_index ];
+    l_slot->op = t_op;
+    l_slot->arg = t_arg;
+    l_slot->state.store( FC_REQUEST, std::memory_order_release );
+
+    for ( int l_spin = 0; ; l_spin++ )
+    {
+        if ( l_slot->state.load( std::memory_order_acquire ) == FC_DONE )
+        {
+            l_slot->state.store( FC_IDLE, std::memory_order_relaxed );
+            return l_slot->result;
+        }
+
+        int l_lock = t_fc->lock.load( std::memory_order_relaxed );
+        if ( !l_lock )
+        {
+            if ( t_fc->lock.compare_exchange_weak( l_lock, FC_LOCKED, std::memory_order_acquire ) )
+            {
+                // own request is executed too
+                fc_combine( t_fc, t_apply, t_ctx );
+                if ( t_fc->lock.exchange( 0, std::memory_order_release ) & FC_WAITERS )
+                    futex_wake( &t_fc->lock );
+            }
+            continue;
+        }
+
+        if ( l_spin < FC_SPIN )
+        {
+            cpu_relax();
+            continue;
+        }
+
+        // combiner does not see request published after its pass,
+        // so waiter sleeps until unlock and then checks again
+        if ( !( l_lock & FC_WAITERS ) &&
+             !t_fc->lock.compare_exchange_weak( l_lock, l_lock | FC_WAITERS, std::memory_order_relaxed ) )
+            continue;
+        futex_wait( &t_fc->lock, l_lock | FC_WAITERS );
+        l_spin = 0;
+    }
+}
+
+#endif // __FLAT_COMBINE_H
@@ -0,0 +1,146 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Profiler of locks (critical sections) between processes.
+//
+// Statistics are kept in shared memory LOCK_PROF_NAME, every lock is
+// identified by its name. Every process using lock has its own slot
+// with histograms of waiting time (from attempt to lock to entry) and
+// holding time (from entry to unlock), so no counter is shared between
+// processes and adding of value costs only few plain stores.
+// Time is read by clock_gettime( CLOCK_MONOTONIC ), served by vDSO
+// without syscall. Statistics are read by lock_prof_read.
+//
+//***************************************************************************
+
+#ifndef __LOCK_PROF_H
+#define __LOCK_PROF_H
+
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <atomic>
+
+#include "futex.h"
+#include "lat_hist.h"
+
+#define LOCK_PROF_NAME          "/sem_lock_prof"
+#define LOCK_PROF_LOCKS         8
+#define LOCK_PROF_PROCS         32
+#define LOCK_PROF_NAME_LEN      32
+
+// state of lock entry
+#define LOCK_PROF_FREE          0
+#define LOCK_PROF_INIT          1
+#define LOCK_PROF_READY         2
+
+// statistics of one process for one lock, written by owner only
+struct lock_prof_slot
+{
+    alignas( CACHE_LINE ) std::atomic<int> pid;         // 0 = free
+    std::atomic<uint64_t> acquires;
+    std::atomic<uint64_t> contended;                    // lock was not free at first attempt
+    long long locked_at;                                // time of entry, owner only
+    lat_hist wait;
+    lat_hist hold;
+};
+
+struct lock_prof_lock
+{
+    alignas( CACHE_LINE ) std::atomic<int> state;
+    char name[ LOCK_PROF_NAME_LEN ];
+    lock_prof_slot slots[ LOCK_PROF_PROCS ];
+};
+
+struct lock_prof_shm
+{
+    lock_prof_lock locks[ LOCK_PROF_LOCKS ];
+};
+
+// Attach shared memory (create when needed) and return nullptr on error.
+// New memory is filled by zeros, it is valid empty table.
+static inline lock_prof_shm *lock_prof_attach( int t_create )
+{
+    int l_fd = shm_open( LOCK_PROF_NAME, O_RDWR | ( t_create ? O_CREAT : 0 ), 0660 );
+    if ( l_fd < 0 ) return nullptr;
+    if ( t_create && ftruncate( l_fd, sizeof( lock_prof_shm ) ) < 0 )
+    {
+        close( l_fd );
+        return nullptr;
+    }
+    void *l_ptr = mmap( nullptr, sizeof( lock_prof_shm ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    return l_ptr == MAP_FAILED ? nullptr : ( lock_prof_shm * ) l_ptr;
+}
+
+// Find or register lock t_name and claim slot for this process.
+// Slot of finished process is reused, its statistics are kept.
+// Returns nullptr when tables are full, then profiling is disabled.
+static inline lock_prof_slot *lock_prof_open( lock_prof_shm *t_shm, const char *t_name )
+{
+    if ( !t_shm ) return nullptr;
+
+    lock_prof_lock *l_lock = nullptr;
+    for ( int i = 0; i < LOCK_PROF_LOCKS && !l_lock; i++ )
+    {
+        lock_prof_lock *l_cur = &t_shm->locks[ i ];
+        int l_state = LOCK_PROF_FREE;
+        if ( l_cur->state.compare_exchange_strong( l_state, LOCK_PROF_INIT ) )
+        {
+            strncpy( l_cur->name, t_name, LOCK_PROF_NAME_LEN - 1 );
+            l_cur->state.store( LOCK_PROF_READY, std::memory_order_release );
+            l_lock = l_cur;
+            break;
+        }
+        // other process registers lock just now
+        while ( l_cur->state.load( std::memory_order_acquire ) == LOCK_PROF_INIT )
+            sched_yield();
+        if ( !strncmp( l_cur->name, t_name, LOCK_PROF_NAME_LEN - 1 ) )
+            l_lock = l_cur;
+    }
+    if ( !l_lock ) return nullptr;
+
+    int l_pid = getpid();
+    for ( int i = 0; i < LOCK_PROF_PROCS; i++ )
+    {
+        lock_prof_slot *l_slot = &l_lock->slots[ i ];
+        int l_old = l_slot->pid.load();
+        if ( l_old && ( kill( l_old, 0 ) == 0 || errno != ESRCH ) ) continue;
+        if ( l_slot->pid.compare_exchange_strong( l_old, l_pid ) )
+            return l_slot;
+    }
+    return nullptr;
+}
+
+static inline void lock_prof_close( lock_prof_slot *t_slot )
+{
+    if ( t_slot ) t_slot->pid.store( 0 );
+}
+
+// Lock was entered, t_start is time of attempt to lock.
+static inline void lock_prof_acquired( lock_prof_slot *t_slot, long long t_start, int t_contended )
+{
+    if ( !t_slot ) return;
+    long long l_now = time_ns();
+    t_slot->locked_at = l_now;
+    t_slot->acquires.store( t_slot->acquires.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    if ( t_contended )
+        t_slot->contended.store( t_slot->contended.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    hist_add( &t_slot->wait, l_now - t_start );
+}
+
+// Lock is being unlocked.
+static inline void lock_prof_released( lock_prof_slot *t_slot )
+{
+    if ( !t_slot ) return;
+    hist_add( &t_slot->hold, time_ns() - t_slot->locked_at );
+}
+
+#endif // __LOCK_PROF_H
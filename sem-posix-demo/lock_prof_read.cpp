@@ -0,0 +1,197 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Reader of lock profiler (lock_prof.h).
+//
+// Program prints for every lock number of entries, ratio of contended
+// entries and percentiles of waiting and holding time. Histograms
+// of all processes (running and finished) are merged, with -p every
+// process is printed too. With -i statistics are printed periodically
+// and rate of entries in last interval is shown.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "lock_prof.h"
+
+int g_interval = 0;
+int g_per_proc = 0;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Reader of lock profiler.\n"
+        "\n"
+        "  Use: %s [-h -d -r -p] [-i seconds]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean statistics (remove shared memory) \n"
+        "    -p  print statistics of every process \n"
+        "    -i  print statistics periodically \n"
+        "\n", t_name );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void print_line( const char *t_name, uint64_t t_acquires, uint64_t t_contended,
+        const lat_hist *t_wait, const lat_hist *t_hold )
+{
+    printf( "%-20s %10lu entries  contended %5.1f %%  "
+            "wait p50 %9lu  p99 %9lu  p99.9 %9lu  max %10lu ns  "
+            "hold p50 %9lu  p99 %9lu  max %10lu ns\n",
+            t_name, ( unsigned long ) t_acquires, t_acquires ? 100.0 * t_contended / t_acquires : 0.0,
+            ( unsigned long ) hist_percentile( t_wait, 50 ), ( unsigned long ) hist_percentile( t_wait, 99 ),
+            ( unsigned long ) hist_percentile( t_wait, 99.9 ), ( unsigned long ) t_wait->max.load(),
+            ( unsigned long ) hist_percentile( t_hold, 50 ), ( unsigned long ) hist_percentile( t_hold, 99 ),
+            ( unsigned long ) t_hold->max.load() );
+}
+
+void print_stats( lock_prof_shm *t_shm, uint64_t *t_last )
+{
+    static lat_hist l_wait, l_hold;
+
+    for ( int l = 0; l < LOCK_PROF_LOCKS; l++ )
+    {
+        lock_prof_lock *l_lock = &t_shm->locks[ l ];
+        if ( l_lock->state.load( std::memory_order_acquire ) != LOCK_PROF_READY ) continue;
+
+        hist_clear( &l_wait );
+        hist_clear( &l_hold );
+        uint64_t l_acquires = 0, l_contended = 0;
+        for ( int i = 0; i < LOCK_PROF_PROCS; i++ )
+        {
+            lock_prof_slot *l_slot = &l_lock->slots[ i ];
+            l_acquires += l_slot->acquires.load( std::memory_order_relaxed );
+            l_contended += l_slot->contended.load( std::memory_order_relaxed );
+            hist_merge( &l_wait, &l_slot->wait );
+            hist_merge( &l_hold, &l_slot->hold );
+        }
+
+        print_line( l_lock->name, l_acquires, l_contended, &l_wait, &l_hold );
+        if ( g_interval )
+        {
+            // rate is known from second reading
+            if ( t_last[ l ] )
+                printf( "%-20s %10.1f entries/s\n", "", ( double ) ( l_acquires - t_last[ l ] ) / g_interval );
+            t_last[ l ] = l_acquires;
+        }
+
+        if ( !g_per_proc ) continue;
+        for ( int i = 0; i < LOCK_PROF_PROCS; i++ )
+        {
+            lock_prof_slot *l_slot = &l_lock->slots[ i ];
+            uint64_t l_count = l_slot->acquires.load( std::memory_order_relaxed );
+            if ( !l_count ) continue;
+            char l_name[ 32 ];
+            int l_pid = l_slot->pid.load();
+            if ( l_pid ) sprintf( l_name, "  pid %d", l_pid );
+            else sprintf( l_name, "  finished (slot %d)", i );
+            print_line( l_name, l_count, l_slot->contended.load( std::memory_order_relaxed ), &l_slot->wait, &l_slot->hold );
+        }
+    }
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-p" ) )
+            g_per_proc = 1;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( LOCK_PROF_NAME );
+            log_msg( LOG_INFO, "Statistics cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg && !strcmp( t_args[ i ], "-i" ) )
+            g_interval = atoi( t_args[ ++i ] );
+    }
+
+    if ( g_interval < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    lock_prof_shm *l_shm = lock_prof_attach( 0 );
+    if ( !l_shm )
+    {
+        log_msg( LOG_ERROR, "Unable to attach statistics of locks!" );
+        exit( 1 );
+    }
+
+    uint64_t l_last[ LOCK_PROF_LOCKS ] = { 0 };
+    while ( 1 )
+    {
+        print_stats( l_shm, l_last );
+        if ( !g_interval ) break;
+        printf( "\n" );
+        fflush( stdout );
+        sleep( g_interval );
+    }
+
+    munmap( l_shm, sizeof( lock_prof_shm ) );
+    return 0;
+}
@@ -0,0 +1,139 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Mutex for processes, placed in shared memory.
+//
+// Lock word contains TID of owner (0 = unlocked) and flag of sleeping
+// waiters. Free mutex is locked by one CAS without syscall. Locked
+// mutex is at first polled in user space, number of spins adapts
+// to average time of previous waiting. Then process sleeps on futex
+// and unlock wakes one sleeper only when waiters flag is set.
+//
+// Sleeping process checks owner periodically. When owner died in
+// critical section, waiter takes mutex over and lock returns
+// PROC_MUTEX_OWNER_DEAD, so data protected by mutex can be repaired.
+//
+//***************************************************************************
+
+#ifndef __PROC_MUTEX_H
+#define __PROC_MUTEX_H
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define MUTEX_WAITERS           0x40000000      // flag in lock word, TID is lower
+#define MUTEX_SPIN_MAX          1000
+#define MUTEX_CHECK_MS          100             // check of owner by sleeping waiter
+
+// result of proc_mutex_lock()
+#define PROC_MUTEX_OWNER_DEAD   1
+
+struct proc_mutex
+{
+    alignas( CACHE_LINE ) std::atomic<int> word;
+    std::atomic<int> spins;                     // average spins before lock
+    std::atomic<int> recovered;                 // number of dead owners
+};
+
+// TID is cached, child after fork() must read its own
+static thread_local int g_mutex_tid = 0;
+static std::atomic<int> g_mutex_atfork( 0 );
+
+static inline void mutex_forget_tid()
+{
+    g_mutex_tid = 0;
+}
+
+static inline int mutex_tid()
+{
+    if ( !g_mutex_tid )
+    {
+        if ( !g_mutex_atfork.exchange( 1 ) )
+            pthread_atfork( nullptr, nullptr, mutex_forget_tid );
+        g_mutex_tid = syscall( SYS_gettid );
+    }
+    return g_mutex_tid;
+}
+
+static inline void proc_mutex_init( proc_mutex *t_mutex )
+{
+    t_mutex->word.store( 0 );
+    t_mutex->spins.store( 0 );
+    t_mutex->recovered.store( 0 );
+}
+
+// returns 0 or EBUSY
+static inline int proc_mutex_trylock( proc_mutex *t_mutex )
+{
+    int l_free = 0;
+    return t_mutex->word.compare_exchange_strong( l_free, mutex_tid(), std::memory_order_acquire ) ? 0 : EBUSY;
+}
+
+// Returns 0 or PROC_MUTEX_OWNER_DEAD, in both cases mutex is locked.
+static inline int proc_mutex_lock( proc_mutex *t_mutex )
+{
+    int l_self = mutex_tid();
+    int l_cur = 0;
+    if ( t_mutex->word.compare_exchange_strong( l_cur, l_self, std::memory_order_acquire ) ) return 0;
+
+    // spin at most twice as long as others needed recently
+    int l_avg = t_mutex->spins.load( std::memory_order_relaxed );
+    int l_max = 2 * l_avg + 10 < MUTEX_SPIN_MAX ? 2 * l_avg + 10 : MUTEX_SPIN_MAX;
+    for ( int l_spin = 0; l_spin < l_max; l_spin++ )
+    {
+        cpu_relax();
+        l_cur = t_mutex->word.load( std::memory_order_relaxed );
+        if ( !l_cur && t_mutex->word.compare_exchange_weak( l_cur, l_self, std::memory_order_acquire ) )
+        {
+            t_mutex->spins.store( l_avg + ( l_spin - l_avg ) / 8, std::memory_order_relaxed );
+            return 0;
+        }
+    }
+    t_mutex->spins.store( l_avg + ( l_max - l_avg ) / 8, std::memory_order_relaxed );
+
+    timespec l_tout = { 0, MUTEX_CHECK_MS * 1000000L };
+    while ( 1 )
+    {
+        l_cur = t_mutex->word.load( std::memory_order_relaxed );
+        if ( !l_cur )
+        {
+            // other processes can sleep, so unlock must wake them
+            if ( t_mutex->word.compare_exchange_weak( l_cur, l_self | MUTEX_WAITERS, std::memory_order_acquire ) )
+                return 0;
+            continue;
+        }
+
+        if ( !( l_cur & MUTEX_WAITERS ) &&
+             !t_mutex->word.compare_exchange_weak( l_cur, l_cur | MUTEX_WAITERS, std::memory_order_relaxed ) )
+            continue;
+        l_cur |= MUTEX_WAITERS;
+
+        if ( futex_wait( &t_mutex->word, l_cur, &l_tout ) < 0 && errno == ETIMEDOUT &&
+             kill( l_cur & ~MUTEX_WAITERS, 0 ) < 0 && errno == ESRCH )
+        {
+            // owner does not exist, only one waiter takes mutex over
+            if ( t_mutex->word.compare_exchange_strong( l_cur, l_self | MUTEX_WAITERS, std::memory_order_acquire ) )
+            {
+                t_mutex->recovered.fetch_add( 1, std::memory_order_relaxed );
+                return PROC_MUTEX_OWNER_DEAD;
+            }
+        }
+    }
+}
+
+static inline void proc_mutex_unlock( proc_mutex *t_mutex )
+{
+    if ( t_mutex->word.exchange( 0, std::memory_order_release ) & MUTEX_WAITERS )
+        futex_wake( &t_mutex->word, 1 );
+}
+
+#endif // __PROC_MUTEX_H
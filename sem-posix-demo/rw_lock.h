@@ -0,0 +1,122 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Reader-writer lock for processes, placed in shared memory.
+//
+// Every reader has its own indicator in its own cache line, so readers
+// do not write any shared counter. Reader sets its indicator and then
+// checks writer word. Writer takes writer word (writers are mutually
+// excluded) and then waits until all indicators are cleared. Readers
+// arriving while writer waits or works back off, so writers are
+// preferred and can not starve.
+//
+// Waiting processes sleep on futex: readers and writers on writer
+// word, writer waiting for reader on its indicator. Value 2 marks
+// sleeping process, so unlock calls futex only when it is needed.
+//
+//***************************************************************************
+
+#ifndef __RW_LOCK_H
+#define __RW_LOCK_H
+
+#include <atomic>
+
+#include "futex.h"
+
+#define RW_MAX_READERS          128
+#define RW_SPIN                 200
+
+// values of writer word and reader indicator
+#define RW_FREE                 0
+#define RW_BUSY                 1
+#define RW_SLEEP                2               // busy and somebody sleeps
+
+struct rw_reader
+{
+    alignas( CACHE_LINE ) std::atomic<int> active;
+};
+
+struct rw_lock
+{
+    alignas( CACHE_LINE ) std::atomic<int> writer;
+    int nreaders;                               // used indicators
+    rw_reader readers[ RW_MAX_READERS ];
+};
+
+static inline void rw_init( rw_lock *t_lock, int t_nreaders )
+{
+    t_lock->writer.store( RW_FREE );
+    t_lock->nreaders = t_nreaders < RW_MAX_READERS ? t_nreaders : RW_MAX_READERS;
+    for ( int i = 0; i < RW_MAX_READERS; i++ )
+        t_lock->readers[ i ].active.store( RW_FREE );
+}
+
+// wait until t_word is RW_FREE, spin shortly and then sleep
+static inline void rw_wait_free( std::atomic<int> *t_word )
+{
+    for ( int l_spin = 0; ; l_spin++ )
+    {
+        int l_val = t_word->load( std::memory_order_acquire );
+        if ( l_val == RW_FREE ) return;
+        if ( l_spin < RW_SPIN )
+        {
+            cpu_relax();
+            continue;
+        }
+        if ( l_val == RW_SLEEP || t_word->compare_exchange_weak( l_val, RW_SLEEP ) )
+            futex_wait( t_word, RW_SLEEP );
+    }
+}
+
+// t_index is unique index of process (0 .. RW_MAX_READERS-1)
+static inline void rw_read_lock( rw_lock *t_lock, int t_index )
+{
+    std::atomic<int> *l_active = &t_lock->readers[ t_index ].active;
+    while ( 1 )
+    {
+        // indicator must be visible before writer is checked (seq_cst)
+        l_active->store( RW_BUSY );
+        if ( t_lock->writer.load() == RW_FREE ) return;
+
+        // back off, writer can wait for this reader
+        if ( l_active->exchange( RW_FREE ) == RW_SLEEP )
+            futex_wake( l_active, 1 );
+        rw_wait_free( &t_lock->writer );
+    }
+}
+
+static inline void rw_read_unlock( rw_lock *t_lock, int t_index )
+{
+    std::atomic<int> *l_active = &t_lock->readers[ t_index ].active;
+    if ( l_active->exchange( RW_FREE, std::memory_order_release ) == RW_SLEEP )
+        futex_wake( l_active, 1 );
+}
+
+static inline void rw_write_lock( rw_lock *t_lock )
+{
+    // mutual exclusion of writers, new readers back off from now
+    int l_free = RW_FREE;
+    if ( !t_lock->writer.compare_exchange_strong( l_free, RW_BUSY ) )
+        while ( 1 )
+        {
+            rw_wait_free( &t_lock->writer );
+            // other processes can sleep, unlock must wake them
+            l_free = RW_FREE;
+            if ( t_lock->writer.compare_exchange_strong( l_free, RW_SLEEP ) ) break;
+        }
+
+    // wait for readers in critical section
+    for ( int i = 0; i < t_lock->nreaders; i++ )
+        rw_wait_free( &t_lock->readers[ i ].active );
+}
+
+static inline void rw_write_unlock( rw_lock *t_lock )
+{
+    if ( t_lock->writer.exchange( RW_FREE, std::memory_order_release ) == RW_SLEEP )
+        futex_wake( &t_lock->writer );
+}
+
+#endif // __RW_LOCK_H
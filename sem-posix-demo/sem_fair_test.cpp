@@ -0,0 +1,293 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Fairness of locks between processes.
+//
+// Processes repeatedly enter critical section protected by named
+// semaphore, futex mutex, ticket lock or MCS lock. Every process
+// measures its waiting time for lock into its own histogram in shared
+// memory. Percentiles of waiting time, the worst process and ratio
+// of entries of the least and the most successful process are reported.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "proc_mutex.h"
+#include "fair_lock.h"
+#include "lat_hist.h"
+
+#define SEM_NAME        "/sem_fair_test"
+
+#define LOCK_SEM        0
+#define LOCK_FUTEX      1
+#define LOCK_TICKET     2
+#define LOCK_MCS        3
+
+// statistics of one process
+struct proc_stats
+{
+    alignas( CACHE_LINE ) lat_hist wait;
+    std::atomic<long> entries;
+};
+
+// data structure for shared memory, anonymous mapping shared with children
+struct shm_data
+{
+    proc_mutex fmutex;
+    ticket_lock ticket;
+    mcs_lock mcs;
+    alignas( CACHE_LINE ) std::atomic<int> stop;
+    alignas( CACHE_LINE ) long counter;         // protected by lock
+    proc_stats procs[ MCS_MAX_NODES ];
+};
+
+// parameters of test
+int g_max_proc = 64;
+int g_seconds = 1;
+int g_cs_ns = 1000;
+int g_out_ns = 1000;
+
+sem_t *g_sem = nullptr;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Fairness of process-shared locks.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-t seconds] [-c cs_ns] [-o out_ns]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean semaphore \n"
+        "    -p  max. number of processes (max. %d, default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "    -c  length of critical section in ns (default %d)\n"
+        "    -o  work outside of critical section in ns (default %d)\n"
+        "\n", t_name, MCS_MAX_NODES, g_max_proc, g_seconds, g_cs_ns, g_out_ns );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void busy_work( int t_ns )
+{
+    if ( t_ns <= 0 ) return;
+    long long l_end = time_ns() + t_ns;
+    while ( time_ns() < l_end );
+}
+
+void worker( shm_data *t_data, int t_type, int t_index )
+{
+    proc_stats *l_stats = &t_data->procs[ t_index ];
+    long l_entries = 0;
+
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        long long l_start = time_ns();
+        switch ( t_type )
+        {
+        case LOCK_SEM:    while ( sem_wait( g_sem ) < 0 && errno == EINTR ); break;
+        case LOCK_FUTEX:  proc_mutex_lock( &t_data->fmutex ); break;
+        case LOCK_TICKET: ticket_lock_acquire( &t_data->ticket ); break;
+        case LOCK_MCS:    mcs_lock_acquire( &t_data->mcs, t_index ); break;
+        }
+        long long l_locked = time_ns();
+
+        t_data->counter++;
+        busy_work( g_cs_ns );
+
+        switch ( t_type )
+        {
+        case LOCK_SEM:    sem_post( g_sem ); break;
+        case LOCK_FUTEX:  proc_mutex_unlock( &t_data->fmutex ); break;
+        case LOCK_TICKET: ticket_lock_release( &t_data->ticket ); break;
+        case LOCK_MCS:    mcs_lock_release( &t_data->mcs, t_index ); break;
+        }
+
+        hist_add( &l_stats->wait, l_locked - l_start );
+        l_entries++;
+        busy_work( g_out_ns );
+    }
+
+    l_stats->entries = l_entries;
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_type, int t_nproc )
+{
+    const char *l_names[] = { "named sem", "futex mutex", "ticket lock", "MCS lock" };
+
+    t_data->stop = 0;
+    t_data->counter = 0;
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        hist_clear( &t_data->procs[ i ].wait );
+        t_data->procs[ i ].entries = 0;
+    }
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data, t_type, i );
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    static lat_hist l_all;
+    hist_clear( &l_all );
+    long l_entries = 0, l_min = -1, l_max = 0;
+    uint64_t l_worst_p99 = 0;
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        proc_stats *l_stats = &t_data->procs[ i ];
+        hist_merge( &l_all, &l_stats->wait );
+        l_entries += l_stats->entries;
+        if ( l_min < 0 || l_stats->entries < l_min ) l_min = l_stats->entries;
+        if ( l_stats->entries > l_max ) l_max = l_stats->entries;
+        uint64_t l_p99 = hist_percentile( &l_stats->wait, 99 );
+        if ( l_p99 > l_worst_p99 ) l_worst_p99 = l_p99;
+    }
+
+    printf( "%-12s %3d processes  %10.0f entries/s  wait p50 %8lu  p99 %9lu  p99.9 %9lu  max %10lu ns"
+            "  worst process p99 %9lu ns  min/max entries %.2f%s\n",
+            l_names[ t_type ], t_nproc, ( double ) l_entries / g_seconds,
+            ( unsigned long ) hist_percentile( &l_all, 50 ), ( unsigned long ) hist_percentile( &l_all, 99 ),
+            ( unsigned long ) hist_percentile( &l_all, 99.9 ), ( unsigned long ) l_all.max.load(),
+            ( unsigned long ) l_worst_p99, l_max ? ( double ) l_min / l_max : 0.0,
+            l_entries == t_data->counter ? "" : "  MUTUAL EXCLUSION BROKEN!" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            sem_unlink( SEM_NAME );
+            log_msg( LOG_INFO, "Semaphore cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_cs_ns = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-o" ) ) g_out_ns = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_max_proc > MCS_MAX_NODES || g_seconds <= 0 || g_cs_ns < 0 || g_out_ns < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    g_sem = sem_open( SEM_NAME, O_RDWR | O_CREAT, 0660, 1 );
+    if ( g_sem == SEM_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create semaphore!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    proc_mutex_init( &l_data->fmutex );
+    ticket_init( &l_data->ticket );
+    mcs_init( &l_data->mcs );
+
+    for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+    {
+        for ( int l_type = LOCK_SEM; l_type <= LOCK_MCS; l_type++ )
+            run_test( l_data, l_type, l_nproc );
+        printf( "\n" );
+    }
+
+    munmap( l_data, sizeof( shm_data ) );
+    sem_close( g_sem );
+    sem_unlink( SEM_NAME );
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Flat combining versus locking between processes.
+//
+// Processes repeatedly execute short operation on shared data (update
+// of several counters). Operation is protected by named semaphore,
+// by futex mutex (proc_mutex.h) or it is executed by flat combining
+// (flat_combine.h). Test is repeated for 1, 2, 4 ... N processes.
+// Counters must be equal to number of operations.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "proc_mutex.h"
+#include "flat_combine.h"
+
+#define SEM_NAME        "/sem_fc_test"
+
+#define LOCK_SEM        0
+#define LOCK_FUTEX      1
+#define LOCK_FC         2
+
+#define DATA_ITEMS      32                      // counters updated by operation
+#define OP_ADD          1
+
+// data structure for shared memory, anonymous mapping shared with children
+struct shm_data
+{
+    proc_mutex fmutex;
+    flat_combine fc;
+    alignas( CACHE_LINE ) std::atomic<int> stop;
+    std::atomic<long> ops;
+    alignas( CACHE_LINE ) long items[ DATA_ITEMS ];     // protected by lock
+};
+
+// parameters of test
+int g_max_proc = 64;
+int g_seconds = 1;
+int g_out_ns = 0;
+
+sem_t *g_sem = nullptr;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Flat combining versus locking.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-t seconds] [-o out_ns]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean semaphore \n"
+        "    -p  max. number of processes (max. %d, default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "    -o  work outside of critical section in ns (default %d)\n"
+        "\n", t_name, FC_MAX_SLOTS, g_max_proc, g_seconds, g_out_ns );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void busy_work( int t_ns )
+{
+    if ( t_ns <= 0 ) return;
+    long long l_end = time_ns() + t_ns;
+    while ( time_ns() < l_end );
+}
+
+// operation on shared data, caller must have exclusive access
+long apply_op( void *t_ctx, int t_op, long t_arg )
+{
+    shm_data *l_data = ( shm_data * ) t_ctx;
+    if ( t_op != OP_ADD ) return -1;
+    for ( int i = 0; i < DATA_ITEMS; i++ )
+        l_data->items[ i ] += t_arg;
+    return l_data->items[ 0 ];
+}
+
+void worker( shm_data *t_data, int t_type, int t_index )
+{
+    long l_ops = 0;
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        switch ( t_type )
+        {
+        case LOCK_SEM:
+            while ( sem_wait( g_sem ) < 0 && errno == EINTR );
+            apply_op( t_data, OP_ADD, 1 );
+            sem_post( g_sem );
+            break;
+        case LOCK_FUTEX:
+            proc_mutex_lock( &t_data->fmutex );
+            apply_op( t_data, OP_ADD, 1 );
+            proc_mutex_unlock( &t_data->fmutex );
+            break;
+        case LOCK_FC:
+            fc_execute( &t_data->fc, t_index, OP_ADD, 1, apply_op, t_data );
+            break;
+        }
+
+        busy_work( g_out_ns );
+        l_ops++;
+    }
+    t_data->ops += l_ops;
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_type, int t_nproc )
+{
+    const char *l_names[] = { "named sem", "futex mutex", "flat combining" };
+
+    t_data->stop = 0;
+    t_data->ops = 0;
+    for ( int i = 0; i < DATA_ITEMS; i++ )
+        t_data->items[ i ] = 0;
+    fc_init( &t_data->fc, t_nproc );
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data, t_type, i );
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    long l_ops = t_data->ops;
+    int l_ok = 1;
+    for ( int i = 0; i < DATA_ITEMS; i++ )
+        if ( t_data->items[ i ] != l_ops ) l_ok = 0;
+
+    printf( "%-14s %3d processes  %11.0f ops/s", l_names[ t_type ], t_nproc, ( double ) l_ops / g_seconds );
+    if ( t_type == LOCK_FC && t_data->fc.combines )
+        printf( "  %6.2f ops/combine", ( double ) t_data->fc.combined / t_data->fc.combines );
+    printf( "%s\n", l_ok ? "" : "  MUTUAL EXCLUSION BROKEN!" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            sem_unlink( SEM_NAME );
+            log_msg( LOG_INFO, "Semaphore cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-o" ) ) g_out_ns = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_max_proc > FC_MAX_SLOTS || g_seconds <= 0 || g_out_ns < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    g_sem = sem_open( SEM_NAME, O_RDWR | O_CREAT, 0660, 1 );
+    if ( g_sem == SEM_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create semaphore!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    proc_mutex_init( &l_data->fmutex );
+
+    for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+    {
+        for ( int l_type = LOCK_SEM; l_type <= LOCK_FC; l_type++ )
+            run_test( l_data, l_type, l_nproc );
+        printf( "\n" );
+    }
+
+    munmap( l_data, sizeof( shm_data ) );
+    sem_close( g_sem );
+    sem_unlink( SEM_NAME );
+
+    return 0;
+}
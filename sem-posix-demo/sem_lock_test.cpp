@@ -0,0 +1,363 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Contention of locks between processes.
+//
+// Processes repeatedly enter critical section protected by:
+//   named semaphore (sem_open),
+//   pthread mutex with PTHREAD_PROCESS_SHARED in shared memory,
+//   plain spin lock in shared memory,
+//   futex mutex (proc_mutex.h) in shared memory.
+// Critical section increments plain counter and busy waits given time.
+// Test is repeated for 1, 2, 4 ... N processes and several lengths
+// of critical section. Counter must be equal to number of entries.
+//
+// Before the test recovery of futex mutex is checked: process is killed
+// while it holds mutex and waiting process must take mutex over.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "proc_mutex.h"
+
+#define SEM_NAME        "/sem_lock_test"
+
+#define LOCK_SEM        0
+#define LOCK_PTHREAD    1
+#define LOCK_SPIN       2
+#define LOCK_FUTEX      3
+
+// data structure for shared memory, anonymous mapping shared with children
+struct shm_data
+{
+    alignas( CACHE_LINE ) pthread_mutex_t pmutex;
+    alignas( CACHE_LINE ) std::atomic<int> spin;
+    proc_mutex fmutex;
+    alignas( CACHE_LINE ) std::atomic<int> stop;
+    std::atomic<int> locked;                    // owner of mutex is ready to be killed
+    std::atomic<long> entries;
+    alignas( CACHE_LINE ) long counter;         // protected by lock
+};
+
+// parameters of test
+int g_max_proc = 64;
+int g_seconds = 1;
+int g_cs_ns = -1;                               // -1 = several lengths
+int g_out_ns = 0;
+
+sem_t *g_sem = nullptr;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Contention of process-shared locks.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-t seconds] [-c cs_ns] [-o out_ns]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean semaphore \n"
+        "    -p  max. number of processes (default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "    -c  length of critical section in ns (default 0, 1000 and 10000)\n"
+        "    -o  work outside of critical section in ns (default %d)\n"
+        "\n", t_name, g_max_proc, g_seconds, g_out_ns );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void busy_work( int t_ns )
+{
+    if ( t_ns <= 0 ) return;
+    long long l_end = time_ns() + t_ns;
+    while ( time_ns() < l_end );
+}
+
+void lock( shm_data *t_data, int t_type )
+{
+    switch ( t_type )
+    {
+    case LOCK_SEM:
+        while ( sem_wait( g_sem ) < 0 && errno == EINTR );
+        break;
+    case LOCK_PTHREAD:
+        pthread_mutex_lock( &t_data->pmutex );
+        break;
+    case LOCK_SPIN:
+        while ( t_data->spin.exchange( 1, std::memory_order_acquire ) )
+            while ( t_data->spin.load( std::memory_order_relaxed ) )
+                cpu_relax();
+        break;
+    case LOCK_FUTEX:
+        proc_mutex_lock( &t_data->fmutex );
+        break;
+    }
+}
+
+void unlock( shm_data *t_data, int t_type )
+{
+    switch ( t_type )
+    {
+    case LOCK_SEM:
+        sem_post( g_sem );
+        break;
+    case LOCK_PTHREAD:
+        pthread_mutex_unlock( &t_data->pmutex );
+        break;
+    case LOCK_SPIN:
+        t_data->spin.store( 0, std::memory_order_release );
+        break;
+    case LOCK_FUTEX:
+        proc_mutex_unlock( &t_data->fmutex );
+        break;
+    }
+}
+
+void worker( shm_data *t_data, int t_type, int t_cs_ns )
+{
+    long l_entries = 0;
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        lock( t_data, t_type );
+        t_data->counter++;
+        busy_work( t_cs_ns );
+        unlock( t_data, t_type );
+
+        busy_work( g_out_ns );
+        l_entries++;
+    }
+    t_data->entries += l_entries;
+    exit( 0 );
+}
+
+// Process holding futex mutex is killed, waiter must get PROC_MUTEX_OWNER_DEAD.
+// Returns 0 when mutex was recovered.
+int owner_death_test( shm_data *t_data )
+{
+    proc_mutex_init( &t_data->fmutex );
+    t_data->locked = 0;
+
+    fflush( stdout );
+    int l_owner = fork();
+    if ( l_owner < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+    if ( l_owner == 0 )
+    {
+        proc_mutex_lock( &t_data->fmutex );
+        t_data->locked = 1;
+        while ( 1 ) pause();
+    }
+    while ( !t_data->locked )
+        usleep( 1000 );
+
+    int l_waiter = fork();
+    if ( l_waiter < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+    if ( l_waiter == 0 )
+    {
+        int l_ret = proc_mutex_lock( &t_data->fmutex );
+        proc_mutex_unlock( &t_data->fmutex );
+        exit( l_ret == PROC_MUTEX_OWNER_DEAD ? 0 : 1 );
+    }
+
+    // waiter goes to sleep on futex, then owner dies
+    usleep( 50000 );
+    long long l_start = time_ns();
+    kill( l_owner, SIGKILL );
+    waitpid( l_owner, nullptr, 0 );
+
+    int l_status;
+    waitpid( l_waiter, &l_status, 0 );
+    int l_ok = WIFEXITED( l_status ) && !WEXITSTATUS( l_status ) &&
+               t_data->fmutex.recovered.load() == 1 && !t_data->fmutex.word.load();
+    log_msg( LOG_INFO, "futex mutex: owner killed, mutex recovered in %.1f ms %s",
+            ( time_ns() - l_start ) / 1e6, l_ok ? "OK" : "FAILED!" );
+
+    proc_mutex_init( &t_data->fmutex );
+    return l_ok ? 0 : -1;
+}
+
+void run_test( shm_data *t_data, int t_type, int t_nproc, int t_cs_ns )
+{
+    const char *l_names[] = { "named sem", "pthread mutex", "spin lock", "futex mutex" };
+
+    t_data->stop = 0;
+    t_data->entries = 0;
+    t_data->counter = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data, t_type, t_cs_ns );
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    long l_entries = t_data->entries;
+    printf( "%-14s %3d processes  cs %6d ns  %11.0f entries/s%s\n",
+            l_names[ t_type ], t_nproc, t_cs_ns, ( double ) l_entries / g_seconds,
+            l_entries == t_data->counter ? "" : "  MUTUAL EXCLUSION BROKEN!" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            sem_unlink( SEM_NAME );
+            log_msg( LOG_INFO, "Semaphore cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_cs_ns = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-o" ) ) g_out_ns = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_seconds <= 0 || g_out_ns < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    g_sem = sem_open( SEM_NAME, O_RDWR | O_CREAT, 0660, 1 );
+    if ( g_sem == SEM_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create semaphore!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    pthread_mutexattr_t l_attr;
+    pthread_mutexattr_init( &l_attr );
+    pthread_mutexattr_setpshared( &l_attr, PTHREAD_PROCESS_SHARED );
+    pthread_mutex_init( &l_data->pmutex, &l_attr );
+    pthread_mutexattr_destroy( &l_attr );
+    l_data->spin = 0;
+    if ( owner_death_test( l_data ) < 0 )
+    {
+        munmap( l_data, sizeof( shm_data ) );
+        sem_close( g_sem );
+        sem_unlink( SEM_NAME );
+        exit( 1 );
+    }
+
+    int l_cs_list[] = { 0, 1000, 10000 };
+    int l_cs_count = 3;
+    if ( g_cs_ns >= 0 )
+    {
+        l_cs_list[ 0 ] = g_cs_ns;
+        l_cs_count = 1;
+    }
+
+    for ( int c = 0; c < l_cs_count; c++ )
+        for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+        {
+            for ( int l_type = LOCK_SEM; l_type <= LOCK_FUTEX; l_type++ )
+                run_test( l_data, l_type, l_nproc, l_cs_list[ c ] );
+            printf( "\n" );
+        }
+
+    pthread_mutex_destroy( &l_data->pmutex );
+    munmap( l_data, sizeof( shm_data ) );
+    sem_close( g_sem );
+    sem_unlink( SEM_NAME );
+
+    return 0;
+}
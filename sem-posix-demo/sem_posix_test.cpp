@@ -9,6 +9,10 @@
 // One semaphore will protect artificial critical section.
 // The second semaphore is used as process number counter.
 // The process which exits last will clean semaphores.
+// With -m critical section is protected by futex mutex in shared memory,
+// process killed in critical section does not block others forever.
+// Waiting and holding time of critical section is recorded by lock
+// profiler (lock_prof.h) and can be printed by lock_prof_read.
 //
 //***************************************************************************
 
@@ -22,14 +26,26 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <semaphore.h>
 
+#include "proc_mutex.h"
+#include "lock_prof.h"
+
 #define SEM_MUTEX_NAME      "/sem_mutex"
 #define SEM_COUNTER_NAME    "/sem_counter"
+#define SHM_MUTEX_NAME      "/sem_shm_mutex"
 
 sem_t *g_sem_mutex = nullptr;
 sem_t *g_sem_counter = nullptr;
 
+// futex mutex in shared memory, used with -m
+proc_mutex *g_mutex = nullptr;
+int g_use_mutex = 0;
+
+// statistics of critical section, nullptr when not available
+lock_prof_slot *g_prof = nullptr;
+
 //***************************************************************************
 // log messages
 
@@ -75,6 +91,8 @@ void clean( void )
 {
     log_msg( LOG_INFO, "Final cleaning ..." );
 
+    lock_prof_close( g_prof );
+
     // decrease number of processes
     if ( sem_trywait( g_sem_counter ) )
     {
@@ -96,6 +114,8 @@ void clean( void )
         log_msg( LOG_INFO, "This process is last. Clean semaphores ..." );
         sem_unlink( SEM_COUNTER_NAME );
         sem_unlink( SEM_MUTEX_NAME );
+        shm_unlink( SHM_MUTEX_NAME );
+        shm_unlink( LOCK_PROF_NAME );
     }
 }
 
@@ -110,34 +130,40 @@ void catch_sig( int t_sig )
 
 void help( int t_narg, char **t_args )
 {
-
-    if ( t_narg <= 1 ) return;
-
-    if ( !strcmp( t_args[ 1 ], "-h" ) )
+    for ( int i = 1; i < t_narg; i++ )
     {
-        printf(
-            "\n"
-            "  Semaphore example.\n"
-            "\n"
-            "  Use: %s [-d -h -r]\n"
-            "\n"
-            "    -h  this help\n"
-            "    -d  debug mode \n"
-            "    -r  clean shared memory \n"
-            "\n", t_args[ 0 ] );
-
-        exit( 0 );
-    }
+        if ( !strcmp( t_args[ i ], "-h" ) )
+        {
+            printf(
+                "\n"
+                "  Semaphore example.\n"
+                "\n"
+                "  Use: %s [-d -h -r -m]\n"
+                "\n"
+                "    -h  this help\n"
+                "    -d  debug mode \n"
+                "    -r  clean shared memory \n"
+                "    -m  use futex mutex in shared memory instead of semaphore \n"
+                "\n", t_args[ 0 ] );
+
+            exit( 0 );
+        }
 
-    if ( !strcmp( t_args[ 1 ], "-d" ) )
-        g_debug = LOG_DEBUG;
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
 
-    if ( !strcmp( t_args[ 1 ], "-r" ) )
-    {
-        log_msg( LOG_INFO, "Clean semaphores." );
-        sem_unlink( SEM_COUNTER_NAME );
-        sem_unlink( SEM_MUTEX_NAME );
-        exit( 0 );
+        if ( !strcmp( t_args[ i ], "-m" ) )
+            g_use_mutex = 1;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            log_msg( LOG_INFO, "Clean semaphores." );
+            sem_unlink( SEM_COUNTER_NAME );
+            sem_unlink( SEM_MUTEX_NAME );
+            shm_unlink( SHM_MUTEX_NAME );
+            shm_unlink( LOCK_PROF_NAME );
+            exit( 0 );
+        }
     }
 }
 
@@ -172,6 +198,29 @@ int main( int t_narg, char **t_args )
         return 1;
     }
 
+    if ( g_use_mutex )
+    {
+        // new memory is filled by zeros, it is unlocked mutex
+        int l_fd = shm_open( SHM_MUTEX_NAME, O_RDWR | O_CREAT, 0660 );
+        if ( l_fd < 0 || ftruncate( l_fd, sizeof( proc_mutex ) ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create shared memory for mutex!" );
+            return 1;
+        }
+        g_mutex = ( proc_mutex * ) mmap( nullptr, sizeof( proc_mutex ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+        close( l_fd );
+        if ( g_mutex == MAP_FAILED )
+        {
+            log_msg( LOG_ERROR, "Unable to attach shared memory for mutex!" );
+            return 1;
+        }
+        log_msg( LOG_INFO, "Futex mutex in shared memory is used." );
+    }
+
+    g_prof = lock_prof_open( lock_prof_attach( 1 ), g_mutex ? SHM_MUTEX_NAME : SEM_MUTEX_NAME );
+    if ( !g_prof )
+        log_msg( LOG_INFO, "Statistics of critical section are not available." );
+
     log_msg( LOG_DEBUG, "Increase number of processes." );
     if ( sem_post( g_sem_counter ) < 0 )
         log_msg( LOG_ERROR, "Unable to increase number of semaphores!" );
@@ -194,8 +243,22 @@ int main( int t_narg, char **t_args )
     {
         // try to enter into critical section
         log_msg( LOG_DEBUG, "Try to enter into critical section ..." );
-        if ( sem_trywait( g_sem_mutex ) < 0 )
+        long long l_start = time_ns();
+        int l_contended = 0;
+        if ( g_mutex )
+        {
+            if ( proc_mutex_trylock( g_mutex ) )
+            {
+                l_contended = 1;
+                log_msg( LOG_DEBUG,  "Critical section is occupied now. Wait for it ..." );
+
+                if ( proc_mutex_lock( g_mutex ) == PROC_MUTEX_OWNER_DEAD )
+                    log_msg( LOG_INFO, "Owner of critical section died, mutex recovered." );
+            }
+        }
+        else if ( sem_trywait( g_sem_mutex ) < 0 )
         {
+            l_contended = 1;
             log_msg( LOG_DEBUG,  "Critical section is occupied now. Wait for it ..." );
 
             if ( sem_wait( g_sem_mutex ) < 0 )
@@ -205,6 +268,7 @@ int main( int t_narg, char **t_args )
             }
         }
 
+        lock_prof_acquired( g_prof, l_start, l_contended );
         log_msg( LOG_DEBUG, "... process is now in critical section..." );
 
         // work in critical section
@@ -220,7 +284,10 @@ int main( int t_narg, char **t_args )
         log_msg( LOG_DEBUG, "... leaving critical section ..." );
 
         // unlock critical section
-        if ( sem_post( g_sem_mutex ) < 0 )
+        lock_prof_released( g_prof );
+        if ( g_mutex )
+            proc_mutex_unlock( g_mutex );
+        else if ( sem_post( g_sem_mutex ) < 0 )
         {
             log_msg( LOG_ERROR, "Unable to unlock critical section!" );
             return 1;
@@ -0,0 +1,306 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Reader-writer locks between processes.
+//
+// Processes read shared data (and check its consistency) or update it.
+// Ratio of writes is given in per mille, default mixes are 95/5
+// and 99/1. Data is protected by named semaphore (readers exclude
+// each other), by pthread rwlock with PTHREAD_PROCESS_SHARED and
+// writer preference, or by rw_lock (rw_lock.h) with per-reader
+// indicators. Test is repeated for 1, 2, 4 ... N processes.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "rw_lock.h"
+
+#define SEM_NAME        "/sem_rw_test"
+
+#define LOCK_SEM        0
+#define LOCK_PTHREAD    1
+#define LOCK_RWLOCK         2
+
+#define DATA_ITEMS      32                      // all items have the same value
+
+// data structure for shared memory, anonymous mapping shared with children
+struct shm_data
+{
+    alignas( CACHE_LINE ) pthread_rwlock_t prwlock;
+    rw_lock rwlock;
+    alignas( CACHE_LINE ) std::atomic<int> stop;
+    std::atomic<long> reads;
+    std::atomic<long> writes;
+    std::atomic<long> errors;
+    alignas( CACHE_LINE ) long items[ DATA_ITEMS ];     // protected by lock
+};
+
+// parameters of test
+int g_max_proc = 64;
+int g_seconds = 1;
+int g_cs_ns = 0;
+int g_write_pm = -1;                            // -1 = 5 % and 1 %
+
+sem_t *g_sem = nullptr;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Reader-writer locks for processes.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-t seconds] [-c cs_ns] [-w writes]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean semaphore \n"
+        "    -p  max. number of processes (max. %d, default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "    -c  length of critical section in ns (default %d)\n"
+        "    -w  writes per mille (default 50 and 10)\n"
+        "\n", t_name, RW_MAX_READERS, g_max_proc, g_seconds, g_cs_ns );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void busy_work( int t_ns )
+{
+    if ( t_ns <= 0 ) return;
+    long long l_end = time_ns() + t_ns;
+    while ( time_ns() < l_end );
+}
+
+void worker( shm_data *t_data, int t_type, int t_index, int t_write_pm )
+{
+    long l_reads = 0, l_writes = 0, l_errors = 0;
+    unsigned int l_seed = t_index + 1;
+
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        if ( ( int ) ( rand_r( &l_seed ) % 1000 ) < t_write_pm )
+        {
+            switch ( t_type )
+            {
+            case LOCK_SEM:     while ( sem_wait( g_sem ) < 0 && errno == EINTR ); break;
+            case LOCK_PTHREAD: pthread_rwlock_wrlock( &t_data->prwlock ); break;
+            case LOCK_RWLOCK:      rw_write_lock( &t_data->rwlock ); break;
+            }
+
+            for ( int i = 0; i < DATA_ITEMS; i++ )
+                t_data->items[ i ]++;
+            busy_work( g_cs_ns );
+            l_writes++;
+
+            switch ( t_type )
+            {
+            case LOCK_SEM:     sem_post( g_sem ); break;
+            case LOCK_PTHREAD: pthread_rwlock_unlock( &t_data->prwlock ); break;
+            case LOCK_RWLOCK:      rw_write_unlock( &t_data->rwlock ); break;
+            }
+        }
+        else
+        {
+            switch ( t_type )
+            {
+            case LOCK_SEM:     while ( sem_wait( g_sem ) < 0 && errno == EINTR ); break;
+            case LOCK_PTHREAD: pthread_rwlock_rdlock( &t_data->prwlock ); break;
+            case LOCK_RWLOCK:      rw_read_lock( &t_data->rwlock, t_index ); break;
+            }
+
+            // reader must not see partial update
+            long l_first = t_data->items[ 0 ];
+            for ( int i = 1; i < DATA_ITEMS; i++ )
+                if ( t_data->items[ i ] != l_first ) l_errors++;
+            busy_work( g_cs_ns );
+            l_reads++;
+
+            switch ( t_type )
+            {
+            case LOCK_SEM:     sem_post( g_sem ); break;
+            case LOCK_PTHREAD: pthread_rwlock_unlock( &t_data->prwlock ); break;
+            case LOCK_RWLOCK:      rw_read_unlock( &t_data->rwlock, t_index ); break;
+            }
+        }
+    }
+
+    t_data->reads += l_reads;
+    t_data->writes += l_writes;
+    t_data->errors += l_errors;
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_type, int t_nproc, int t_write_pm )
+{
+    const char *l_names[] = { "named sem", "pthread rwlock", "rw_lock" };
+
+    t_data->stop = 0;
+    t_data->reads = 0;
+    t_data->writes = 0;
+    t_data->errors = 0;
+    for ( int i = 0; i < DATA_ITEMS; i++ )
+        t_data->items[ i ] = 0;
+    rw_init( &t_data->rwlock, t_nproc );
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data, t_type, i, t_write_pm );
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    long l_reads = t_data->reads, l_writes = t_data->writes;
+    printf( "%-14s %3d processes  writes %4.1f %%  %11.0f reads/s  %10.0f writes/s%s\n",
+            l_names[ t_type ], t_nproc, t_write_pm / 10.0,
+            ( double ) l_reads / g_seconds, ( double ) l_writes / g_seconds,
+            t_data->errors == 0 && t_data->items[ 0 ] == l_writes ? "" : "  MUTUAL EXCLUSION BROKEN!" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            sem_unlink( SEM_NAME );
+            log_msg( LOG_INFO, "Semaphore cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_cs_ns = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-w" ) ) g_write_pm = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_max_proc > RW_MAX_READERS || g_seconds <= 0 || g_cs_ns < 0 || g_write_pm > 1000 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    g_sem = sem_open( SEM_NAME, O_RDWR | O_CREAT, 0660, 1 );
+    if ( g_sem == SEM_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create semaphore!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    pthread_rwlockattr_t l_attr;
+    pthread_rwlockattr_init( &l_attr );
+    pthread_rwlockattr_setpshared( &l_attr, PTHREAD_PROCESS_SHARED );
+    pthread_rwlockattr_setkind_np( &l_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+    pthread_rwlock_init( &l_data->prwlock, &l_attr );
+    pthread_rwlockattr_destroy( &l_attr );
+
+    int l_write_list[] = { 50, 10 };
+    int l_write_count = 2;
+    if ( g_write_pm >= 0 )
+    {
+        l_write_list[ 0 ] = g_write_pm;
+        l_write_count = 1;
+    }
+
+    for ( int w = 0; w < l_write_count; w++ )
+        for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+        {
+            for ( int l_type = LOCK_SEM; l_type <= LOCK_RWLOCK; l_type++ )
+                run_test( l_data, l_type, l_nproc, l_write_list[ w ] );
+            printf( "\n" );
+        }
+
+    pthread_rwlock_destroy( &l_data->prwlock );
+    munmap( l_data, sizeof( shm_data ) );
+    sem_close( g_sem );
+    sem_unlink( SEM_NAME );
+
+    return 0;
+}
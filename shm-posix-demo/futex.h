@@ -0,0 +1,61 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Futex helpers for process-shared synchronization.
+// Futex word must be placed in shared memory, so private futex
+// operations (FUTEX_PRIVATE_FLAG) can not be used.
+//
+//***************************************************************************
+
+#ifndef __FUTEX_H
+#define __FUTEX_H
+
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <atomic>
+
+// atomic int must be address free to be usable in shared memory
+static_assert( ATOMIC_INT_LOCK_FREE == 2, "std::atomic<int> is not lock free!" );
+static_assert( sizeof( std::atomic<int> ) == sizeof( int ), "std::atomic<int> can not be used as futex!" );
+
+// size of cache line, shared data written by different processes
+// should be placed in different cache lines
+#define CACHE_LINE              64
+
+// hint for CPU in busy waiting loop
+static inline void cpu_relax()
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_ia32_pause();
+#elif defined( __aarch64__ )
+    asm volatile( "yield" ::: "memory" );
+#endif
+}
+
+// sleep while *t_addr == t_val, t_tout is relative timeout or nullptr
+static inline int futex_wait( std::atomic<int> *t_addr, int t_val, const timespec *t_tout = nullptr )
+{
+    return syscall( SYS_futex, ( int * ) t_addr, FUTEX_WAIT, t_val, t_tout, nullptr, 0 );
+}
+
+// wake up to t_num processes sleeping on t_addr
+static inline int futex_wake( std::atomic<int> *t_addr, int t_num = INT_MAX )
+{
+    return syscall( SYS_futex, ( int * ) t_addr, FUTEX_WAKE, t_num, nullptr, nullptr, 0 );
+}
+
+// monotonic time in nanoseconds
+static inline long long time_ns()
+{
+    timespec l_ts;
+    clock_gettime( CLOCK_MONOTONIC, &l_ts );
+    return l_ts.tv_sec * 1000000000LL + l_ts.tv_nsec;
+}
+
+#endif // __FUTEX_H
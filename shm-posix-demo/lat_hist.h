@@ -0,0 +1,101 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Histogram of times (latencies) in nanoseconds.
+//
+// Buckets are logarithmic, every power of 2 is divided into 8 linear
+// sub-buckets, so relative error of percentile is below 12.5 %.
+// Histogram has one writer (owning process), values are atomic only
+// to be readable by other processes at any time.
+//
+//***************************************************************************
+
+#ifndef __LAT_HIST_H
+#define __LAT_HIST_H
+
+#include <stdint.h>
+#include <atomic>
+
+#define HIST_SUB_BITS           3
+#define HIST_SUB                ( 1 << HIST_SUB_BITS )
+#define HIST_BUCKETS            ( ( 64 - HIST_SUB_BITS + 1 ) * HIST_SUB )
+
+struct lat_hist
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[ HIST_BUCKETS ];
+};
+
+static inline int hist_bucket( uint64_t t_val )
+{
+    if ( t_val < HIST_SUB ) return t_val;
+    int l_exp = 63 - __builtin_clzll( t_val );
+    return ( l_exp - HIST_SUB_BITS + 1 ) * HIST_SUB + ( ( t_val >> ( l_exp - HIST_SUB_BITS ) ) & ( HIST_SUB - 1 ) );
+}
+
+// the lowest value of bucket
+static inline uint64_t hist_value( int t_bucket )
+{
+    if ( t_bucket < HIST_SUB ) return t_bucket;
+    int l_exp = t_bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    return ( 1ULL << l_exp ) | ( ( uint64_t ) ( t_bucket % HIST_SUB ) << ( l_exp - HIST_SUB_BITS ) );
+}
+
+static inline void hist_clear( lat_hist *t_hist )
+{
+    t_hist->count.store( 0, std::memory_order_relaxed );
+    t_hist->sum.store( 0, std::memory_order_relaxed );
+    t_hist->max.store( 0, std::memory_order_relaxed );
+    for ( int i = 0; i < HIST_BUCKETS; i++ )
+        t_hist->buckets[ i ].store( 0, std::memory_order_relaxed );
+}
+
+// only owner of histogram can add, no atomic RMW is needed
+static inline void hist_add( lat_hist *t_hist, uint64_t t_val )
+{
+    std::atomic<uint64_t> &l_bucket = t_hist->buckets[ hist_bucket( t_val ) ];
+    l_bucket.store( l_bucket.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    t_hist->count.store( t_hist->count.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    t_hist->sum.store( t_hist->sum.load( std::memory_order_relaxed ) + t_val, std::memory_order_relaxed );
+    if ( t_val > t_hist->max.load( std::memory_order_relaxed ) )
+        t_hist->max.store( t_val, std::memory_order_relaxed );
+}
+
+// add histogram t_src into t_dst, t_dst must not be used by other process
+static inline void hist_merge( lat_hist *t_dst, const lat_hist *t_src )
+{
+    for ( int i = 0; i < HIST_BUCKETS; i++ )
+        t_dst->buckets[ i ].store( t_dst->buckets[ i ].load( std::memory_order_relaxed ) +
+                t_src->buckets[ i ].load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    t_dst->count.store( t_dst->count.load( std::memory_order_relaxed ) +
+            t_src->count.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    t_dst->sum.store( t_dst->sum.load( std::memory_order_relaxed ) +
+            t_src->sum.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+    if ( t_src->max.load( std::memory_order_relaxed ) > t_dst->max.load( std::memory_order_relaxed ) )
+        t_dst->max.store( t_src->max.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+}
+
+// value of percentile t_pct (0-100)
+static inline uint64_t hist_percentile( const lat_hist *t_hist, double t_pct )
+{
+    uint64_t l_count = 0;
+    for ( int i = 0; i < HIST_BUCKETS; i++ )
+        l_count += t_hist->buckets[ i ].load( std::memory_order_relaxed );
+    if ( !l_count ) return 0;
+
+    uint64_t l_rank = ( uint64_t ) ( t_pct / 100.0 * ( l_count - 1 ) ) + 1;
+    uint64_t l_sum = 0;
+    for ( int i = 0; i < HIST_BUCKETS; i++ )
+    {
+        l_sum += t_hist->buckets[ i ].load( std::memory_order_relaxed );
+        if ( l_sum >= l_rank ) return hist_value( i );
+    }
+    return t_hist->max.load( std::memory_order_relaxed );
+}
+
+#endif // __LAT_HIST_H
@@ -0,0 +1,199 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Memory allocator inside shared memory segment.
+//
+// Shared memory can be mapped at different address in every process,
+// so allocator works only with offsets from beginning of segment.
+// Blocks have sizes of powers of 2 (size classes). Freed blocks are
+// kept in lock-free list for every size class, new blocks are taken
+// from the end of used area.
+//
+// Template offset_ptr<T> stores distance between pointer and target,
+// so linked structures built in segment are valid in all processes.
+//
+//***************************************************************************
+
+#ifndef __SHM_ARENA_H
+#define __SHM_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define ARENA_MAGIC             0x414E4552414D4853ULL   // "SHMARENA"
+#define ARENA_MIN_SHIFT         4                       // the smallest block 16 B
+#define ARENA_CLASSES           23                      // the largest block 64 MB
+#define ARENA_HDR               8                       // block header (size class)
+#define ARENA_ROOTS             8                       // user roots
+#define ARENA_MAX_SIZE          ( 1ULL << 35 )          // offset / 8 fits into 32 bits
+
+struct shm_arena
+{
+    uint64_t magic;
+    uint64_t size;                              // size of whole segment
+
+    alignas( CACHE_LINE ) std::atomic<uint64_t> top;    // end of used area
+
+    // lists of free blocks: tag (32 bits) | offset / 8 (32 bits), segment max. 32 GB
+    alignas( CACHE_LINE ) std::atomic<uint64_t> free_list[ ARENA_CLASSES ];
+
+    // offsets of user data structures, processes find them here
+    alignas( CACHE_LINE ) std::atomic<uint64_t> root[ ARENA_ROOTS ];
+};
+
+// Initialization by the first process. Returns nullptr (errno EFBIG)
+// when segment is larger than free lists can address.
+static inline shm_arena *shm_arena_init( void *t_base, size_t t_size )
+{
+    if ( t_size > ARENA_MAX_SIZE )
+    {
+        errno = EFBIG;
+        return nullptr;
+    }
+
+    shm_arena *l_arena = ( shm_arena * ) t_base;
+    l_arena->size = t_size;
+    l_arena->top.store( ( sizeof( shm_arena ) + CACHE_LINE - 1 ) & ~( CACHE_LINE - 1ULL ) );
+    for ( int i = 0; i < ARENA_CLASSES; i++ )
+        l_arena->free_list[ i ].store( 0 );
+    for ( int i = 0; i < ARENA_ROOTS; i++ )
+        l_arena->root[ i ].store( 0 );
+    std::atomic_thread_fence( std::memory_order_release );
+    l_arena->magic = ARENA_MAGIC;
+    return l_arena;
+}
+
+// conversions between offsets and addresses, offset 0 is null
+
+template<class T> static inline T *arena_ptr( shm_arena *t_arena, uint64_t t_off )
+{
+    return t_off ? ( T * ) ( ( char * ) t_arena + t_off ) : nullptr;
+}
+
+static inline uint64_t arena_off( shm_arena *t_arena, const void *t_ptr )
+{
+    return t_ptr ? ( const char * ) t_ptr - ( const char * ) t_arena : 0;
+}
+
+static inline int arena_class( size_t t_size )
+{
+    size_t l_need = t_size + ARENA_HDR;
+    int l_cls = 0;
+    while ( ( ( size_t ) 1 << ( l_cls + ARENA_MIN_SHIFT ) ) < l_need )
+        l_cls++;
+    return l_cls;
+}
+
+// Allocate t_size bytes, returns offset of data or 0 when there is no memory.
+// Data is aligned to 8 bytes.
+static inline uint64_t shm_arena_alloc( shm_arena *t_arena, size_t t_size )
+{
+    int l_cls = arena_class( t_size );
+    if ( l_cls >= ARENA_CLASSES ) return 0;
+
+    uint64_t l_block = 0;
+
+    // reuse freed block
+    std::atomic<uint64_t> &l_list = t_arena->free_list[ l_cls ];
+    uint64_t l_head = l_list.load( std::memory_order_acquire );
+    while ( l_head & 0xFFFFFFFF )
+    {
+        uint64_t l_off = ( l_head & 0xFFFFFFFF ) << 3;
+        // block can be taken by other process meanwhile, then CAS fails thanks to tag
+        uint64_t l_next = ( ( std::atomic<uint64_t> * ) ( ( char * ) t_arena + l_off + ARENA_HDR ) )->load( std::memory_order_relaxed );
+        uint64_t l_new = ( ( l_head >> 32 ) + 1 ) << 32 | ( l_next >> 3 );
+        if ( l_list.compare_exchange_weak( l_head, l_new, std::memory_order_acquire ) )
+        {
+            l_block = l_off;
+            break;
+        }
+    }
+
+    // new block from the end of used area
+    if ( !l_block )
+    {
+        // top is moved only when block fits, failed allocation does not change it
+        uint64_t l_bsize = ( uint64_t ) 1 << ( l_cls + ARENA_MIN_SHIFT );
+        l_block = t_arena->top.load( std::memory_order_relaxed );
+        do
+            if ( l_block + l_bsize > t_arena->size ) return 0;
+        while ( !t_arena->top.compare_exchange_weak( l_block, l_block + l_bsize, std::memory_order_relaxed ) );
+    }
+
+    *( uint64_t * ) ( ( char * ) t_arena + l_block ) = l_cls;
+    return l_block + ARENA_HDR;
+}
+
+// return block to free list of its size class
+static inline void shm_arena_free( shm_arena *t_arena, uint64_t t_off )
+{
+    if ( !t_off ) return;
+
+    uint64_t l_block = t_off - ARENA_HDR;
+    int l_cls = *( uint64_t * ) ( ( char * ) t_arena + l_block );
+    std::atomic<uint64_t> *l_next = ( std::atomic<uint64_t> * ) ( ( char * ) t_arena + t_off );
+    std::atomic<uint64_t> &l_list = t_arena->free_list[ l_cls ];
+
+    uint64_t l_head = l_list.load( std::memory_order_relaxed );
+    uint64_t l_new;
+    do
+    {
+        l_next->store( ( l_head & 0xFFFFFFFF ) << 3, std::memory_order_relaxed );
+        l_new = ( ( l_head >> 32 ) + 1 ) << 32 | ( l_block >> 3 );
+    }
+    while ( !l_list.compare_exchange_weak( l_head, l_new, std::memory_order_release, std::memory_order_relaxed ) );
+}
+
+// typed allocation
+template<class T> static inline T *shm_arena_new( shm_arena *t_arena )
+{
+    return arena_ptr<T>( t_arena, shm_arena_alloc( t_arena, sizeof( T ) ) );
+}
+
+template<class T> static inline void shm_arena_delete( shm_arena *t_arena, T *t_ptr )
+{
+    shm_arena_free( t_arena, arena_off( t_arena, t_ptr ) );
+}
+
+// bytes taken from segment (including freed blocks)
+static inline uint64_t shm_arena_used( shm_arena *t_arena )
+{
+    return t_arena->top.load( std::memory_order_relaxed );
+}
+
+//***************************************************************************
+// pointer independent on address of mapping, it must be placed in segment
+
+template<class T> class offset_ptr
+{
+public:
+    offset_ptr() : m_diff( 1 ) {}
+    offset_ptr( T *t_ptr ) { set( t_ptr ); }
+    offset_ptr( const offset_ptr &t_other ) { set( t_other.get() ); }
+
+    offset_ptr &operator=( T *t_ptr ) { set( t_ptr ); return *this; }
+    offset_ptr &operator=( const offset_ptr &t_other ) { set( t_other.get() ); return *this; }
+
+    T *get() const { return m_diff == 1 ? nullptr : ( T * ) ( ( char * ) this + m_diff ); }
+    T *operator->() const { return get(); }
+    T &operator*() const { return *get(); }
+    explicit operator bool() const { return m_diff != 1; }
+
+    bool operator==( const offset_ptr &t_other ) const { return get() == t_other.get(); }
+    bool operator!=( const offset_ptr &t_other ) const { return get() != t_other.get(); }
+
+private:
+    // distance 1 is null, target can not be inside of pointer itself
+    void set( T *t_ptr ) { m_diff = t_ptr ? ( char * ) t_ptr - ( char * ) this : 1; }
+
+    ptrdiff_t m_diff;
+};
+
+#endif // __SHM_ARENA_H
@@ -0,0 +1,342 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Example of allocator inside shared memory.
+//
+// Child processes attach shared memory (every process at different
+// address) and they build common linked list (lock-free) and binary
+// tree (protected by spin lock) from blocks allocated in segment.
+// They also allocate and release blocks of random size.
+// Finally the parent process walks through both structures.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <new>
+
+#include "shm_arena.h"
+#include "shm_segment.h"
+
+#define SHM_NAME        "/shm_arena"
+
+#define ROOT_LIST       0       // index of roots in arena
+#define ROOT_TREE       1
+#define ROOT_READY      2       // processes which finished lists and trees
+
+struct list_node
+{
+    offset_ptr<list_node> next;
+    int pid;
+    int value;
+};
+
+struct tree_node
+{
+    offset_ptr<tree_node> left;
+    offset_ptr<tree_node> right;
+    int key;
+    int pid;
+};
+
+struct tree_root
+{
+    std::atomic<int> lock;
+    offset_ptr<tree_node> top;
+};
+
+// parameters of test
+int g_nproc = 4;
+int g_nodes = 10000;
+int g_churn = 100000;
+size_t g_size = 256UL << 20;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Allocator and linked structures in shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p processes] [-n nodes] [-c churn] [-s size]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  number of processes (default %d)\n"
+        "    -n  number of list and tree nodes per process (default %d)\n"
+        "    -c  number of random alloc/free per process (default %d)\n"
+        "    -s  size of segment, suffix K, M, G allowed (default 256M)\n"
+        "\n"
+        "  Small segment tests allocation at the end of memory, e.g. -s 1M -n 100 -p 8.\n"
+        "  Blocks are checked before release, so overlapping blocks are detected.\n"
+        "\n", t_name, g_nproc, g_nodes, g_churn );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void tree_insert( tree_root *t_root, tree_node *t_node )
+{
+    int l_unlocked = 0;
+    while ( !t_root->lock.compare_exchange_weak( l_unlocked, 1, std::memory_order_acquire ) )
+    {
+        l_unlocked = 0;
+        sched_yield();
+    }
+
+    offset_ptr<tree_node> *l_link = &t_root->top;
+    while ( *l_link )
+        l_link = t_node->key < ( *l_link )->key ? &( *l_link )->left : &( *l_link )->right;
+    *l_link = t_node;
+
+    t_root->lock.store( 0, std::memory_order_release );
+}
+
+void worker( int t_id )
+{
+    shm_segment l_seg;
+    if ( shm_segment_attach( &l_seg, SHM_NAME, SEG_SHM ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        exit( 1 );
+    }
+
+    shm_arena *l_arena = ( shm_arena * ) l_seg.addr;
+    log_msg( LOG_DEBUG, "Process %d attached arena at %p.", getpid(), l_arena );
+
+    std::atomic<uint64_t> &l_list = l_arena->root[ ROOT_LIST ];
+    tree_root *l_tree = arena_ptr<tree_root>( l_arena, l_arena->root[ ROOT_TREE ] );
+    srand( getpid() );
+
+    for ( int i = 0; i < g_nodes; i++ )
+    {
+        list_node *l_lnode = shm_arena_new<list_node>( l_arena );
+        tree_node *l_tnode = shm_arena_new<tree_node>( l_arena );
+        if ( !l_lnode || !l_tnode )
+        {
+            log_msg( LOG_INFO, "Shared memory is full!" );
+            l_arena->root[ ROOT_READY ]++;
+            exit( 1 );
+        }
+
+        // lock-free push to head of list
+        l_lnode->pid = getpid();
+        l_lnode->value = t_id * g_nodes + i;
+        uint64_t l_head = l_list.load( std::memory_order_relaxed );
+        do
+            l_lnode->next = arena_ptr<list_node>( l_arena, l_head );
+        while ( !l_list.compare_exchange_weak( l_head, arena_off( l_arena, l_lnode ), std::memory_order_release ) );
+
+        new ( l_tnode ) tree_node();
+        l_tnode->key = rand();
+        l_tnode->pid = getpid();
+        tree_insert( l_tree, l_tnode );
+    }
+
+    // churn starts when all nodes are allocated, so it can fill whole memory
+    l_arena->root[ ROOT_READY ]++;
+    while ( l_arena->root[ ROOT_READY ].load() < ( uint64_t ) g_nproc )
+        sched_yield();
+
+    // random allocations, every block is filled by pid and checked before release
+    uint64_t l_live[ 64 ] = { 0 };
+    int l_lsize[ 64 ] = { 0 };
+    char l_fill = getpid();
+    long long l_time = 0;
+    int l_full = 0;
+    for ( int i = 0; i < g_churn; i++ )
+    {
+        int l_idx = rand() % 64;
+        char *l_ptr = arena_ptr<char>( l_arena, l_live[ l_idx ] );
+        for ( int k = 0; l_ptr && k < l_lsize[ l_idx ]; k++ )
+            if ( l_ptr[ k ] != l_fill )
+            {
+                log_msg( LOG_INFO, "Block at offset %lu was overwritten!", ( unsigned long ) l_live[ l_idx ] );
+                exit( 1 );
+            }
+
+        l_lsize[ l_idx ] = 8 + rand() % 4096;
+
+        long long l_start = time_ns();
+        shm_arena_free( l_arena, l_live[ l_idx ] );
+        l_live[ l_idx ] = shm_arena_alloc( l_arena, l_lsize[ l_idx ] );
+        l_time += time_ns() - l_start;
+
+        // full segment is not error here, small segment tests allocator at its limit
+        if ( !l_live[ l_idx ] )
+        {
+            l_full++;
+            continue;
+        }
+        memset( arena_ptr<char>( l_arena, l_live[ l_idx ] ), l_fill, l_lsize[ l_idx ] );
+    }
+    double l_sec = l_time / 1e9;
+
+    log_msg( LOG_INFO, "Process %d: %.0f alloc+free/s, %d allocations failed (memory full).", getpid(), g_churn / l_sec, l_full );
+
+    shm_segment_close( &l_seg );
+    exit( 0 );
+}
+
+//***************************************************************************
+
+int tree_walk( tree_node *t_node, int *t_last, int *t_ok )
+{
+    if ( !t_node ) return 0;
+
+    int l_cnt = tree_walk( t_node->left.get(), t_last, t_ok );
+    if ( t_node->key < *t_last ) *t_ok = 0;
+    *t_last = t_node->key;
+    return l_cnt + 1 + tree_walk( t_node->right.get(), t_last, t_ok );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_nproc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_nodes = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_churn = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_size = seg_parse_size( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_nproc <= 0 || g_nodes < 0 || g_churn < 0 || g_size < ( 1 << 20 ) )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    shm_segment l_seg;
+    if ( shm_segment_create( &l_seg, SHM_NAME, g_size, SEG_SHM ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory. Use -r to clean it." );
+        exit( 1 );
+    }
+
+    shm_arena *l_arena = shm_arena_init( l_seg.addr, l_seg.size );
+    if ( !l_arena )
+    {
+        log_msg( LOG_ERROR, "Arena can not be larger than %llu GB!", ARENA_MAX_SIZE >> 30 );
+        shm_segment_close( &l_seg, 1 );
+        exit( 1 );
+    }
+    tree_root *l_tree = new ( shm_arena_new<tree_root>( l_arena ) ) tree_root();
+    l_tree->lock = 0;
+    l_arena->root[ ROOT_TREE ] = arena_off( l_arena, l_tree );
+
+    fflush( stdout );
+    for ( int i = 0; i < g_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( i );
+    }
+
+    int l_failed = 0;
+    for ( int i = 0; i < g_nproc; i++ )
+    {
+        int l_status;
+        wait( &l_status );
+        if ( !WIFEXITED( l_status ) || WEXITSTATUS( l_status ) ) l_failed++;
+    }
+
+    // walk list, every value must be present once
+    char *l_seen = ( char * ) calloc( g_nproc * g_nodes, 1 );
+    int l_list_cnt = 0, l_list_ok = 1;
+    for ( list_node *l_node = arena_ptr<list_node>( l_arena, l_arena->root[ ROOT_LIST ] ); l_node; l_node = l_node->next.get() )
+    {
+        if ( l_node->value < 0 || l_node->value >= g_nproc * g_nodes || l_seen[ l_node->value ]++ )
+            l_list_ok = 0;
+        l_list_cnt++;
+    }
+    free( l_seen );
+
+    int l_last = -1, l_tree_ok = 1;
+    int l_tree_cnt = tree_walk( l_tree->top.get(), &l_last, &l_tree_ok );
+
+    log_msg( LOG_INFO, "Failed processes: %d.", l_failed );
+    log_msg( LOG_INFO, "List: %d nodes (expected %d) %s.", l_list_cnt, g_nproc * g_nodes, l_list_ok ? "OK" : "CORRUPTED" );
+    log_msg( LOG_INFO, "Tree: %d nodes (expected %d) %s.", l_tree_cnt, g_nproc * g_nodes, l_tree_ok ? "sorted" : "NOT SORTED" );
+    log_msg( LOG_INFO, "Used %lu kB of %lu kB.", ( unsigned long ) shm_arena_used( l_arena ) >> 10,
+            ( unsigned long ) l_seg.size >> 10 );
+
+    shm_segment_close( &l_seg, 1 );
+
+    return l_failed || !l_list_ok || !l_tree_ok;
+}
@@ -0,0 +1,90 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Sharded counter in shared memory.
+//
+// Every process gets its own slot in separate cache line and increments
+// only this slot, no atomic read-modify-write is necessary. Total value
+// is sum of all slots. Atomic counter (fetch_add) is available
+// for comparison.
+//
+// Slots are assigned by registry of processes (shm_registry.h), slot is
+// released at detach and slot of killed process is reclaimed. Value of
+// slot is kept, the next owner continues to add to it.
+//
+//***************************************************************************
+
+#ifndef __SHM_COUNTER_H
+#define __SHM_COUNTER_H
+
+#include <atomic>
+
+#include "futex.h"
+#include "shm_registry.h"
+
+#define COUNTER_MAX_SLOTS       REGISTRY_SLOTS
+
+struct counter_slot
+{
+    alignas( CACHE_LINE ) std::atomic<long> value;
+};
+
+struct shm_counter
+{
+    shm_registry users;                         // owners of slots
+    alignas( CACHE_LINE ) std::atomic<long> shared;     // atomic variant
+    counter_slot slots[ COUNTER_MAX_SLOTS ];
+};
+
+static inline void shm_counter_init( shm_counter *t_cnt )
+{
+    shm_registry_init( &t_cnt->users );
+    t_cnt->shared.store( 0 );
+    for ( int i = 0; i < COUNTER_MAX_SLOTS; i++ )
+        t_cnt->slots[ i ].value.store( 0 );
+}
+
+// claim slot for calling process, returns -1 when all slots are used
+static inline int shm_counter_slot( shm_counter *t_cnt )
+{
+    return shm_registry_join( &t_cnt->users );
+}
+
+// release slot at detach, its value stays in total
+static inline void shm_counter_release( shm_counter *t_cnt, int t_slot )
+{
+    shm_registry_leave( &t_cnt->users, t_slot );
+}
+
+// sharded increment, slot is written only by its owner
+static inline void shm_counter_add( shm_counter *t_cnt, int t_slot, long t_val = 1 )
+{
+    std::atomic<long> &l_value = t_cnt->slots[ t_slot ].value;
+    l_value.store( l_value.load( std::memory_order_relaxed ) + t_val, std::memory_order_relaxed );
+}
+
+// aggregated value of all slots
+static inline long shm_counter_read( shm_counter *t_cnt )
+{
+    long l_sum = 0;
+    for ( int i = 0; i < COUNTER_MAX_SLOTS; i++ )
+        l_sum += t_cnt->slots[ i ].value.load( std::memory_order_relaxed );
+    return l_sum;
+}
+
+// atomic variant, all processes share one cache line
+
+static inline void shm_counter_add_atomic( shm_counter *t_cnt, long t_val = 1 )
+{
+    t_cnt->shared.fetch_add( t_val, std::memory_order_relaxed );
+}
+
+static inline long shm_counter_read_atomic( shm_counter *t_cnt )
+{
+    return t_cnt->shared.load( std::memory_order_relaxed );
+}
+
+#endif // __SHM_COUNTER_H
@@ -0,0 +1,253 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Counters in shared memory.
+//
+// Processes increment counter in shared memory in three ways:
+//   naive   - plain ++ of one shared int (lost updates!)
+//   atomic  - fetch_add on one shared counter
+//   sharded - every process increments its own slot
+// Test is repeated for 1, 2, 4 ... N processes.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "shm_counter.h"
+
+#define SHM_NAME        "/shm_counter"
+
+#define MODE_NAIVE      0
+#define MODE_ATOMIC     1
+#define MODE_SHARDED    2
+
+// data structure for shared memory
+struct shm_data
+{
+    std::atomic<int> ready;
+    std::atomic<int> start;
+    alignas( CACHE_LINE ) volatile long naive;
+    shm_counter counter;
+};
+
+// parameters of test
+int g_max_proc = 32;
+long g_incs = 10000000;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Naive, atomic and sharded counters in shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-n increments]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  max. number of processes (default %d, max %d)\n"
+        "    -n  total number of increments in one test (default %ld)\n"
+        "\n", t_name, g_max_proc, COUNTER_MAX_SLOTS, g_incs );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void worker( shm_data *t_data, int t_mode, long t_count )
+{
+    int l_slot = shm_counter_slot( &t_data->counter );
+    if ( l_slot < 0 )
+    {
+        log_msg( LOG_INFO, "No free slot for counter!" );
+        exit( 1 );
+    }
+
+    t_data->ready++;
+    while ( !t_data->start.load( std::memory_order_acquire ) )
+        sched_yield();
+
+    switch ( t_mode )
+    {
+    case MODE_NAIVE:
+        for ( long i = 0; i < t_count; i++ )
+            t_data->naive++;
+        break;
+
+    case MODE_ATOMIC:
+        for ( long i = 0; i < t_count; i++ )
+            shm_counter_add_atomic( &t_data->counter );
+        break;
+
+    case MODE_SHARDED:
+        for ( long i = 0; i < t_count; i++ )
+            shm_counter_add( &t_data->counter, l_slot );
+        break;
+    }
+
+    shm_counter_release( &t_data->counter, l_slot );
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_mode, int t_nproc )
+{
+    const char *l_names[] = { "naive", "atomic", "sharded" };
+    long l_per_proc = g_incs / t_nproc;
+
+    t_data->ready = 0;
+    t_data->start = 0;
+    t_data->naive = 0;
+    shm_counter_init( &t_data->counter );
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data, t_mode, l_per_proc );
+    }
+
+    while ( t_data->ready < t_nproc )
+        usleep( 1000 );
+
+    long long l_start = time_ns();
+    t_data->start.store( 1, std::memory_order_release );
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    double l_sec = ( time_ns() - l_start ) / 1e9;
+
+    long l_result = 0;
+    switch ( t_mode )
+    {
+    case MODE_NAIVE:   l_result = t_data->naive; break;
+    case MODE_ATOMIC:  l_result = shm_counter_read_atomic( &t_data->counter ); break;
+    case MODE_SHARDED: l_result = shm_counter_read( &t_data->counter ); break;
+    }
+
+    printf( "%-8s %3d processes  %14.0f inc/s  result %ld of %ld%s\n",
+            l_names[ t_mode ], t_nproc, l_per_proc * t_nproc / l_sec, l_result, l_per_proc * t_nproc,
+            l_result != l_per_proc * t_nproc ? "  (LOST UPDATES)" : "" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_incs = atol( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_max_proc > COUNTER_MAX_SLOTS || g_incs <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory." );
+        exit( 1 );
+    }
+    if ( ftruncate( l_fd, sizeof( shm_data ) ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+
+    for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+        for ( int l_mode = MODE_NAIVE; l_mode <= MODE_SHARDED; l_mode++ )
+            run_test( l_data, l_mode, l_nproc );
+
+    munmap( l_data, sizeof( shm_data ) );
+    shm_unlink( SHM_NAME );
+
+    return 0;
+}
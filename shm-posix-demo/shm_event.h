@@ -0,0 +1,61 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Waiting for change of value in shared memory.
+//
+// Any int in shared memory can be used as futex word. Waiting process
+// sleeps in kernel until value differs from value it saw last time.
+// Number of sleeping processes is counted, so process changing value
+// calls futex_wake() only when somebody is sleeping, and it can wake
+// all sleepers once after a batch of changes.
+//
+//***************************************************************************
+
+#ifndef __SHM_EVENT_H
+#define __SHM_EVENT_H
+
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+// Sleep while *t_word == t_old. t_waiters counts sleeping processes.
+// Returns current value of word. With timeout (ms >= 0) value
+// can be still t_old.
+static inline int shm_wait_change( std::atomic<int> *t_word, std::atomic<int> *t_waiters, int t_old, int t_tout_ms = -1 )
+{
+    timespec l_tout = { t_tout_ms / 1000, ( t_tout_ms % 1000 ) * 1000000L };
+
+    int l_cur = t_word->load( std::memory_order_acquire );
+    if ( l_cur != t_old ) return l_cur;
+
+    t_waiters->fetch_add( 1, std::memory_order_seq_cst );
+    // value is checked by kernel again, change between load and sleep is not lost
+    futex_wait( t_word, t_old, t_tout_ms >= 0 ? &l_tout : nullptr );
+    t_waiters->fetch_sub( 1, std::memory_order_relaxed );
+
+    return t_word->load( std::memory_order_acquire );
+}
+
+// wake all sleepers after value was changed
+static inline void shm_notify( std::atomic<int> *t_word, std::atomic<int> *t_waiters )
+{
+    // pairs with fetch_add in shm_wait_change
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( t_waiters->load( std::memory_order_relaxed ) > 0 )
+        futex_wake( t_word );
+}
+
+// change value and wake sleepers only once per t_batch changes
+static inline int shm_add_notify( std::atomic<int> *t_word, std::atomic<int> *t_waiters, int t_val = 1, int t_batch = 1 )
+{
+    int l_new = t_word->fetch_add( t_val, std::memory_order_release ) + t_val;
+    if ( t_batch <= 1 || !( l_new % t_batch ) )
+        shm_notify( t_word, t_waiters );
+    return l_new;
+}
+
+#endif // __SHM_EVENT_H
@@ -0,0 +1,136 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Passing of file descriptors between processes.
+//
+// Descriptor is sent over Unix socket as SCM_RIGHTS control message,
+// receiver gets new descriptor of the same open file (e.g. memfd).
+// Server socket has name in abstract namespace (leading zero byte),
+// so no file is created and name disappears with the socket.
+//
+//***************************************************************************
+
+#ifndef __SHM_FDPASS_H
+#define __SHM_FDPASS_H
+
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static inline socklen_t fdpass_addr( sockaddr_un *t_addr, const char *t_name )
+{
+    bzero( t_addr, sizeof( *t_addr ) );
+    t_addr->sun_family = AF_UNIX;
+    size_t l_len = strnlen( t_name, sizeof( t_addr->sun_path ) - 1 );
+    memcpy( t_addr->sun_path + 1, t_name, l_len );
+    return offsetof( sockaddr_un, sun_path ) + 1 + l_len;
+}
+
+// Create server socket, returns -1 and EADDRINUSE when other process serves name.
+static inline int fdpass_listen( const char *t_name )
+{
+    sockaddr_un l_addr;
+    socklen_t l_len = fdpass_addr( &l_addr, t_name );
+
+    int l_sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( l_sock < 0 ) return -1;
+
+    if ( bind( l_sock, ( sockaddr * ) &l_addr, l_len ) < 0 || listen( l_sock, SOMAXCONN ) < 0 )
+    {
+        int l_err = errno;
+        close( l_sock );
+        errno = l_err;
+        return -1;
+    }
+    return l_sock;
+}
+
+static inline int fdpass_send( int t_sock, int t_fd )
+{
+    char l_byte = 0;
+    iovec l_iov = { &l_byte, 1 };
+    char l_ctrl[ CMSG_SPACE( sizeof( int ) ) ];
+    bzero( l_ctrl, sizeof( l_ctrl ) );
+
+    msghdr l_msg;
+    bzero( &l_msg, sizeof( l_msg ) );
+    l_msg.msg_iov = &l_iov;
+    l_msg.msg_iovlen = 1;
+    l_msg.msg_control = l_ctrl;
+    l_msg.msg_controllen = sizeof( l_ctrl );
+
+    cmsghdr *l_cmsg = CMSG_FIRSTHDR( &l_msg );
+    l_cmsg->cmsg_level = SOL_SOCKET;
+    l_cmsg->cmsg_type = SCM_RIGHTS;
+    l_cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+    memcpy( CMSG_DATA( l_cmsg ), &t_fd, sizeof( int ) );
+
+    return sendmsg( t_sock, &l_msg, MSG_NOSIGNAL ) == 1 ? 0 : -1;
+}
+
+// returns received descriptor or -1
+static inline int fdpass_recv( int t_sock )
+{
+    char l_byte;
+    iovec l_iov = { &l_byte, 1 };
+    char l_ctrl[ CMSG_SPACE( sizeof( int ) ) ];
+
+    msghdr l_msg;
+    bzero( &l_msg, sizeof( l_msg ) );
+    l_msg.msg_iov = &l_iov;
+    l_msg.msg_iovlen = 1;
+    l_msg.msg_control = l_ctrl;
+    l_msg.msg_controllen = sizeof( l_ctrl );
+
+    if ( recvmsg( t_sock, &l_msg, MSG_CMSG_CLOEXEC ) != 1 ) return -1;
+
+    cmsghdr *l_cmsg = CMSG_FIRSTHDR( &l_msg );
+    if ( !l_cmsg || l_cmsg->cmsg_level != SOL_SOCKET || l_cmsg->cmsg_type != SCM_RIGHTS )
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    int l_fd;
+    memcpy( &l_fd, CMSG_DATA( l_cmsg ), sizeof( int ) );
+    return l_fd;
+}
+
+// accept one client and send it descriptor
+static inline int fdpass_serve( int t_listen, int t_fd )
+{
+    int l_sock = accept4( t_listen, nullptr, nullptr, SOCK_CLOEXEC );
+    if ( l_sock < 0 ) return -1;
+
+    int l_ret = fdpass_send( l_sock, t_fd );
+    close( l_sock );
+    return l_ret;
+}
+
+// connect to server t_name and get descriptor, returns -1 when nobody serves
+static inline int fdpass_get( const char *t_name )
+{
+    sockaddr_un l_addr;
+    socklen_t l_len = fdpass_addr( &l_addr, t_name );
+
+    int l_sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( l_sock < 0 ) return -1;
+
+    int l_fd = -1;
+    if ( !connect( l_sock, ( sockaddr * ) &l_addr, l_len ) )
+        l_fd = fdpass_recv( l_sock );
+
+    int l_err = errno;
+    close( l_sock );
+    errno = l_err;
+    return l_fd;
+}
+
+#endif // __SHM_FDPASS_H
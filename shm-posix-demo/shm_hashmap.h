@@ -0,0 +1,269 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Fixed capacity hash map (cache) in shared memory.
+//
+// Key is hashed to set of SLOTS_PER_SET slots and it is searched only
+// in this set (open addressing with bounded probing). Readers do not
+// lock, every slot has its own sequence (seqlock) and reader repeats
+// copy of slot when writer changed it meanwhile. Writers lock set
+// by striped spin locks. When set is full or number of items reached
+// limit, victim is selected by CLOCK algorithm (reference bits).
+//
+// Key 0 is reserved for empty slot, it is rejected by all operations.
+//
+//***************************************************************************
+
+#ifndef __SHM_HASHMAP_H
+#define __SHM_HASHMAP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define SLOTS_PER_SET           8
+#define HASHMAP_LOCKS           1024
+
+struct hashmap_slot
+{
+    std::atomic<uint32_t> seq;                  // odd during update
+    std::atomic<uint8_t> ref;                   // used since last CLOCK pass
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> words[ 0 ];           // value
+};
+
+struct shm_hashmap
+{
+    uint32_t sets;                              // number of sets (power of 2)
+    uint32_t value_size;
+    uint32_t stride;                            // size of slot in bytes
+    uint64_t max_items;
+
+    alignas( CACHE_LINE ) std::atomic<uint64_t> items;
+    std::atomic<uint64_t> evictions;
+
+    alignas( CACHE_LINE ) std::atomic<int> locks[ HASHMAP_LOCKS ];
+    alignas( CACHE_LINE ) char slots[ 0 ];      // sets are followed by clock hands
+};
+
+static inline uint32_t hashmap_stride( uint32_t t_value_size )
+{
+    return sizeof( hashmap_slot ) + ( ( t_value_size + 7 ) & ~7u );
+}
+
+// bytes required for map
+static inline size_t shm_hashmap_bytes( uint32_t t_sets, uint32_t t_value_size )
+{
+    return sizeof( shm_hashmap ) + ( size_t ) t_sets * SLOTS_PER_SET * hashmap_stride( t_value_size )
+           + t_sets * sizeof( std::atomic<uint8_t> );
+}
+
+static inline uint64_t hashmap_hash( uint64_t t_key )
+{
+    t_key ^= t_key >> 30;
+    t_key *= 0xbf58476d1ce4e5b9ULL;
+    t_key ^= t_key >> 27;
+    t_key *= 0x94d049bb133111ebULL;
+    return t_key ^ ( t_key >> 31 );
+}
+
+static inline hashmap_slot *hashmap_get_slot( shm_hashmap *t_map, uint32_t t_set, int t_way )
+{
+    return ( hashmap_slot * ) ( t_map->slots + ( ( size_t ) t_set * SLOTS_PER_SET + t_way ) * t_map->stride );
+}
+
+static inline std::atomic<uint8_t> *hashmap_hand( shm_hashmap *t_map, uint32_t t_set )
+{
+    return ( std::atomic<uint8_t> * ) ( t_map->slots + ( size_t ) t_map->sets * SLOTS_PER_SET * t_map->stride ) + t_set;
+}
+
+// initialization by the first process, t_sets must be power of 2
+static inline void shm_hashmap_init( shm_hashmap *t_map, uint32_t t_sets, uint32_t t_value_size, uint64_t t_max_items )
+{
+    t_map->sets = t_sets;
+    t_map->value_size = t_value_size;
+    t_map->stride = hashmap_stride( t_value_size );
+    t_map->max_items = t_max_items && t_max_items < ( uint64_t ) t_sets * SLOTS_PER_SET ? t_max_items : ( uint64_t ) t_sets * SLOTS_PER_SET;
+    t_map->items.store( 0 );
+    t_map->evictions.store( 0 );
+    for ( int i = 0; i < HASHMAP_LOCKS; i++ )
+        t_map->locks[ i ].store( 0 );
+    memset( t_map->slots, 0, shm_hashmap_bytes( t_sets, t_value_size ) - sizeof( shm_hashmap ) );
+    std::atomic_thread_fence( std::memory_order_release );
+}
+
+static inline void hashmap_lock( shm_hashmap *t_map, uint32_t t_set )
+{
+    std::atomic<int> &l_lock = t_map->locks[ t_set % HASHMAP_LOCKS ];
+    int l_spin = 0;
+    while ( l_lock.exchange( 1, std::memory_order_acquire ) )
+    {
+        while ( l_lock.load( std::memory_order_relaxed ) )
+            if ( ++l_spin % 64 ) cpu_relax(); else sched_yield();
+    }
+}
+
+static inline void hashmap_unlock( shm_hashmap *t_map, uint32_t t_set )
+{
+    t_map->locks[ t_set % HASHMAP_LOCKS ].store( 0, std::memory_order_release );
+}
+
+// write key and value into slot, set lock must be held
+static inline void hashmap_write_slot( shm_hashmap *t_map, hashmap_slot *t_slot, uint64_t t_key, const void *t_value )
+{
+    uint32_t l_seq = t_slot->seq.load( std::memory_order_relaxed );
+    t_slot->seq.store( l_seq + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    t_slot->key.store( t_key, std::memory_order_relaxed );
+    for ( uint32_t i = 0; t_value && i * 8 < t_map->value_size; i++ )
+    {
+        uint64_t l_word = 0;
+        memcpy( &l_word, ( const char * ) t_value + i * 8, t_map->value_size - i * 8 < 8 ? t_map->value_size - i * 8 : 8 );
+        t_slot->words[ i ].store( l_word, std::memory_order_relaxed );
+    }
+
+    t_slot->seq.store( l_seq + 2, std::memory_order_release );
+}
+
+// Lock-free lookup, returns 1 and copies value when key was found.
+// Content of t_value is undefined when key is not found.
+static inline int shm_hashmap_get( shm_hashmap *t_map, uint64_t t_key, void *t_value )
+{
+    if ( !t_key ) return 0;
+
+    uint32_t l_set = hashmap_hash( t_key ) & ( t_map->sets - 1 );
+
+    for ( int w = 0; w < SLOTS_PER_SET; w++ )
+    {
+        hashmap_slot *l_slot = hashmap_get_slot( t_map, l_set, w );
+        for ( int l_retry = 1; ; l_retry++ )
+        {
+            uint32_t l_seq = l_slot->seq.load( std::memory_order_acquire );
+            if ( !( l_seq & 1 ) )
+            {
+                if ( l_slot->key.load( std::memory_order_relaxed ) != t_key ) break;
+
+                for ( uint32_t i = 0; i * 8 < t_map->value_size; i++ )
+                {
+                    uint64_t l_word = l_slot->words[ i ].load( std::memory_order_relaxed );
+                    memcpy( ( char * ) t_value + i * 8, &l_word, t_map->value_size - i * 8 < 8 ? t_map->value_size - i * 8 : 8 );
+                }
+
+                std::atomic_thread_fence( std::memory_order_acquire );
+                if ( l_slot->seq.load( std::memory_order_relaxed ) == l_seq )
+                {
+                    // reference bit is written only when it is not set, cache line stays shared
+                    if ( !l_slot->ref.load( std::memory_order_relaxed ) )
+                        l_slot->ref.store( 1, std::memory_order_relaxed );
+                    return 1;
+                }
+            }
+
+            // writer can be preempted in the middle of update
+            if ( l_retry % 64 ) cpu_relax(); else sched_yield();
+        }
+    }
+    return 0;
+}
+
+// Insert or update key, old item is evicted when necessary.
+// Returns -1 (errno EINVAL) for key 0, otherwise 0.
+static inline int shm_hashmap_put( shm_hashmap *t_map, uint64_t t_key, const void *t_value )
+{
+    if ( !t_key )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    uint32_t l_set = hashmap_hash( t_key ) & ( t_map->sets - 1 );
+    hashmap_lock( t_map, l_set );
+
+    hashmap_slot *l_empty = nullptr;
+    for ( int w = 0; w < SLOTS_PER_SET; w++ )
+    {
+        hashmap_slot *l_slot = hashmap_get_slot( t_map, l_set, w );
+        uint64_t l_key = l_slot->key.load( std::memory_order_relaxed );
+        if ( l_key == t_key )
+        {
+            hashmap_write_slot( t_map, l_slot, t_key, t_value );
+            hashmap_unlock( t_map, l_set );
+            return 0;
+        }
+        if ( !l_key && !l_empty ) l_empty = l_slot;
+    }
+
+    if ( l_empty && t_map->items.load( std::memory_order_relaxed ) < t_map->max_items )
+    {
+        t_map->items.fetch_add( 1, std::memory_order_relaxed );
+        hashmap_write_slot( t_map, l_empty, t_key, t_value );
+        hashmap_unlock( t_map, l_set );
+        return 0;
+    }
+
+    // CLOCK: skip and clear recently used slots
+    std::atomic<uint8_t> *l_hand = hashmap_hand( t_map, l_set );
+    hashmap_slot *l_victim = nullptr;
+    for ( int i = 0; i < 2 * SLOTS_PER_SET && !l_victim; i++ )
+    {
+        int l_way = l_hand->load( std::memory_order_relaxed ) % SLOTS_PER_SET;
+        l_hand->store( l_way + 1, std::memory_order_relaxed );
+        hashmap_slot *l_slot = hashmap_get_slot( t_map, l_set, l_way );
+
+        if ( !l_slot->key.load( std::memory_order_relaxed ) ) continue;
+        if ( l_slot->ref.load( std::memory_order_relaxed ) )
+            l_slot->ref.store( 0, std::memory_order_relaxed );
+        else
+            l_victim = l_slot;
+    }
+
+    if ( l_victim )
+    {
+        t_map->evictions.fetch_add( 1, std::memory_order_relaxed );
+        l_victim->ref.store( 0, std::memory_order_relaxed );
+        hashmap_write_slot( t_map, l_victim, t_key, t_value );
+    }
+    else if ( l_empty )
+    {
+        // limit reached, but this set is empty, item goes over limit
+        t_map->items.fetch_add( 1, std::memory_order_relaxed );
+        hashmap_write_slot( t_map, l_empty, t_key, t_value );
+    }
+
+    hashmap_unlock( t_map, l_set );
+    return 0;
+}
+
+// remove key, returns 1 when key was found
+static inline int shm_hashmap_erase( shm_hashmap *t_map, uint64_t t_key )
+{
+    if ( !t_key ) return 0;
+
+    uint32_t l_set = hashmap_hash( t_key ) & ( t_map->sets - 1 );
+    hashmap_lock( t_map, l_set );
+
+    int l_found = 0;
+    for ( int w = 0; w < SLOTS_PER_SET && !l_found; w++ )
+    {
+        hashmap_slot *l_slot = hashmap_get_slot( t_map, l_set, w );
+        if ( l_slot->key.load( std::memory_order_relaxed ) != t_key ) continue;
+
+        hashmap_write_slot( t_map, l_slot, 0, nullptr );
+        l_slot->ref.store( 0, std::memory_order_relaxed );
+        t_map->items.fetch_sub( 1, std::memory_order_relaxed );
+        l_found = 1;
+    }
+
+    hashmap_unlock( t_map, l_set );
+    return l_found;
+}
+
+#endif // __SHM_HASHMAP_H
@@ -0,0 +1,291 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Example of hash map cache shared by processes.
+//
+// The first process creates and fills cache in shared memory.
+// Worker processes look up random keys, missing keys are inserted
+// (with eviction), some percentage of lookups is replaced by updates.
+// Every value is derived from its key, so torn reads are detected.
+// Test is repeated for 1, 2, 4 ... N processes.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "shm_hashmap.h"
+
+#define SHM_NAME        "/shm_hashmap"
+#define VALUE_WORDS     8
+
+// data structure for shared memory
+struct shm_data
+{
+    std::atomic<int> stop;
+    std::atomic<long> lookups;
+    std::atomic<long> hits;
+    std::atomic<long> torn;
+    shm_hashmap map;                            // must be last
+};
+
+// parameters of test
+int g_max_proc = 32;
+int g_seconds = 2;
+int g_write_pct = 1;
+uint32_t g_items = 1 << 20;
+uint32_t g_keys = 1 << 21;
+
+size_t g_shm_size = 0;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Hash map cache in shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-t seconds] [-w write_pct] [-n capacity] [-k keys]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  max. number of processes (default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "    -w  percentage of updates (default %d)\n"
+        "    -n  capacity of cache in items (default %u)\n"
+        "    -k  number of different keys (default %u)\n"
+        "\n", t_name, g_max_proc, g_seconds, g_write_pct, g_items, g_keys );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void make_value( uint64_t t_key, uint64_t *t_value )
+{
+    for ( int i = 0; i < VALUE_WORDS; i++ )
+        t_value[ i ] = t_key * ( i + 1 );
+}
+
+void worker( shm_data *t_data )
+{
+    uint64_t l_value[ VALUE_WORDS ];
+    long l_lookups = 0, l_hits = 0, l_torn = 0;
+    unsigned int l_seed = getpid();
+
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        uint64_t l_key = 1 + rand_r( &l_seed ) % g_keys;
+
+        if ( ( int ) ( rand_r( &l_seed ) % 100 ) < g_write_pct )
+        {
+            make_value( l_key, l_value );
+            shm_hashmap_put( &t_data->map, l_key, l_value );
+            continue;
+        }
+
+        l_lookups++;
+        if ( shm_hashmap_get( &t_data->map, l_key, l_value ) )
+        {
+            l_hits++;
+            for ( int i = 0; i < VALUE_WORDS; i++ )
+                if ( l_value[ i ] != l_key * ( i + 1 ) )
+                {
+                    l_torn++;
+                    break;
+                }
+        }
+        else
+        {
+            // cache miss, value is "computed" and stored for others
+            make_value( l_key, l_value );
+            shm_hashmap_put( &t_data->map, l_key, l_value );
+        }
+    }
+
+    t_data->lookups += l_lookups;
+    t_data->hits += l_hits;
+    t_data->torn += l_torn;
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_nproc )
+{
+    t_data->stop = 0;
+    t_data->lookups = 0;
+    t_data->hits = 0;
+    t_data->torn = 0;
+    t_data->map.evictions = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i < t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            worker( t_data );
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i < t_nproc; i++ )
+        wait( nullptr );
+
+    long l_lookups = t_data->lookups;
+    printf( "%3d processes  %12.0f lookups/s  hit rate %5.1f %%  torn %ld  evictions %lu  shared %zu MB  private copies %zu MB\n",
+            t_nproc, ( double ) l_lookups / g_seconds, l_lookups ? 100.0 * t_data->hits / l_lookups : 0.0,
+            t_data->torn.load(), ( unsigned long ) t_data->map.evictions.load(),
+            g_shm_size >> 20, ( g_shm_size * t_nproc ) >> 20 );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-w" ) ) g_write_pct = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_items = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-k" ) ) g_keys = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_seconds <= 0 || g_write_pct < 0 || g_write_pct > 100 || !g_items || !g_keys )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    // sets for capacity with 25 % reserve, power of 2
+    uint32_t l_sets = 1;
+    while ( ( uint64_t ) l_sets * SLOTS_PER_SET * 3 < ( uint64_t ) g_items * 4 )
+        l_sets *= 2;
+
+    g_shm_size = sizeof( shm_data ) + shm_hashmap_bytes( l_sets, VALUE_WORDS * sizeof( uint64_t ) );
+
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory." );
+        exit( 1 );
+    }
+    if ( ftruncate( l_fd, g_shm_size ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, g_shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+
+    shm_hashmap_init( &l_data->map, l_sets, VALUE_WORDS * sizeof( uint64_t ), g_items );
+
+    uint64_t l_value[ VALUE_WORDS ];
+    for ( uint64_t l_key = 1; l_key <= g_items && l_key <= g_keys; l_key++ )
+    {
+        make_value( l_key, l_value );
+        shm_hashmap_put( &l_data->map, l_key, l_value );
+    }
+    log_msg( LOG_INFO, "Cache filled with %lu items, %u sets, %zu MB.",
+            ( unsigned long ) l_data->map.items.load(), l_sets, g_shm_size >> 20 );
+
+    // key 0 marks empty slot, it must not be stored or found
+    uint64_t l_items = l_data->map.items.load();
+    make_value( 0, l_value );
+    if ( shm_hashmap_put( &l_data->map, 0, l_value ) != -1 || shm_hashmap_get( &l_data->map, 0, l_value ) ||
+         shm_hashmap_erase( &l_data->map, 0 ) || l_data->map.items.load() != l_items )
+    {
+        log_msg( LOG_INFO, "Key 0 was not rejected!" );
+        munmap( l_data, g_shm_size );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+    log_msg( LOG_DEBUG, "Key 0 is rejected." );
+
+    for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+        run_test( l_data, l_nproc );
+
+    munmap( l_data, g_shm_size );
+    shm_unlink( SHM_NAME );
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Shared memory with 4 KB and 2 MB pages.
+//
+// Segment of given size is created with selected backing and it is
+// pre-faulted. Random reads over the whole segment are sensitive
+// to TLB misses, so throughput shows difference between page sizes.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include "shm_segment.h"
+#include "futex.h"
+
+#define SHM_NAME        "/shm_hugepage"
+
+// parameters of test
+size_t g_size = 1UL << 30;
+long g_accesses = 20000000;
+int g_numa = SEG_NUMA_DEFAULT;
+unsigned long g_nodes = 1;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Random access to shared memory with 4 KB and 2 MB pages.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-s size] [-n accesses] [-i | -b] [-m nodemask]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -s  size of segment, suffix K, M, G allowed (default 1G)\n"
+        "    -n  number of random accesses (default %ld)\n"
+        "    -i  NUMA interleave over nodes in mask\n"
+        "    -b  NUMA bind to nodes in mask\n"
+        "    -m  NUMA node mask (default 0x1)\n"
+        "\n"
+        "  Huge pages must be reserved, e.g. 'echo 600 > /proc/sys/vm/nr_hugepages'\n"
+        "  and hugetlbfs mounted in " SEG_HUGETLBFS_DIR ".\n"
+        "\n", t_name, g_accesses );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void run_test( const char *t_desc, int t_type, int t_flags )
+{
+    shm_segment l_seg;
+
+    long long l_start = time_ns();
+    if ( shm_segment_create( &l_seg, SHM_NAME, g_size, t_type, t_flags | SEG_POPULATE, g_numa, g_nodes ) < 0 )
+    {
+        log_msg( LOG_ERROR, "%-26s unable to create segment.", t_desc );
+        return;
+    }
+    double l_setup = ( time_ns() - l_start ) / 1e6;
+
+    // random reads, every address depends on previous value,
+    // so CPU can not hide latency of TLB misses
+    uint64_t *l_data = ( uint64_t * ) l_seg.addr;
+    uint64_t l_words = l_seg.size / sizeof( uint64_t );
+    uint64_t l_rnd = 88172645463325252ULL, l_sum = 0;
+
+    l_start = time_ns();
+    for ( long i = 0; i < g_accesses; i++ )
+    {
+        l_rnd ^= l_rnd << 13;
+        l_rnd ^= l_rnd >> 7;
+        l_rnd ^= l_rnd << 17;
+        l_sum += l_data[ ( l_rnd + l_sum ) % l_words ];
+    }
+    double l_sec = ( time_ns() - l_start ) / 1e9;
+
+    printf( "%-26s size %6zu MB  setup %8.1f ms  %12.0f access/s  %6.1f ns/access\n",
+            t_desc, l_seg.size >> 20, l_setup, g_accesses / l_sec, l_sec * 1e9 / g_accesses );
+    log_msg( LOG_DEBUG, "Checksum %llu.", ( unsigned long long ) l_sum );
+
+    shm_segment_close( &l_seg, 1 );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            unlink( SEG_HUGETLBFS_DIR SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( !strcmp( t_args[ i ], "-i" ) )
+            g_numa = SEG_NUMA_INTERLEAVE;
+
+        if ( !strcmp( t_args[ i ], "-b" ) )
+            g_numa = SEG_NUMA_BIND;
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-s" ) ) g_size = seg_parse_size( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_accesses = atol( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-m" ) ) g_nodes = strtoul( t_args[ ++i ], nullptr, 0 );
+        }
+    }
+
+    if ( g_size < 4096 || g_accesses <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    run_test( "shm_open 4 KB", SEG_SHM, 0 );
+    run_test( "shm_open THP (madvise)", SEG_SHM, SEG_THP );
+    run_test( "memfd 4 KB", SEG_MEMFD, 0 );
+    run_test( "memfd MFD_HUGETLB 2 MB", SEG_MEMFD_HUGE, 0 );
+    run_test( "hugetlbfs 2 MB", SEG_HUGETLBFS, 0 );
+
+    return 0;
+}
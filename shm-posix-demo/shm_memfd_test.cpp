@@ -0,0 +1,235 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Attaching of named shared memory versus memfd passed by descriptor.
+//
+// Parent creates segment and starts N processes, every process
+// attaches segment by itself (inherited mapping is not used):
+// by shm_open() and mmap(), or by connecting to parent over Unix
+// socket, receiving memfd descriptor (SCM_RIGHTS) and mmap().
+// Time of attach in every process and total time for all processes
+// are reported.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <atomic>
+
+#include "futex.h"
+#include "shm_segment.h"
+#include "shm_fdpass.h"
+
+#define SHM_NAME        "/shm_memfd"
+#define FDPASS_NAME     "shm_memfd_test"
+
+// data structure at start of segment
+struct shm_data
+{
+    std::atomic<int> attached;
+    std::atomic<long long> attach_sum;
+    std::atomic<long long> attach_max;
+};
+
+// parameters of test
+int g_procs = 100;
+size_t g_size = 64UL << 20;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Attaching of shm_open() segment versus memfd passed over socket.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p processes] [-s size]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  number of attaching processes (default %d)\n"
+        "    -s  size of segment, suffix K, M, G (default %zu MB)\n"
+        "\n", t_name, g_procs, g_size >> 20 );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void child( int t_memfd, int t_inherited_fd )
+{
+    // only own attach is measured
+    close( t_inherited_fd );
+
+    long long l_start = time_ns();
+    shm_segment l_seg;
+    int l_ret;
+
+    if ( t_memfd )
+    {
+        int l_fd = fdpass_get( FDPASS_NAME );
+        l_ret = l_fd < 0 ? -1 : shm_segment_attach_fd( &l_seg, l_fd );
+    }
+    else
+        l_ret = shm_segment_attach( &l_seg, SHM_NAME, SEG_SHM );
+
+    if ( l_ret < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) l_seg.addr;
+    l_data->attached++;
+    long long l_time = time_ns() - l_start;
+
+    l_data->attach_sum += l_time;
+    long long l_max = l_data->attach_max;
+    while ( l_time > l_max && !l_data->attach_max.compare_exchange_weak( l_max, l_time ) );
+
+    shm_segment_close( &l_seg );
+    exit( 0 );
+}
+
+void run_test( int t_memfd )
+{
+    shm_segment l_seg;
+    int l_listen = -1;
+    long long l_start = time_ns();
+
+    int l_ret = shm_segment_create( &l_seg, t_memfd ? FDPASS_NAME : SHM_NAME, g_size, t_memfd ? SEG_MEMFD : SEG_SHM );
+    if ( !l_ret && t_memfd )
+    {
+        l_ret = shm_segment_seal( &l_seg );
+        if ( !l_ret ) l_listen = fdpass_listen( FDPASS_NAME );
+        if ( l_listen < 0 ) l_ret = -1;
+    }
+    if ( l_ret < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create shared memory!" );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) l_seg.addr;
+    l_data->attached = 0;
+    l_data->attach_sum = 0;
+    l_data->attach_max = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i < g_procs; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            child( t_memfd, l_seg.fd );
+    }
+
+    // every process gets descriptor by its own connection
+    for ( int i = 0; t_memfd && i < g_procs; i++ )
+        if ( fdpass_serve( l_listen, l_seg.fd ) < 0 )
+            log_msg( LOG_ERROR, "Unable to pass descriptor!" );
+
+    for ( int i = 0; i < g_procs; i++ )
+        wait( nullptr );
+    double l_total = ( time_ns() - l_start ) / 1e6;
+
+    int l_attached = l_data->attached;
+    printf( "%-16s %4d processes attached  avg %8.1f us  max %8.1f us  total with fork %8.1f ms\n",
+            t_memfd ? "memfd+SCM_RIGHTS" : "shm_open", l_attached,
+            l_attached ? l_data->attach_sum / 1e3 / l_attached : 0.0, l_data->attach_max / 1e3, l_total );
+
+    if ( l_listen >= 0 ) close( l_listen );
+    shm_segment_close( &l_seg, 1 );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_procs = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_size = seg_parse_size( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_procs <= 0 || g_size < sizeof( shm_data ) )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    run_test( 0 );
+    run_test( 1 );
+
+    return 0;
+}
@@ -0,0 +1,185 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Bounded multi-producer/multi-consumer queue in shared memory.
+//
+// Queue is array of slots with sequence numbers (D. Vyukov's algorithm).
+// Slot with sequence equal to position is free for producer,
+// slot with sequence equal to position + 1 is full for consumer.
+// Producers and consumers claim positions by CAS on enqueue/dequeue
+// index, so any number of processes can use queue without lock.
+//
+//***************************************************************************
+
+#ifndef __SHM_MPMC_H
+#define __SHM_MPMC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+struct mpmc_slot
+{
+    std::atomic<uint64_t> seq;
+    uint32_t len;
+    char data[ 0 ];
+};
+
+struct shm_mpmc
+{
+    uint32_t capacity;                          // number of slots (power of 2)
+    uint32_t slot_size;                         // max. size of one item
+    uint32_t stride;                            // distance of slots in bytes
+
+    alignas( CACHE_LINE ) std::atomic<uint64_t> enq_pos;
+    alignas( CACHE_LINE ) std::atomic<uint64_t> deq_pos;
+
+    alignas( CACHE_LINE ) char slots[ 0 ];
+};
+
+static inline uint32_t mpmc_stride( uint32_t t_slot_size )
+{
+    return ( sizeof( mpmc_slot ) + t_slot_size + 7 ) & ~7u;
+}
+
+// bytes required for queue
+static inline size_t shm_mpmc_bytes( uint32_t t_capacity, uint32_t t_slot_size )
+{
+    return sizeof( shm_mpmc ) + ( size_t ) t_capacity * mpmc_stride( t_slot_size );
+}
+
+static inline mpmc_slot *mpmc_get_slot( shm_mpmc *t_q, uint64_t t_pos )
+{
+    return ( mpmc_slot * ) ( t_q->slots + ( t_pos & ( t_q->capacity - 1 ) ) * t_q->stride );
+}
+
+// initialization by the first process, t_capacity must be power of 2
+static inline void shm_mpmc_init( shm_mpmc *t_q, uint32_t t_capacity, uint32_t t_slot_size )
+{
+    t_q->capacity = t_capacity;
+    t_q->slot_size = t_slot_size;
+    t_q->stride = mpmc_stride( t_slot_size );
+    t_q->enq_pos.store( 0 );
+    t_q->deq_pos.store( 0 );
+    for ( uint32_t i = 0; i < t_capacity; i++ )
+        mpmc_get_slot( t_q, i )->seq.store( i, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+}
+
+// Claim up to t_max consecutive positions. t_ready is sequence difference
+// of free slot: 0 for producer, 1 for consumer.
+// Returns number of claimed positions, first one is stored in t_first.
+static inline int mpmc_claim( shm_mpmc *t_q, std::atomic<uint64_t> *t_index, int t_ready, int t_max, uint64_t *t_first )
+{
+    uint64_t l_pos = t_index->load( std::memory_order_relaxed );
+    while ( 1 )
+    {
+        // slots ready for this lap can not be taken by anyone else
+        // without moving index, so the check stays valid when CAS succeeds
+        int l_cnt = 0;
+        while ( l_cnt < t_max &&
+                mpmc_get_slot( t_q, l_pos + l_cnt )->seq.load( std::memory_order_acquire ) == l_pos + l_cnt + t_ready )
+            l_cnt++;
+
+        if ( !l_cnt )
+        {
+            int64_t l_diff = mpmc_get_slot( t_q, l_pos )->seq.load( std::memory_order_acquire ) - ( l_pos + t_ready );
+            if ( l_diff < 0 ) return 0;     // queue is full or empty
+            l_pos = t_index->load( std::memory_order_relaxed );
+            continue;
+        }
+
+        if ( t_index->compare_exchange_weak( l_pos, l_pos + l_cnt, std::memory_order_relaxed ) )
+        {
+            *t_first = l_pos;
+            return l_cnt;
+        }
+    }
+}
+
+// Store up to t_num items of size t_item_size from array t_items.
+// Returns number of stored items, 0 when queue is full, -1 (errno EMSGSIZE)
+// when t_item_size exceeds slot_size.
+static inline int shm_mpmc_enqueue_batch( shm_mpmc *t_q, const void *t_items, uint32_t t_item_size, int t_num )
+{
+    if ( t_item_size > t_q->slot_size )
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    uint64_t l_pos;
+    int l_cnt = mpmc_claim( t_q, &t_q->enq_pos, 0, t_num, &l_pos );
+
+    for ( int i = 0; i < l_cnt; i++ )
+    {
+        mpmc_slot *l_slot = mpmc_get_slot( t_q, l_pos + i );
+        l_slot->len = t_item_size;
+        memcpy( l_slot->data, ( const char * ) t_items + i * t_item_size, t_item_size );
+        l_slot->seq.store( l_pos + i + 1, std::memory_order_release );
+    }
+    return l_cnt;
+}
+
+// Read up to t_num items of size t_item_size into t_items.
+// Returns number of items, 0 when queue is empty.
+static inline int shm_mpmc_dequeue_batch( shm_mpmc *t_q, void *t_items, uint32_t t_item_size, int t_num )
+{
+    uint64_t l_pos;
+    int l_cnt = mpmc_claim( t_q, &t_q->deq_pos, 1, t_num, &l_pos );
+
+    for ( int i = 0; i < l_cnt; i++ )
+    {
+        mpmc_slot *l_slot = mpmc_get_slot( t_q, l_pos + i );
+        memcpy( ( char * ) t_items + i * t_item_size, l_slot->data, l_slot->len < t_item_size ? l_slot->len : t_item_size );
+        // slot is free for producer in the next lap
+        l_slot->seq.store( l_pos + i + t_q->capacity, std::memory_order_release );
+    }
+    return l_cnt;
+}
+
+// single items, too long item is not stored and -1 is returned
+
+static inline int shm_mpmc_try_enqueue( shm_mpmc *t_q, const void *t_data, uint32_t t_len )
+{
+    return shm_mpmc_enqueue_batch( t_q, t_data, t_len, 1 );
+}
+
+static inline int shm_mpmc_try_dequeue( shm_mpmc *t_q, void *t_buf, uint32_t t_size )
+{
+    uint64_t l_pos;
+    if ( !mpmc_claim( t_q, &t_q->deq_pos, 1, 1, &l_pos ) ) return -1;
+
+    mpmc_slot *l_slot = mpmc_get_slot( t_q, l_pos );
+    int l_len = l_slot->len;
+    memcpy( t_buf, l_slot->data, l_slot->len < t_size ? l_slot->len : t_size );
+    l_slot->seq.store( l_pos + t_q->capacity, std::memory_order_release );
+    return l_len;
+}
+
+// blocking variants, queue itself has no waiting, CPU is released by sched_yield()
+
+static inline int shm_mpmc_enqueue( shm_mpmc *t_q, const void *t_data, uint32_t t_len )
+{
+    int l_ret;
+    while ( !( l_ret = shm_mpmc_try_enqueue( t_q, t_data, t_len ) ) )
+        sched_yield();
+    return l_ret < 0 ? -1 : 0;
+}
+
+static inline int shm_mpmc_dequeue( shm_mpmc *t_q, void *t_buf, uint32_t t_size )
+{
+    int l_len;
+    while ( ( l_len = shm_mpmc_try_dequeue( t_q, t_buf, t_size ) ) < 0 )
+        sched_yield();
+    return l_len;
+}
+
+#endif // __SHM_MPMC_H
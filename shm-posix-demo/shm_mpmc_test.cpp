@@ -0,0 +1,313 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Example of MPMC queue in shared memory.
+//
+// Producers and consumers are independent processes, every process
+// attaches shared memory itself (at different address) and number
+// of attached processes is counted in shared memory.
+// Test is repeated for 1, 2, 4 ... N producers and N consumers.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "shm_mpmc.h"
+
+#define SHM_NAME        "/shm_mpmc"
+#define MAX_BATCH       256
+
+struct item
+{
+    uint64_t value;
+    uint64_t producer;
+};
+
+// data structure for shared memory
+struct shm_data
+{
+    std::atomic<int> num_of_process;
+    std::atomic<int> start;
+    alignas( CACHE_LINE ) std::atomic<uint64_t> consumed;
+    std::atomic<uint64_t> sum;
+    shm_mpmc queue;                             // must be last
+};
+
+// parameters of test
+int g_max_proc = 32;
+int g_batch = 1;
+int g_items = 1000000;
+uint32_t g_capacity = 1024;
+
+size_t g_shm_size = 0;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  MPMC queue in shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p max_proc] [-b batch] [-n items] [-c capacity]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  max. number of producers and consumers (default %d)\n"
+        "    -b  size of batch for enqueue/dequeue (default %d, max %d)\n"
+        "    -n  number of items in one test (default %d)\n"
+        "    -c  capacity of queue, power of 2 (default %d)\n"
+        "\n", t_name, g_max_proc, g_batch, MAX_BATCH, g_items, g_capacity );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+shm_data *attach()
+{
+    int l_fd = shm_open( SHM_NAME, O_RDWR, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to open file for shared memory." );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, g_shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        exit( 1 );
+    }
+
+    l_data->num_of_process++;
+    log_msg( LOG_DEBUG, "Process %d attached shared memory at %p.", getpid(), l_data );
+    return l_data;
+}
+
+void producer( int t_id, int t_count )
+{
+    shm_data *l_data = attach();
+    item l_items[ MAX_BATCH ];
+
+    while ( !l_data->start.load( std::memory_order_acquire ) )
+        sched_yield();
+
+    int l_sent = 0;
+    while ( l_sent < t_count )
+    {
+        int l_num = g_batch < t_count - l_sent ? g_batch : t_count - l_sent;
+        for ( int i = 0; i < l_num; i++ )
+        {
+            l_items[ i ].value = l_sent + i + 1;
+            l_items[ i ].producer = t_id;
+        }
+
+        int l_done = 0;
+        while ( l_done < l_num )
+        {
+            int l_ret = shm_mpmc_enqueue_batch( &l_data->queue, l_items + l_done, sizeof( item ), l_num - l_done );
+            if ( l_ret < 0 )
+            {
+                log_msg( LOG_ERROR, "Item does not fit into slot of queue!" );
+                exit( 1 );
+            }
+            if ( !l_ret ) sched_yield();
+            l_done += l_ret;
+        }
+        l_sent += l_num;
+    }
+
+    l_data->num_of_process--;
+    exit( 0 );
+}
+
+void consumer( uint64_t t_total )
+{
+    shm_data *l_data = attach();
+    item l_items[ MAX_BATCH ];
+    uint64_t l_sum = 0;
+
+    while ( !l_data->start.load( std::memory_order_acquire ) )
+        sched_yield();
+
+    while ( l_data->consumed.load( std::memory_order_relaxed ) < t_total )
+    {
+        int l_ret = shm_mpmc_dequeue_batch( &l_data->queue, l_items, sizeof( item ), g_batch );
+        if ( !l_ret )
+        {
+            sched_yield();
+            continue;
+        }
+
+        for ( int i = 0; i < l_ret; i++ )
+            l_sum += l_items[ i ].value;
+        l_data->consumed.fetch_add( l_ret, std::memory_order_relaxed );
+    }
+
+    l_data->sum += l_sum;
+    l_data->num_of_process--;
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void run_test( shm_data *t_data, int t_nproc )
+{
+    int l_per_prod = g_items / t_nproc;
+    uint64_t l_total = ( uint64_t ) l_per_prod * t_nproc;
+    uint64_t l_expect = ( uint64_t ) t_nproc * l_per_prod * ( l_per_prod + 1 ) / 2;
+
+    shm_mpmc_init( &t_data->queue, g_capacity, sizeof( item ) );
+    t_data->start = 0;
+    t_data->consumed = 0;
+    t_data->sum = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i < 2 * t_nproc; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+        {
+            if ( i < t_nproc )
+                producer( i, l_per_prod );
+            else
+                consumer( l_total );
+        }
+    }
+
+    // wait for all processes
+    while ( t_data->num_of_process < 2 * t_nproc + 1 )
+        usleep( 1000 );
+
+    long long l_start = time_ns();
+    t_data->start.store( 1, std::memory_order_release );
+
+    for ( int i = 0; i < 2 * t_nproc; i++ )
+        wait( nullptr );
+
+    double l_sec = ( time_ns() - l_start ) / 1e9;
+
+    printf( "%3d producers %3d consumers  batch %3d  %12.0f items/s  %s\n",
+            t_nproc, t_nproc, g_batch, l_total / l_sec,
+            t_data->sum == l_expect ? "checksum OK" : "CHECKSUM ERROR" );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_max_proc = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-b" ) ) g_batch = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_items = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_capacity = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_max_proc <= 0 || g_batch <= 0 || g_batch > MAX_BATCH || g_items <= 0 ||
+         !g_capacity || g_capacity & ( g_capacity - 1 ) )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    g_shm_size = sizeof( shm_data ) + shm_mpmc_bytes( g_capacity, sizeof( item ) );
+
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT | O_EXCL, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory. Use -r to clean it." );
+        exit( 1 );
+    }
+    if ( ftruncate( l_fd, g_shm_size ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+    close( l_fd );
+
+    shm_data *l_data = attach();
+
+    for ( int l_nproc = 1; l_nproc <= g_max_proc; l_nproc *= 2 )
+        run_test( l_data, l_nproc );
+
+    munmap( l_data, g_shm_size );
+    shm_unlink( SHM_NAME );
+
+    return 0;
+}
@@ -0,0 +1,308 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Persistent shared memory backed by regular file.
+//
+// File starts with header page: magic, version and layout of data
+// protected by checksum, number of attached processes, clean flag and
+// bitmap of dirty chunks. Data follows header. Processes mark changed
+// ranges as dirty and persist_sync() writes only dirty chunks to disk.
+// Restarted process maps existing file and checks header, data does
+// not have to be rebuilt (warm start).
+//
+// Attached processes are registered in header (shm_registry.h), so
+// crashed processes are removed and restart after crash is recognized.
+// Check and creation of header is serialized by flock() of lock file
+// <path>.lock, so processes started at once agree on one file. Empty,
+// short or foreign file is replaced.
+//
+//***************************************************************************
+
+#ifndef __SHM_PERSIST_H
+#define __SHM_PERSIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <algorithm>
+#include <atomic>
+
+#include "futex.h"
+#include "shm_segment.h"
+#include "shm_registry.h"
+
+#define PERSIST_MAGIC           0x32545352455053ULL     // "PERST2"
+#define PERSIST_CHUNK           ( 64UL << 10 )
+#define PERSIST_PAGE            4096UL
+
+// result of shm_persist_open()
+#define PERSIST_COLD            0       // new file, data must be built
+#define PERSIST_WARM            1       // data restored after clean close
+#define PERSIST_DIRTY           2       // data restored, previous run was not closed
+#define PERSIST_JOIN            3       // other processes are attached
+
+// Initialization of user data, called with t_state PERSIST_COLD, _WARM
+// or _DIRTY while creation is locked, so joining processes see it done.
+typedef void ( *persist_init_fn )( void *t_data, int t_state );
+
+struct persist_header
+{
+    // layout, protected by checksum
+    uint64_t magic;
+    uint32_t version;                           // version of user data
+    uint32_t hdr_size;                          // data starts at this offset
+    uint64_t data_size;
+    uint64_t chunk_size;
+    uint64_t checksum;
+
+    shm_registry users;                         // attached processes
+    alignas( CACHE_LINE ) std::atomic<int> clean;       // all users closed segment
+    std::atomic<uint64_t> syncs;                // number of persist_sync() calls
+    alignas( CACHE_LINE ) std::atomic<uint64_t> dirty[ 0 ];     // bit per chunk
+};
+
+static inline size_t persist_hdr_bytes( size_t t_data_size )
+{
+    size_t l_words = ( t_data_size / PERSIST_CHUNK + 64 ) / 64;
+    size_t l_size = sizeof( persist_header ) + l_words * sizeof( uint64_t );
+    return ( l_size + PERSIST_PAGE - 1 ) & ~( PERSIST_PAGE - 1 );
+}
+
+// FNV-1a of layout fields
+static inline uint64_t persist_checksum( const persist_header *t_hdr )
+{
+    uint64_t l_hash = 0xcbf29ce484222325ULL;
+    const unsigned char *l_ptr = ( const unsigned char * ) t_hdr;
+    for ( size_t i = 0; i < offsetof( persist_header, checksum ); i++ )
+        l_hash = ( l_hash ^ l_ptr[ i ] ) * 0x100000001b3ULL;
+    return l_hash;
+}
+
+static inline persist_header *persist_hdr( shm_segment *t_seg )
+{
+    return ( persist_header * ) t_seg->addr;
+}
+
+static inline void *persist_data( shm_segment *t_seg )
+{
+    return ( char * ) t_seg->addr + persist_hdr( t_seg )->hdr_size;
+}
+
+static inline int persist_valid( shm_segment *t_seg, size_t t_data_size, uint32_t t_version )
+{
+    persist_header *l_hdr = persist_hdr( t_seg );
+    return t_seg->size >= sizeof( persist_header ) && l_hdr->magic == PERSIST_MAGIC &&
+           l_hdr->checksum == persist_checksum( l_hdr ) && l_hdr->version == t_version &&
+           l_hdr->data_size == t_data_size && l_hdr->chunk_size == PERSIST_CHUNK &&
+           l_hdr->hdr_size == persist_hdr_bytes( t_data_size ) &&
+           t_seg->size == l_hdr->hdr_size + t_data_size;
+}
+
+#define PERSIST_LOCK_LEN        ( 256 + 8 )
+
+// name of lock file t_path.lock
+static inline const char *persist_lock_path( char *t_buf, const char *t_path )
+{
+    snprintf( t_buf, PERSIST_LOCK_LEN, "%s.lock", t_path );
+    return t_buf;
+}
+
+// Lock file t_path.lock, returns its descriptor or -1.
+static inline int persist_lock( const char *t_path )
+{
+    char l_name[ PERSIST_LOCK_LEN ];
+    int l_fd = open( persist_lock_path( l_name, t_path ), O_RDWR | O_CREAT | O_CLOEXEC, 0660 );
+    if ( l_fd < 0 ) return -1;
+    while ( flock( l_fd, LOCK_EX ) < 0 )
+        if ( errno != EINTR )
+        {
+            int l_err = errno;
+            close( l_fd );
+            errno = l_err;
+            return -1;
+        }
+    return l_fd;
+}
+
+// close of descriptor releases lock
+static inline void persist_unlock( int t_fd )
+{
+    int l_err = errno;
+    close( t_fd );
+    errno = l_err;
+}
+
+// Register this process, dead processes are removed first.
+// Returns PERSIST_JOIN when other process is attached.
+static inline int persist_join( persist_header *t_hdr )
+{
+    shm_registry_reclaim( &t_hdr->users, 0 );
+    if ( shm_registry_join( &t_hdr->users ) < 0 )
+    {
+        errno = EUSERS;
+        return -1;
+    }
+    if ( t_hdr->users.members.load() > 1 ) return PERSIST_JOIN;
+
+    int l_clean = t_hdr->clean.exchange( 0 );
+    msync( t_hdr, persist_hdr_bytes( t_hdr->data_size ), MS_SYNC );
+    return l_clean ? PERSIST_WARM : PERSIST_DIRTY;
+}
+
+// Map file t_path with t_data_size bytes of data. File with other
+// version or layout is replaced by new one. Function t_init is called
+// by the first attached process. Returns PERSIST_* or -1.
+static inline int shm_persist_open( shm_segment *t_seg, const char *t_path, size_t t_data_size, uint32_t t_version,
+                                    persist_init_fn t_init = nullptr )
+{
+    int l_lock = persist_lock( t_path );
+    if ( l_lock < 0 ) return -1;
+
+    if ( !shm_segment_attach( t_seg, t_path, SEG_FILE ) )
+    {
+        if ( persist_valid( t_seg, t_data_size, t_version ) )
+        {
+            int l_ret = persist_join( persist_hdr( t_seg ) );
+            if ( l_ret < 0 ) shm_segment_close( t_seg );
+            else if ( l_ret != PERSIST_JOIN && t_init ) t_init( persist_data( t_seg ), l_ret );
+            persist_unlock( l_lock );
+            return l_ret;
+        }
+        shm_segment_close( t_seg, 1 );
+    }
+    else if ( errno == EINVAL )
+        unlink( t_path );               // empty file, creation was not finished
+    else if ( errno != ENOENT )
+    {
+        persist_unlock( l_lock );
+        return -1;
+    }
+
+    size_t l_hdr_size = persist_hdr_bytes( t_data_size );
+    if ( shm_segment_create( t_seg, t_path, l_hdr_size + t_data_size, SEG_FILE ) < 0 )
+    {
+        persist_unlock( l_lock );
+        return -1;
+    }
+
+    persist_header *l_hdr = persist_hdr( t_seg );
+    l_hdr->magic = PERSIST_MAGIC;
+    l_hdr->version = t_version;
+    l_hdr->hdr_size = l_hdr_size;
+    l_hdr->data_size = t_data_size;
+    l_hdr->chunk_size = PERSIST_CHUNK;
+    l_hdr->checksum = persist_checksum( l_hdr );
+    shm_registry_init( &l_hdr->users );
+    shm_registry_join( &l_hdr->users );
+    l_hdr->clean.store( 0 );
+    l_hdr->syncs.store( 0 );
+    msync( l_hdr, l_hdr_size, MS_SYNC );
+    if ( t_init ) t_init( persist_data( t_seg ), PERSIST_COLD );
+
+    persist_unlock( l_lock );
+    return PERSIST_COLD;
+}
+
+// mark range of data as changed
+static inline void persist_mark_dirty( shm_segment *t_seg, size_t t_off, size_t t_len )
+{
+    persist_header *l_hdr = persist_hdr( t_seg );
+    if ( !t_len ) return;
+
+    for ( size_t l_chunk = t_off / PERSIST_CHUNK; l_chunk <= ( t_off + t_len - 1 ) / PERSIST_CHUNK; l_chunk++ )
+    {
+        std::atomic<uint64_t> &l_word = l_hdr->dirty[ l_chunk / 64 ];
+        uint64_t l_bit = 1ULL << ( l_chunk % 64 );
+        // cache line is not written when chunk is already dirty
+        if ( !( l_word.load( std::memory_order_relaxed ) & l_bit ) )
+            l_word.fetch_or( l_bit, std::memory_order_relaxed );
+    }
+}
+
+static inline void persist_mark_ptr( shm_segment *t_seg, const void *t_ptr, size_t t_len )
+{
+    persist_mark_dirty( t_seg, ( const char * ) t_ptr - ( const char * ) persist_data( t_seg ), t_len );
+}
+
+// start (or wait for) write of chunks
+static inline size_t persist_write_chunks( shm_segment *t_seg, size_t t_first, size_t t_count, int t_flags )
+{
+    if ( !t_count ) return 0;
+
+    size_t l_size = persist_hdr( t_seg )->data_size;
+    size_t l_len = std::min( t_count * PERSIST_CHUNK, l_size - t_first * PERSIST_CHUNK );
+    sync_file_range( t_seg->fd, persist_hdr( t_seg )->hdr_size + t_first * PERSIST_CHUNK, l_len, t_flags );
+    return l_len;
+}
+
+// Write dirty chunks to file, neighbouring chunks are written together.
+// Writes of all chunks are started first, so disk gets them at once.
+// With t_wait data are on disk after return (one fdatasync() instead of
+// msync() per chunk). Returns number of bytes in dirty chunks.
+static inline size_t persist_sync( shm_segment *t_seg, int t_wait = 1 )
+{
+    persist_header *l_hdr = persist_hdr( t_seg );
+    size_t l_chunks = ( l_hdr->data_size + PERSIST_CHUNK - 1 ) / PERSIST_CHUNK;
+    size_t l_synced = 0;
+    size_t l_run = 0, l_run_len = 0;
+
+    for ( size_t w = 0; w * 64 < l_chunks; w++ )
+    {
+        if ( !l_hdr->dirty[ w ].load( std::memory_order_relaxed ) ) continue;
+        // chunk changed after exchange is marked again and written next time
+        uint64_t l_bits = l_hdr->dirty[ w ].exchange( 0, std::memory_order_acquire );
+
+        for ( ; l_bits; l_bits &= l_bits - 1 )
+        {
+            size_t l_chunk = w * 64 + __builtin_ctzll( l_bits );
+            if ( l_run_len && l_run + l_run_len == l_chunk )
+            {
+                l_run_len++;
+                continue;
+            }
+            l_synced += persist_write_chunks( t_seg, l_run, l_run_len, SYNC_FILE_RANGE_WRITE );
+            l_run = l_chunk;
+            l_run_len = 1;
+        }
+    }
+    l_synced += persist_write_chunks( t_seg, l_run, l_run_len, SYNC_FILE_RANGE_WRITE );
+
+    if ( t_wait ) fdatasync( t_seg->fd );
+
+    l_hdr->syncs.fetch_add( 1, std::memory_order_relaxed );
+    return l_synced;
+}
+
+// Write dirty data and detach. The last process marks file as clean.
+static inline void shm_persist_close( shm_segment *t_seg )
+{
+    persist_header *l_hdr = persist_hdr( t_seg );
+    persist_sync( t_seg );
+
+    // slot of this process is found by PID
+    int l_lock = persist_lock( t_seg->name );
+    int l_self = getpid();
+    for ( int i = 0; i < REGISTRY_SLOTS; i++ )
+        if ( l_hdr->users.slots[ i ].pid.load() == l_self && !shm_registry_leave( &l_hdr->users, i ) )
+        {
+            l_hdr->clean.store( 1 );
+            msync( l_hdr, persist_hdr_bytes( l_hdr->data_size ), MS_SYNC );
+            break;
+        }
+    if ( l_lock >= 0 ) persist_unlock( l_lock );
+    shm_segment_close( t_seg );
+}
+
+// remove file and its lock file
+static inline void shm_persist_remove( const char *t_path )
+{
+    char l_name[ PERSIST_LOCK_LEN ];
+    unlink( t_path );
+    unlink( persist_lock_path( l_name, t_path ) );
+}
+
+#endif // __SHM_PERSIST_H
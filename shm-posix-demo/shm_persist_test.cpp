@@ -0,0 +1,275 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Cold start versus warm restart of persistent shared memory.
+//
+// Cold start creates file and builds table in it (every item is
+// computed from its index). Warm restart is done by new process,
+// it maps existing file and checks header and sample of items.
+// Warm restart is measured with data in page cache and after pages
+// were dropped from page cache. Incremental sync of dirty chunks
+// is compared with msync() of whole segment.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "shm_persist.h"
+
+#define DATA_VERSION    1
+#define SAMPLES         10000
+
+// parameters of test
+const char *g_path = "shm_persist.dat";
+size_t g_size = 2UL << 30;
+int g_updates = 1000;
+int g_keep = 0;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Cold start versus warm restart of file backed shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -k] [-f file] [-s size] [-u updates]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -k  keep file after test \n"
+        "    -f  backing file (default %s)\n"
+        "    -s  size of data, suffix K, M, G (default %zu MB)\n"
+        "    -u  number of random updates before incremental sync (default %d)\n"
+        "\n", t_name, g_path, g_size >> 20, g_updates );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+double ms_since( long long t_start )
+{
+    return ( time_ns() - t_start ) / 1e6;
+}
+
+// item is "expensive" to compute, table must be built at cold start
+uint64_t make_item( uint64_t t_index )
+{
+    uint64_t l_val = t_index;
+    for ( int i = 0; i < 4; i++ )
+    {
+        l_val ^= l_val >> 31;
+        l_val *= 0x7fb5d329728ea185ULL;
+        l_val ^= l_val >> 27;
+    }
+    return l_val;
+}
+
+int verify_sample( uint64_t *t_table, size_t t_items, unsigned int *t_seed )
+{
+    for ( int i = 0; i < SAMPLES; i++ )
+    {
+        size_t l_index = ( ( size_t ) rand_r( t_seed ) * RAND_MAX + rand_r( t_seed ) ) % t_items;
+        if ( t_table[ l_index ] != make_item( l_index ) )
+            return 0;
+    }
+    return 1;
+}
+
+void cold_start()
+{
+    shm_segment l_seg;
+    long long l_start = time_ns();
+
+    int l_ret = shm_persist_open( &l_seg, g_path, g_size, DATA_VERSION );
+    if ( l_ret != PERSIST_COLD )
+    {
+        log_msg( LOG_ERROR, "Unable to create file %s.", g_path );
+        exit( 1 );
+    }
+    double l_open = ms_since( l_start );
+
+    uint64_t *l_table = ( uint64_t * ) persist_data( &l_seg );
+    size_t l_items = g_size / sizeof( uint64_t );
+    for ( size_t i = 0; i < l_items; i++ )
+        l_table[ i ] = make_item( i );
+    persist_mark_dirty( &l_seg, 0, g_size );
+    double l_build = ms_since( l_start ) - l_open;
+
+    size_t l_synced = persist_sync( &l_seg );
+    double l_total = ms_since( l_start );
+
+    printf( "cold start        %10.1f ms  (open %.1f ms, build %.1f ms, sync %zu MB %.1f ms)\n",
+            l_total, l_open, l_build, l_synced >> 20, l_total - l_open - l_build );
+
+    shm_persist_close( &l_seg );
+}
+
+// new process attaches existing data
+void warm_restart( const char *t_desc, int t_updates )
+{
+    fflush( stdout );
+    int l_pid = fork();
+    if ( l_pid < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+    if ( l_pid > 0 )
+    {
+        waitpid( l_pid, nullptr, 0 );
+        return;
+    }
+
+    shm_segment l_seg;
+    unsigned int l_seed = getpid();
+    long long l_start = time_ns();
+
+    int l_ret = shm_persist_open( &l_seg, g_path, g_size, DATA_VERSION );
+    if ( l_ret != PERSIST_WARM )
+    {
+        log_msg( LOG_ERROR, "Unexpected state %d of file %s.", l_ret, g_path );
+        exit( 1 );
+    }
+    double l_open = ms_since( l_start );
+
+    uint64_t *l_table = ( uint64_t * ) persist_data( &l_seg );
+    size_t l_items = g_size / sizeof( uint64_t );
+    int l_ok = verify_sample( l_table, l_items, &l_seed );
+    double l_total = ms_since( l_start );
+
+    printf( "%-17s %10.1f ms  (open %.3f ms, %d samples %s %.1f ms)\n",
+            t_desc, l_total, l_open, SAMPLES, l_ok ? "OK" : "CORRUPTED", l_total - l_open );
+
+    if ( t_updates )
+    {
+        // the same items are changed twice, values stay valid
+        size_t *l_index = new size_t[ t_updates ];
+        for ( int i = 0; i < t_updates; i++ )
+            l_index[ i ] = ( ( size_t ) rand_r( &l_seed ) * RAND_MAX + rand_r( &l_seed ) ) % l_items;
+
+        for ( int i = 0; i < t_updates; i++ )
+        {
+            l_table[ l_index[ i ] ] = make_item( l_index[ i ] );
+            persist_mark_ptr( &l_seg, &l_table[ l_index[ i ] ], sizeof( uint64_t ) );
+        }
+        l_start = time_ns();
+        size_t l_synced = persist_sync( &l_seg );
+        double l_incr = ms_since( l_start );
+
+        for ( int i = 0; i < t_updates; i++ )
+            l_table[ l_index[ i ] ] = make_item( l_index[ i ] );
+        l_start = time_ns();
+        msync( l_table, g_size, MS_SYNC );
+        double l_full = ms_since( l_start );
+
+        printf( "%d updates       incremental sync %.1f ms (%zu KB)  full msync %.1f ms (%zu MB)\n",
+                t_updates, l_incr, l_synced >> 10, l_full, g_size >> 20 );
+        delete [] l_index;
+    }
+
+    shm_persist_close( &l_seg );
+    exit( 0 );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-k" ) )
+            g_keep = 1;
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-f" ) ) g_path = t_args[ ++i ];
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_size = seg_parse_size( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-u" ) ) g_updates = atoi( t_args[ ++i ] );
+        }
+    }
+
+    g_size &= ~( sizeof( uint64_t ) - 1 );
+    if ( !g_size || g_updates < 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    shm_persist_remove( g_path );
+    log_msg( LOG_INFO, "Data %zu MB in file %s.", g_size >> 20, g_path );
+
+    cold_start();
+    warm_restart( "warm restart", g_updates );
+
+    // simulate restart of machine, pages must be read from disk
+    int l_fd = open( g_path, O_RDONLY );
+    if ( l_fd >= 0 )
+    {
+        fdatasync( l_fd );
+        posix_fadvise( l_fd, 0, 0, POSIX_FADV_DONTNEED );
+        close( l_fd );
+    }
+    warm_restart( "warm, no cache", 0 );
+
+    if ( !g_keep ) shm_persist_remove( g_path );
+
+    return 0;
+}
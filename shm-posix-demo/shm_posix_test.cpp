@@ -6,7 +6,15 @@
 //
 // Example of shared memory.
 // Every process increments global counter.
-// Number of process is counted in shared memory.
+// Processes are registered in shared memory (slot per process),
+// slots of killed processes are reclaimed, so the last process
+// removes shared memory.
+// Process started with -w only waits for changes of counter (futex).
+// With -f file shared memory is backed by file and counter survives
+// restart of all processes.
+// With -m shared memory has no name, it is created by memfd_create()
+// and its descriptor is passed to next processes over Unix socket.
+// Kernel releases it with the last process, -r is not necessary.
 //
 //***************************************************************************
 
@@ -20,19 +28,42 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <atomic>
+
+#include "shm_event.h"
+#include "shm_persist.h"
+#include "shm_fdpass.h"
+#include "shm_registry.h"
 
 #define SHM_NAME        "/shm_example"
+#define DATA_VERSION    1
+#define FDPASS_NAME     "shm_example"
+#define FDPASS_RETRY_US 10000           // members retry to take over socket
+#define FDPASS_WAIT_US  500000          // new process waits for members
 
 // data structure for shared memory
 struct shm_data
 {
-  int num_of_process;
-  int counter;
+  shm_registry registry;        // processes using shared memory
+  std::atomic<int> counter;     // atomic, plain ++ loses updates of other processes
+  std::atomic<int> waiters;     // number of processes sleeping on counter
 };
 
 // pointer to shared memory
 shm_data *g_glb_data = nullptr;
 
+// slot of this process in registry
+int g_slot = -1;
+
+// persistent segment, used when g_file is set
+const char *g_file = nullptr;
+shm_segment g_seg;
+
+// memfd segment passed over socket, g_seg is used too
+int g_memfd = 0;
+int g_listen = -1;
+
 //***************************************************************************
 // log messages
 
@@ -43,6 +74,9 @@ shm_data *g_glb_data = nullptr;
 // debug flag
 int g_debug = LOG_INFO;
 
+// process only waits for changes
+int g_watch = 0;
+
 void log_msg( int t_log_level, const char *t_form, ... )
 {
     const char *out_fmt[] = {
@@ -82,13 +116,27 @@ void clean( void )
 
     int l_num_proc = -1;
 
-    if ( g_glb_data != nullptr )
+    if ( g_slot >= 0 )
+        l_num_proc = shm_registry_leave( &g_glb_data->registry, g_slot );
+
+    log_msg( LOG_INFO, "Shared memory releasing..." );
+    if ( g_file )
     {
-        g_glb_data->num_of_process--;
-        l_num_proc = g_glb_data->num_of_process;
+        // data stays in file for next start
+        persist_mark_ptr( &g_seg, g_glb_data, sizeof( *g_glb_data ) );
+        shm_persist_close( &g_seg );
+        log_msg( LOG_INFO, "Share memory released, data saved in %s.", g_file );
+        return;
+    }
+
+    if ( g_memfd )
+    {
+        // nothing to remove, kernel releases memfd with the last user
+        shm_segment_close( &g_seg );
+        log_msg( LOG_INFO, "Share memory released." );
+        return;
     }
 
-    log_msg( LOG_INFO, "Shared memory releasing..." );
     int l_ret = munmap( g_glb_data, sizeof( *g_glb_data ) );
     if ( l_ret )
         log_msg( LOG_ERROR, "Unable to release shared memory!" );
@@ -113,40 +161,52 @@ void catch_sig( int sig )
 
 void help( int t_narg, char **t_args )
 {
-    if ( t_narg <= 1 ) return;
-
-    if ( !strcmp( t_args[ 1 ], "-h" ) )
+    for ( int i = 1; i < t_narg; i++ )
     {
-        printf(
-            "\n"
-            "  Share memory use example.\n"
-            "\n"
-            "  Use: %s [-d -h -r]\n"
-            "\n"
-            "    -h  this help\n"
-            "    -d  debug mode \n"
-            "    -r  clean shared memory \n"
-             "\n", t_args[ 0 ] );
-
-        exit( 0 );
-    }
+        if ( !strcmp( t_args[ i ], "-h" ) )
+        {
+            printf(
+                "\n"
+                "  Share memory use example.\n"
+                "\n"
+                "  Use: %s [-d -h -r -w -m | -f file]\n"
+                "\n"
+                "    -h  this help\n"
+                "    -d  debug mode \n"
+                "    -r  clean shared memory \n"
+                "    -w  do not increment, wait for changes of counter \n"
+                "    -f  shared memory in file, counter is kept after restart \n"
+                "    -m  shared memory without name, passed by descriptor \n"
+                 "\n", t_args[ 0 ] );
+
+            exit( 0 );
+        }
 
-    if ( !strcmp( t_args[ 1 ], "-d" ) )
-        g_debug = LOG_DEBUG;
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
 
-    if ( !strcmp( t_args[ 1 ], "-r" ) )
-    {
-        shm_unlink( SHM_NAME );
-        log_msg( LOG_INFO, "Shared memory cleaned." );
+        if ( !strcmp( t_args[ i ], "-w" ) )
+            g_watch = 1;
+
+        if ( !strcmp( t_args[ i ], "-f" ) && i + 1 < t_narg )
+            g_file = t_args[ ++i ];
+
+        if ( !strcmp( t_args[ i ], "-m" ) )
+            g_memfd = 1;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+        }
     }
 }
 
 //***************************************************************************
 
-int main( int t_narg, char **t_args )
+// attach shared memory in /dev/shm, returns 1 for the first process
+int attach_shm( void )
 {
-    help( t_narg, t_args );
-
     int l_first = 0;
 
     int l_fd = shm_open( SHM_NAME, O_RDWR, 0660 );
@@ -176,6 +236,143 @@ int main( int t_narg, char **t_args )
     else
         log_msg( LOG_INFO, "Shared memory attached.");
 
+    return l_first;
+}
+
+// Initialization of data in file, it runs while shm_persist_open() holds
+// lock, so processes started at the same time join initialized data.
+void init_file( void *t_data, int t_state )
+{
+    shm_data *l_data = ( shm_data * ) t_data;
+    if ( t_state == PERSIST_COLD )
+        l_data->counter = 0;
+    // PIDs from previous run are not valid
+    shm_registry_init( &l_data->registry );
+    l_data->waiters = 0;
+}
+
+// attach shared memory backed by file, data is initialized by init_file()
+int attach_file( void )
+{
+    // restarted process uses data from file, nothing is rebuilt
+    int l_ret = shm_persist_open( &g_seg, g_file, sizeof( shm_data ), DATA_VERSION, init_file );
+    if ( l_ret < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to map file %s.", g_file );
+        exit( 1 );
+    }
+    g_glb_data = ( shm_data * ) persist_data( &g_seg );
+
+    if ( l_ret == PERSIST_COLD )
+        log_msg( LOG_INFO, "File %s created, this process is first", g_file );
+    else if ( l_ret != PERSIST_JOIN )
+        log_msg( LOG_INFO, "Data restored from %s%s, counter is %d.", g_file,
+                l_ret == PERSIST_DIRTY ? " (not closed cleanly)" : "", g_glb_data->counter.load() );
+
+    return 0;
+}
+
+// Thread passes descriptor of memfd to new processes. When serving
+// process exits, name of socket is released and other process takes it
+// quickly, new processes wait for it (see attach_memfd).
+void *fd_server( void * )
+{
+    while ( 1 )
+    {
+        if ( g_listen < 0 )
+        {
+            g_listen = fdpass_listen( FDPASS_NAME );
+            if ( g_listen < 0 )
+            {
+                usleep( FDPASS_RETRY_US );
+                continue;
+            }
+            log_msg( LOG_DEBUG, "This process now passes shared memory to others." );
+        }
+
+        if ( fdpass_serve( g_listen, g_seg.fd ) < 0 )
+            log_msg( LOG_ERROR, "Unable to pass shared memory." );
+    }
+    return nullptr;
+}
+
+// get descriptor from serving process, members of group take over
+// the socket within FDPASS_RETRY_US, so they are waited for
+int get_memfd( void )
+{
+    for ( int l_waited = 0; ; l_waited += FDPASS_RETRY_US )
+    {
+        int l_fd = fdpass_get( FDPASS_NAME );
+        if ( l_fd >= 0 || l_waited >= FDPASS_WAIT_US ) return l_fd;
+        usleep( FDPASS_RETRY_US );
+    }
+}
+
+// get memfd from other process or create it, returns 1 for the first process
+int attach_memfd( void )
+{
+    int l_first = 0;
+
+    while ( 1 )
+    {
+        int l_fd = get_memfd();
+        if ( l_fd >= 0 )
+        {
+            if ( shm_segment_attach_fd( &g_seg, l_fd ) < 0 )
+            {
+                log_msg( LOG_ERROR, "Unable to attach received shared memory!" );
+                exit( 1 );
+            }
+            log_msg( LOG_INFO, "Shared memory received from other process." );
+            break;
+        }
+
+        if ( shm_segment_create( &g_seg, FDPASS_NAME, sizeof( shm_data ), SEG_MEMFD ) < 0 ||
+             shm_segment_seal( &g_seg ) < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create memfd for shared memory." );
+            exit( 1 );
+        }
+
+        g_listen = fdpass_listen( FDPASS_NAME );
+        if ( g_listen >= 0 )
+        {
+            log_msg( LOG_INFO, "Memfd created, this process is first" );
+            l_first = 1;
+            break;
+        }
+        if ( errno != EADDRINUSE )
+        {
+            log_msg( LOG_ERROR, "Unable to create socket %s.", FDPASS_NAME );
+            exit( 1 );
+        }
+
+        // other process was faster, its memfd is used
+        shm_segment_close( &g_seg );
+    }
+
+    g_glb_data = ( shm_data * ) g_seg.addr;
+    return l_first;
+}
+
+// start passing of memfd, shared memory must be initialized
+void start_fd_server( void )
+{
+    pthread_t l_thread;
+    if ( pthread_create( &l_thread, nullptr, fd_server, nullptr ) )
+        log_msg( LOG_ERROR, "Unable to create thread, shared memory will not be passed." );
+    else
+        pthread_detach( l_thread );
+}
+
+//***************************************************************************
+
+int main( int t_narg, char **t_args )
+{
+    help( t_narg, t_args );
+
+    int l_first = g_file ? attach_file() : g_memfd ? attach_memfd() : attach_shm();
+
     struct sigaction l_sa;
     bzero( &l_sa, sizeof( l_sa ) );
     l_sa.sa_handler = catch_sig;
@@ -190,30 +387,70 @@ int main( int t_narg, char **t_args )
     // clean at exit
     atexit( clean );
 
-    // first process initialize shared memory
+    // first process initialize shared memory, file is initialized in attach_file()
     if ( l_first )
     {
         g_glb_data->counter = 0;
-        g_glb_data->num_of_process = 0;
+        g_glb_data->waiters = 0;
+        shm_registry_init( &g_glb_data->registry );
     }
 
-    // increase number of processes
-    g_glb_data->num_of_process++;
+    // new processes get memfd only after initialization
+    if ( g_memfd )
+        start_fd_server();
+
+    // register process, dead processes are removed from registry
+    int l_dead = shm_registry_reclaim( &g_glb_data->registry );
+    if ( l_dead )
+        log_msg( LOG_INFO, "Removed %d killed processes from registry.", l_dead );
+
+    g_slot = shm_registry_join( &g_glb_data->registry );
+    if ( g_slot < 0 )
+    {
+        log_msg( LOG_INFO, "Too many processes use shared memory." );
+        exit( 1 );
+    }
+    log_msg( LOG_DEBUG, "Process registered in slot %d, %d processes.", g_slot, g_glb_data->registry.members.load() );
 
     int l_old = g_glb_data->counter;
-    log_msg( LOG_DEBUG, "Current global counter is %d.", g_glb_data->counter );
+    log_msg( LOG_DEBUG, "Current global counter is %d.", l_old );
+
+    // sleep until other processes change counter, no busy polling
+    while ( g_watch )
+    {
+        // timeout to keep heartbeat fresh
+        int l_cur = shm_wait_change( &g_glb_data->counter, &g_glb_data->waiters, l_old,
+                REGISTRY_HEARTBEAT_NS / 2000000 );
+        shm_registry_heartbeat( &g_glb_data->registry, g_slot );
+        if ( l_cur != l_old )
+            log_msg( LOG_INFO, "Another process changed global counter. Difference=%d", l_cur - l_old );
+        l_old = l_cur;
+    }
 
     while ( 1 )
     {
-        if ( l_old != g_glb_data->counter )
-            log_msg( LOG_INFO, "Another process changed global counter. Difference=%d", g_glb_data->counter - l_old );
+        int l_cur = g_glb_data->counter;
+        if ( l_old != l_cur )
+            log_msg( LOG_INFO, "Another process changed global counter. Difference=%d", l_cur - l_old );
 
         l_old = ++g_glb_data->counter;
+        shm_registry_heartbeat( &g_glb_data->registry, g_slot );
 
-        printf( "New value of global counter %d\r", g_glb_data->counter );
+        printf( "New value of global counter %d\r", l_old );
         fflush( stdout );
 
-        if ( !( g_glb_data->counter % 100 ) ) usleep( 250000 );
+        // waiting processes are woken once per batch of increments
+        if ( !( l_old % 100 ) )
+        {
+            shm_notify( &g_glb_data->counter, &g_glb_data->waiters );
+            if ( g_file )
+            {
+                // only changed part of file is written
+                persist_mark_ptr( &g_seg, g_glb_data, sizeof( *g_glb_data ) );
+                persist_sync( &g_seg, 0 );
+            }
+            usleep( 250000 );
+        }
     }
 
     return 0;
@@ -0,0 +1,193 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Registry of processes using shared memory.
+//
+// Every process claims one slot of fixed table by CAS of its PID into
+// empty slot. Index of slot can be used as process index in other
+// shared structures. Process stores time of heartbeat into its slot
+// periodically, so membership is checked by reading slot only.
+// Slots of processes killed without cleaning (SIGKILL) are reclaimed
+// by other processes: process without recent heartbeat is tested
+// by kill( pid, 0 ) and its start time is compared (PID reuse).
+// Number of members is decremented exactly once for every slot,
+// so only one process is the last one.
+//
+// Slot being claimed contains negative PID of claimer and it is counted
+// in members only when PID is published. Claim of killed process is
+// freed by reclaim like slot of dead member.
+//
+//***************************************************************************
+
+#ifndef __SHM_REGISTRY_H
+#define __SHM_REGISTRY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define REGISTRY_SLOTS          64
+#define REGISTRY_HEARTBEAT_NS   1000000000LL    // default max. age of heartbeat
+
+struct registry_slot
+{
+    alignas( CACHE_LINE ) std::atomic<int> pid;         // 0 = free, -pid = being claimed
+    std::atomic<unsigned long long> start_time;         // 0 = not known yet
+    std::atomic<long long> heartbeat;                   // time_ns() of last heartbeat
+};
+
+struct shm_registry
+{
+    std::atomic<int> members;
+    registry_slot slots[ REGISTRY_SLOTS ];
+};
+
+// start time of process in clock ticks since boot, 0 when process does not exist
+static inline unsigned long long registry_start_time( int t_pid )
+{
+    char l_buf[ 1024 ];
+    snprintf( l_buf, sizeof( l_buf ), "/proc/%d/stat", t_pid );
+    FILE *l_file = fopen( l_buf, "r" );
+    if ( !l_file ) return 0;
+    size_t l_len = fread( l_buf, 1, sizeof( l_buf ) - 1, l_file );
+    fclose( l_file );
+    l_buf[ l_len ] = 0;
+
+    // name of program can contain spaces, fields follow the last ')'
+    char *l_ptr = strrchr( l_buf, ')' );
+    if ( !l_ptr ) return 0;
+    l_ptr++;
+    // start time is field 22, state is field 3
+    for ( int i = 3; i < 22 && l_ptr; i++ )
+        l_ptr = strchr( l_ptr + 1, ' ' );
+    return l_ptr ? strtoull( l_ptr, nullptr, 10 ) : 0;
+}
+
+// initialization by the first process
+static inline void shm_registry_init( shm_registry *t_reg )
+{
+    for ( int i = 0; i < REGISTRY_SLOTS; i++ )
+    {
+        t_reg->slots[ i ].pid.store( 0 );
+        t_reg->slots[ i ].start_time.store( 0 );
+        t_reg->slots[ i ].heartbeat.store( 0 );
+    }
+    t_reg->members.store( 0 );
+}
+
+static inline int registry_alive( registry_slot *t_slot, int t_pid, long long t_max_age )
+{
+    // fresh heartbeat, no syscall is needed
+    if ( time_ns() - t_slot->heartbeat.load( std::memory_order_relaxed ) < t_max_age ) return 1;
+
+    if ( kill( t_pid, 0 ) < 0 && errno == ESRCH ) return 0;
+
+    unsigned long long l_start = t_slot->start_time.load( std::memory_order_relaxed );
+    return !l_start || registry_start_time( t_pid ) == l_start;
+}
+
+// Claim takes microseconds, claimer is dead or claim is stale. Heartbeat
+// can be still from previous owner, then live claim is freed too and
+// claimer repeats it.
+static inline int registry_claim_lost( registry_slot *t_slot, int t_pid )
+{
+    if ( kill( t_pid, 0 ) < 0 && errno == ESRCH ) return 1;
+    return time_ns() - t_slot->heartbeat.load( std::memory_order_relaxed ) >= REGISTRY_HEARTBEAT_NS;
+}
+
+// Free slots of dead processes, returns number of reclaimed slots.
+static inline int shm_registry_reclaim( shm_registry *t_reg, long long t_max_age = REGISTRY_HEARTBEAT_NS )
+{
+    int l_self = getpid();
+    int l_count = 0;
+
+    for ( int i = 0; i < REGISTRY_SLOTS; i++ )
+    {
+        registry_slot *l_slot = &t_reg->slots[ i ];
+        int l_pid = l_slot->pid.load( std::memory_order_acquire );
+        if ( !l_pid || l_pid == l_self || l_pid == -l_self ) continue;
+
+        // unfinished claim is not counted in members
+        if ( l_pid < 0 )
+        {
+            if ( registry_claim_lost( l_slot, -l_pid ) && l_slot->pid.compare_exchange_strong( l_pid, 0 ) )
+                l_count++;
+            continue;
+        }
+        if ( registry_alive( l_slot, l_pid, t_max_age ) ) continue;
+
+        // only one process wins slot, members is decremented once
+        if ( l_slot->pid.compare_exchange_strong( l_pid, 0 ) )
+        {
+            t_reg->members.fetch_sub( 1 );
+            l_count++;
+        }
+    }
+    return l_count;
+}
+
+static inline void shm_registry_heartbeat( shm_registry *t_reg, int t_slot )
+{
+    t_reg->slots[ t_slot ].heartbeat.store( time_ns(), std::memory_order_relaxed );
+}
+
+// Claim slot for this process, returns index of slot or -1 when table is full.
+static inline int shm_registry_join( shm_registry *t_reg )
+{
+    int l_self = getpid();
+
+    for ( int l_try = 0; l_try < 2; l_try++ )
+    {
+        for ( int i = 0; i < REGISTRY_SLOTS; i++ )
+        {
+            registry_slot *l_slot = &t_reg->slots[ i ];
+            int l_free = 0;
+            if ( l_slot->pid.load( std::memory_order_relaxed ) ) continue;
+            // slot is reserved by -pid until it contains data of this process,
+            // reclaim must not check new PID against data of previous one
+            if ( !l_slot->pid.compare_exchange_strong( l_free, -l_self ) ) continue;
+
+            l_slot->heartbeat.store( time_ns() );
+            l_slot->start_time.store( registry_start_time( l_self ) );
+            // claim could be freed by reclaim meanwhile
+            int l_claim = -l_self;
+            if ( !l_slot->pid.compare_exchange_strong( l_claim, l_self, std::memory_order_release ) ) continue;
+            t_reg->members.fetch_add( 1 );
+            return i;
+        }
+        // table is full, try to free slots of dead processes
+        if ( !shm_registry_reclaim( t_reg ) ) break;
+    }
+    return -1;
+}
+
+// Release slot, returns number of remaining members (0 = last process).
+static inline int shm_registry_leave( shm_registry *t_reg, int t_slot )
+{
+    shm_registry_reclaim( t_reg );
+
+    int l_self = getpid();
+    if ( !t_reg->slots[ t_slot ].pid.compare_exchange_strong( l_self, 0 ) )
+        return t_reg->members.load();
+
+    return t_reg->members.fetch_sub( 1 ) - 1;
+}
+
+// Process in slot is member with fresh heartbeat, no syscall.
+static inline int shm_registry_is_member( shm_registry *t_reg, int t_slot, long long t_max_age = REGISTRY_HEARTBEAT_NS )
+{
+    registry_slot *l_slot = &t_reg->slots[ t_slot ];
+    return l_slot->pid.load( std::memory_order_acquire ) > 0 &&
+           time_ns() - l_slot->heartbeat.load( std::memory_order_relaxed ) < t_max_age;
+}
+
+#endif // __SHM_REGISTRY_H
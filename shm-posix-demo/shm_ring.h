@@ -0,0 +1,197 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Single-producer/single-consumer ring buffer in shared memory.
+//
+// Ring stores records of variable length. Every record starts with
+// 4 byte header (length) and it is aligned to 8 bytes. When record does
+// not fit to the end of buffer, padding record is inserted and record
+// is stored from the beginning of buffer.
+//
+// Head (producer) and tail (consumer) are in separate cache lines
+// and they are published with release/acquire semantics. Empty or full
+// ring does not cause busy waiting, process sleeps on futex.
+//
+//***************************************************************************
+
+#ifndef __SHM_RING_H
+#define __SHM_RING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+
+#include "futex.h"
+
+#define RING_PAD_RECORD         0xFFFFFFFFu     // length of padding record
+#define RING_SPIN_COUNT         128             // spins before sleeping
+
+struct shm_ring
+{
+    uint64_t capacity;                          // size of data area (power of 2)
+
+    // written by producer
+    alignas( CACHE_LINE ) std::atomic<uint64_t> head;
+    uint64_t tail_cache;                        // last tail seen by producer
+
+    // written by consumer
+    alignas( CACHE_LINE ) std::atomic<uint64_t> tail;
+    uint64_t head_cache;                        // last head seen by consumer
+
+    // futex words, 1 = process is sleeping
+    alignas( CACHE_LINE ) std::atomic<int> cons_wait;
+    alignas( CACHE_LINE ) std::atomic<int> prod_wait;
+
+    alignas( CACHE_LINE ) char data[ 0 ];
+};
+
+static inline uint64_t ring_align( uint64_t t_len )
+{
+    return ( t_len + 7 ) & ~7ull;
+}
+
+// bytes required for ring with given capacity
+static inline size_t shm_ring_bytes( uint64_t t_capacity )
+{
+    return sizeof( shm_ring ) + t_capacity;
+}
+
+// initialization by the first process, t_capacity must be power of 2
+static inline void shm_ring_init( shm_ring *t_ring, uint64_t t_capacity )
+{
+    t_ring->capacity = t_capacity;
+    t_ring->head.store( 0 );
+    t_ring->tail.store( 0 );
+    t_ring->tail_cache = 0;
+    t_ring->head_cache = 0;
+    t_ring->cons_wait.store( 0 );
+    t_ring->prod_wait.store( 0 );
+}
+
+// wake up the opposite side if it is sleeping
+static inline void ring_wake( std::atomic<int> *t_wait )
+{
+    // pairs with fence in ring_sleep, either sleeper sees new index or we see flag
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( t_wait->load( std::memory_order_relaxed ) )
+    {
+        t_wait->store( 0, std::memory_order_relaxed );
+        futex_wake( t_wait );
+    }
+}
+
+// sleep until index differs from t_old
+static inline void ring_sleep( std::atomic<int> *t_wait, std::atomic<uint64_t> *t_index, uint64_t t_old )
+{
+    for ( int i = 0; i < RING_SPIN_COUNT; i++ )
+    {
+        if ( t_index->load( std::memory_order_acquire ) != t_old ) return;
+        cpu_relax();
+    }
+
+    t_wait->store( 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( t_index->load( std::memory_order_acquire ) != t_old )
+    {
+        t_wait->store( 0, std::memory_order_relaxed );
+        return;
+    }
+    futex_wait( t_wait, 1 );
+}
+
+// maximal length of one record
+static inline uint32_t shm_ring_max_record( shm_ring *t_ring )
+{
+    return t_ring->capacity / 2 - 8;
+}
+
+// store record, returns 0 when ring is full, -1 (errno EMSGSIZE) when
+// record is longer than shm_ring_max_record()
+static inline int shm_ring_try_push( shm_ring *t_ring, const void *t_data, uint32_t t_len )
+{
+    if ( t_len > shm_ring_max_record( t_ring ) )
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    uint64_t l_head = t_ring->head.load( std::memory_order_relaxed );
+    uint64_t l_pos = l_head & ( t_ring->capacity - 1 );
+    uint64_t l_need = ring_align( 4 + t_len );
+    uint64_t l_to_end = t_ring->capacity - l_pos;
+    uint64_t l_pad = l_to_end < l_need ? l_to_end : 0;
+
+    if ( l_head + l_pad + l_need - t_ring->tail_cache > t_ring->capacity )
+    {
+        t_ring->tail_cache = t_ring->tail.load( std::memory_order_acquire );
+        if ( l_head + l_pad + l_need - t_ring->tail_cache > t_ring->capacity )
+            return 0;
+    }
+
+    if ( l_pad )
+    {
+        *( uint32_t * ) ( t_ring->data + l_pos ) = RING_PAD_RECORD;
+        l_pos = 0;
+    }
+
+    *( uint32_t * ) ( t_ring->data + l_pos ) = t_len;
+    memcpy( t_ring->data + l_pos + 4, t_data, t_len );
+
+    t_ring->head.store( l_head + l_pad + l_need, std::memory_order_release );
+    ring_wake( &t_ring->cons_wait );
+    return 1;
+}
+
+// read record into t_buf, returns length of record or -1 when ring is empty.
+// Too long record is truncated to t_size.
+static inline int shm_ring_try_pop( shm_ring *t_ring, void *t_buf, uint32_t t_size )
+{
+    uint64_t l_tail = t_ring->tail.load( std::memory_order_relaxed );
+
+    if ( l_tail == t_ring->head_cache )
+    {
+        t_ring->head_cache = t_ring->head.load( std::memory_order_acquire );
+        if ( l_tail == t_ring->head_cache )
+            return -1;
+    }
+
+    uint64_t l_pos = l_tail & ( t_ring->capacity - 1 );
+    uint32_t l_len = *( uint32_t * ) ( t_ring->data + l_pos );
+    if ( l_len == RING_PAD_RECORD )
+    {
+        l_tail += t_ring->capacity - l_pos;
+        l_pos = 0;
+        l_len = *( uint32_t * ) t_ring->data;
+    }
+
+    memcpy( t_buf, t_ring->data + l_pos + 4, l_len < t_size ? l_len : t_size );
+
+    t_ring->tail.store( l_tail + ring_align( 4 + l_len ), std::memory_order_release );
+    ring_wake( &t_ring->prod_wait );
+    return l_len;
+}
+
+// blocking variants
+
+// returns 0 or -1 when record is too long
+static inline int shm_ring_push( shm_ring *t_ring, const void *t_data, uint32_t t_len )
+{
+    int l_ret;
+    while ( !( l_ret = shm_ring_try_push( t_ring, t_data, t_len ) ) )
+        ring_sleep( &t_ring->prod_wait, &t_ring->tail, t_ring->tail_cache );
+    return l_ret < 0 ? -1 : 0;
+}
+
+static inline int shm_ring_pop( shm_ring *t_ring, void *t_buf, uint32_t t_size )
+{
+    int l_len;
+    while ( ( l_len = shm_ring_try_pop( t_ring, t_buf, t_size ) ) < 0 )
+        ring_sleep( &t_ring->cons_wait, &t_ring->head, t_ring->head_cache );
+    return l_len;
+}
+
+#endif // __SHM_RING_H
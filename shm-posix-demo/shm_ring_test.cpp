@@ -0,0 +1,399 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Example of SPSC ring buffer in shared memory.
+//
+// Parent process (producer) sends messages to child process (consumer).
+// The same workload is passed through shared memory ring, pipe
+// and posix message queue. Throughput is measured by burst of messages,
+// latency is measured as half of round trip time (ping-pong).
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <mqueue.h>
+#include <vector>
+#include <algorithm>
+
+#include "shm_ring.h"
+
+#define SHM_NAME        "/shm_ring"
+#define MQ_NAME_0       "/shm_ring_mq0"
+#define MQ_NAME_1       "/shm_ring_mq1"
+
+// parameters of test
+int g_msg_size = 64;
+int g_msg_count = 1000000;
+int g_rounds = 10000;
+uint64_t g_capacity = 1 << 20;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  SPSC ring buffer in shared memory compared with pipe and message queue.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-s msg_size] [-n msg_count] [-l rounds] [-c capacity]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory and message queues\n"
+        "    -s  size of message in bytes (default %d)\n"
+        "    -n  number of messages for throughput test (default %d)\n"
+        "    -l  number of ping-pong rounds for latency test (default %d)\n"
+        "    -c  capacity of ring in bytes, power of 2 (default %d)\n"
+        "\n", t_name, g_msg_size, g_msg_count, g_rounds, ( int ) g_capacity );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+// transports, every transport has two channels: 0 parent->child, 1 child->parent
+
+shm_ring *g_ring[ 2 ] = { nullptr, nullptr };
+
+int ring_setup()
+{
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory." );
+        return -1;
+    }
+
+    size_t l_ring_size = shm_ring_bytes( g_capacity );
+    if ( ftruncate( l_fd, 2 * l_ring_size ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        close( l_fd );
+        return -1;
+    }
+
+    char *l_mem = ( char * ) mmap( nullptr, 2 * l_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_mem == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        return -1;
+    }
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        g_ring[ i ] = ( shm_ring * ) ( l_mem + i * l_ring_size );
+        shm_ring_init( g_ring[ i ], g_capacity );
+    }
+    return 0;
+}
+
+void ring_send( int t_chan, const void *t_data, int t_len )
+{
+    if ( shm_ring_push( g_ring[ t_chan ], t_data, t_len ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to store message into ring!" );
+        exit( 1 );
+    }
+}
+
+int ring_recv( int t_chan, void *t_buf, int t_size )
+{
+    return shm_ring_pop( g_ring[ t_chan ], t_buf, t_size );
+}
+
+void ring_cleanup()
+{
+    munmap( g_ring[ 0 ], 2 * shm_ring_bytes( g_capacity ) );
+    shm_unlink( SHM_NAME );
+}
+
+int g_pipe[ 2 ][ 2 ];
+
+int pipe_setup()
+{
+    if ( pipe( g_pipe[ 0 ] ) < 0 || pipe( g_pipe[ 1 ] ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create pipe!" );
+        return -1;
+    }
+    return 0;
+}
+
+void pipe_send( int t_chan, const void *t_data, int t_len )
+{
+    // pipe is stream, messages have fixed size
+    const char *l_ptr = ( const char * ) t_data;
+    while ( t_len > 0 )
+    {
+        int l_ret = write( g_pipe[ t_chan ][ 1 ], l_ptr, t_len );
+        if ( l_ret < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to write to pipe!" );
+            exit( 1 );
+        }
+        l_ptr += l_ret;
+        t_len -= l_ret;
+    }
+}
+
+int pipe_recv( int t_chan, void *t_buf, int t_size )
+{
+    char *l_ptr = ( char * ) t_buf;
+    int l_len = g_msg_size;
+    while ( l_len > 0 )
+    {
+        int l_ret = read( g_pipe[ t_chan ][ 0 ], l_ptr, l_len );
+        if ( l_ret <= 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to read from pipe!" );
+            exit( 1 );
+        }
+        l_ptr += l_ret;
+        l_len -= l_ret;
+    }
+    return g_msg_size;
+}
+
+void pipe_cleanup()
+{
+    for ( int i = 0; i < 2; i++ )
+    {
+        close( g_pipe[ i ][ 0 ] );
+        close( g_pipe[ i ][ 1 ] );
+    }
+}
+
+mqd_t g_mq[ 2 ] = { -1, -1 };
+
+int mq_setup()
+{
+    mq_attr l_mqa;
+    bzero( &l_mqa, sizeof( l_mqa ) );
+    l_mqa.mq_maxmsg = 8;
+    l_mqa.mq_msgsize = g_msg_size;
+
+    mq_unlink( MQ_NAME_0 );
+    mq_unlink( MQ_NAME_1 );
+    g_mq[ 0 ] = mq_open( MQ_NAME_0, O_RDWR | O_CREAT, 0660, &l_mqa );
+    g_mq[ 1 ] = mq_open( MQ_NAME_1, O_RDWR | O_CREAT, 0660, &l_mqa );
+    if ( g_mq[ 0 ] < 0 || g_mq[ 1 ] < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create message queue!" );
+        return -1;
+    }
+    return 0;
+}
+
+void mq_send_msg( int t_chan, const void *t_data, int t_len )
+{
+    if ( mq_send( g_mq[ t_chan ], ( const char * ) t_data, t_len, 0 ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to send message!" );
+        exit( 1 );
+    }
+}
+
+int mq_recv_msg( int t_chan, void *t_buf, int t_size )
+{
+    int l_ret = mq_receive( g_mq[ t_chan ], ( char * ) t_buf, t_size, nullptr );
+    if ( l_ret < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to receive message!" );
+        exit( 1 );
+    }
+    return l_ret;
+}
+
+void mq_cleanup()
+{
+    mq_close( g_mq[ 0 ] );
+    mq_close( g_mq[ 1 ] );
+    mq_unlink( MQ_NAME_0 );
+    mq_unlink( MQ_NAME_1 );
+}
+
+struct transport
+{
+    const char *name;
+    int ( *setup )();
+    void ( *send )( int t_chan, const void *t_data, int t_len );
+    int ( *recv )( int t_chan, void *t_buf, int t_size );
+    void ( *cleanup )();
+};
+
+transport g_transports[] = {
+    { "shm ring", ring_setup, ring_send, ring_recv, ring_cleanup },
+    { "pipe", pipe_setup, pipe_send, pipe_recv, pipe_cleanup },
+    { "mq", mq_setup, mq_send_msg, mq_recv_msg, mq_cleanup },
+};
+
+//***************************************************************************
+
+void run_test( transport *t_tr )
+{
+    if ( t_tr->setup() < 0 ) return;
+
+    std::vector<char> l_msg( g_msg_size );
+
+    // throughput: burst of messages from parent to child
+    long long l_start = time_ns();
+
+    fflush( stdout );
+    int l_child = fork();
+    if ( l_child < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create new process!" );
+        exit( 1 );
+    }
+
+    if ( l_child == 0 )
+    {
+        for ( int i = 0; i < g_msg_count; i++ )
+            t_tr->recv( 0, l_msg.data(), g_msg_size );
+        log_msg( LOG_DEBUG, "Consumer received %d messages.", g_msg_count );
+
+        // latency: echo every message back
+        for ( int i = 0; i < g_rounds; i++ )
+        {
+            int l_len = t_tr->recv( 0, l_msg.data(), g_msg_size );
+            t_tr->send( 1, l_msg.data(), l_len );
+        }
+        exit( 0 );
+    }
+
+    for ( int i = 0; i < g_msg_count; i++ )
+    {
+        *( int * ) l_msg.data() = i;
+        t_tr->send( 0, l_msg.data(), g_msg_size );
+    }
+
+    // wait for consumer, first echo confirms all messages were consumed
+    long long l_rtt_start = time_ns();
+    t_tr->send( 0, l_msg.data(), g_msg_size );
+    t_tr->recv( 1, l_msg.data(), g_msg_size );
+    long long l_end = time_ns();
+
+    std::vector<long long> l_lat;
+    l_lat.reserve( g_rounds );
+    l_lat.push_back( ( l_end - l_rtt_start ) / 2 );
+
+    for ( int i = 1; i < g_rounds; i++ )
+    {
+        long long l_t0 = time_ns();
+        t_tr->send( 0, l_msg.data(), g_msg_size );
+        t_tr->recv( 1, l_msg.data(), g_msg_size );
+        l_lat.push_back( ( time_ns() - l_t0 ) / 2 );
+    }
+
+    waitpid( l_child, nullptr, 0 );
+    t_tr->cleanup();
+
+    std::sort( l_lat.begin(), l_lat.end() );
+    double l_sec = ( l_end - l_start ) / 1e9;
+
+    printf( "%-10s %8d B %12.0f msg/s %10.1f MB/s   latency p50 %7lld ns  p99 %7lld ns  max %9lld ns\n",
+            t_tr->name, g_msg_size, g_msg_count / l_sec, g_msg_count / l_sec * g_msg_size / 1e6,
+            l_lat[ l_lat.size() / 2 ], l_lat[ l_lat.size() * 99 / 100 ], l_lat.back() );
+}
+
+//***************************************************************************
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            mq_unlink( MQ_NAME_0 );
+            mq_unlink( MQ_NAME_1 );
+            log_msg( LOG_INFO, "Shared memory and message queues cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-s" ) ) g_msg_size = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_msg_count = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-l" ) ) g_rounds = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-c" ) ) g_capacity = strtoull( t_args[ ++i ], nullptr, 0 );
+        }
+    }
+
+    if ( g_msg_size < ( int ) sizeof( int ) || g_msg_count <= 0 || g_rounds <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    if ( g_capacity & ( g_capacity - 1 ) || g_msg_size > ( int ) ( g_capacity / 2 - 8 ) )
+    {
+        log_msg( LOG_INFO, "Capacity of ring must be power of 2 and at least twice size of message!" );
+        exit( 1 );
+    }
+
+    log_msg( LOG_INFO, "Messages %d, size %d B, ping-pong rounds %d.", g_msg_count, g_msg_size, g_rounds );
+
+    for ( auto &l_tr : g_transports )
+        run_test( &l_tr );
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Shared memory segment of size given at run time.
+//
+// Segment can be backed by:
+//   SEG_SHM       - shm_open() in /dev/shm (4 KB pages, THP on request)
+//   SEG_HUGETLBFS - file in hugetlbfs mount (huge pages)
+//   SEG_MEMFD     - memfd_create()
+//   SEG_MEMFD_HUGE - memfd_create( MFD_HUGETLB ) (huge pages)
+//   SEG_FILE      - regular file, content survives restart
+// Pages can be pre-faulted (SEG_POPULATE) and NUMA policy
+// (interleave or bind) can be set for the whole segment.
+// Memfd segment has no name, its descriptor can be sealed and passed
+// to other processes (see shm_fdpass.h), kernel removes it with
+// the last descriptor and mapping.
+//
+//***************************************************************************
+
+#ifndef __SHM_SEGMENT_H
+#define __SHM_SEGMENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC             0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING       0x0002U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB             0x0004U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS             ( 1024 + 9 )
+#define F_GET_SEALS             ( 1024 + 10 )
+#define F_SEAL_SEAL             0x0001
+#define F_SEAL_SHRINK           0x0002
+#define F_SEAL_GROW             0x0004
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE     23
+#endif
+
+// backing of segment
+#define SEG_SHM                 0
+#define SEG_HUGETLBFS           1
+#define SEG_MEMFD               2
+#define SEG_MEMFD_HUGE          3
+#define SEG_FILE                4
+
+// flags
+#define SEG_POPULATE            0x01    // pre-fault all pages
+#define SEG_THP                 0x02    // ask for transparent huge pages
+
+// NUMA policy
+#define SEG_NUMA_DEFAULT        0
+#define SEG_NUMA_INTERLEAVE     1
+#define SEG_NUMA_BIND           2
+
+#define SEG_HUGE_PAGE           ( 2UL << 20 )
+#define SEG_HUGETLBFS_DIR       "/dev/hugepages"
+
+struct shm_segment
+{
+    void *addr;
+    size_t size;
+    int fd;
+    int type;
+    char name[ 256 ];
+};
+
+// size with optional suffix K, M or G
+static inline size_t seg_parse_size( const char *t_str )
+{
+    char *l_end;
+    size_t l_size = strtoull( t_str, &l_end, 0 );
+    switch ( *l_end )
+    {
+    case 'g': case 'G': l_size <<= 10; // fallthrough
+    case 'm': case 'M': l_size <<= 10; // fallthrough
+    case 'k': case 'K': l_size <<= 10;
+    }
+    return l_size;
+}
+
+static inline int seg_is_huge( int t_type )
+{
+    return t_type == SEG_HUGETLBFS || t_type == SEG_MEMFD_HUGE;
+}
+
+// set NUMA policy for memory range, t_nodes is bit mask of nodes
+static inline int seg_set_numa( void *t_addr, size_t t_size, int t_policy, unsigned long t_nodes )
+{
+    if ( t_policy == SEG_NUMA_DEFAULT ) return 0;
+
+    int l_mode = t_policy == SEG_NUMA_BIND ? MPOL_BIND : MPOL_INTERLEAVE;
+    return syscall( SYS_mbind, t_addr, t_size, l_mode, &t_nodes, sizeof( t_nodes ) * 8, 0 );
+}
+
+// pre-fault pages, data in segment is not changed
+static inline void seg_populate( void *t_addr, size_t t_size, size_t t_page )
+{
+    if ( !madvise( t_addr, t_size, MADV_POPULATE_WRITE ) ) return;
+
+    // older kernel, touch every page
+    for ( size_t i = 0; i < t_size; i += t_page )
+    {
+        volatile char *l_ptr = ( volatile char * ) t_addr + i;
+        *l_ptr = *l_ptr;
+    }
+}
+
+// map segment and apply flags and policy
+static inline int seg_map( shm_segment *t_seg, int t_flags, int t_numa, unsigned long t_nodes )
+{
+    // with NUMA policy pages must be faulted after mbind()
+    int l_map_flags = MAP_SHARED;
+    if ( t_flags & SEG_POPULATE && t_numa == SEG_NUMA_DEFAULT ) l_map_flags |= MAP_POPULATE;
+
+    t_seg->addr = mmap( nullptr, t_seg->size, PROT_READ | PROT_WRITE, l_map_flags, t_seg->fd, 0 );
+    if ( t_seg->addr == MAP_FAILED )
+    {
+        t_seg->addr = nullptr;
+        return -1;
+    }
+
+    if ( t_flags & SEG_THP && !seg_is_huge( t_seg->type ) )
+        madvise( t_seg->addr, t_seg->size, MADV_HUGEPAGE );
+
+    if ( seg_set_numa( t_seg->addr, t_seg->size, t_numa, t_nodes ) < 0 )
+    {
+        int l_err = errno;
+        munmap( t_seg->addr, t_seg->size );
+        t_seg->addr = nullptr;
+        errno = l_err;
+        return -1;
+    }
+
+    if ( t_flags & SEG_POPULATE && t_numa != SEG_NUMA_DEFAULT )
+        seg_populate( t_seg->addr, t_seg->size, seg_is_huge( t_seg->type ) ? SEG_HUGE_PAGE : 4096 );
+
+    return 0;
+}
+
+// Create new segment of t_size bytes (rounded up to huge page for huge types).
+// Returns 0 or -1 with errno set.
+static inline int shm_segment_create( shm_segment *t_seg, const char *t_name, size_t t_size, int t_type,
+        int t_flags = 0, int t_numa = SEG_NUMA_DEFAULT, unsigned long t_nodes = 0 )
+{
+    bzero( t_seg, sizeof( *t_seg ) );
+    t_seg->type = t_type;
+    t_seg->size = seg_is_huge( t_type ) ? ( t_size + SEG_HUGE_PAGE - 1 ) & ~( SEG_HUGE_PAGE - 1 ) : t_size;
+
+    switch ( t_type )
+    {
+    case SEG_SHM:
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s", t_name );
+        t_seg->fd = shm_open( t_name, O_RDWR | O_CREAT | O_EXCL, 0660 );
+        break;
+
+    case SEG_HUGETLBFS:
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s%s", SEG_HUGETLBFS_DIR, t_name );
+        t_seg->fd = open( t_seg->name, O_RDWR | O_CREAT | O_EXCL, 0660 );
+        break;
+
+    case SEG_FILE:
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s", t_name );
+        t_seg->fd = open( t_seg->name, O_RDWR | O_CREAT | O_EXCL, 0660 );
+        break;
+
+    case SEG_MEMFD:
+    case SEG_MEMFD_HUGE:
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s", t_name );
+        t_seg->fd = syscall( SYS_memfd_create, t_name,
+                MFD_CLOEXEC | MFD_ALLOW_SEALING | ( t_type == SEG_MEMFD_HUGE ? MFD_HUGETLB : 0 ) );
+        break;
+
+    default:
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ( t_seg->fd < 0 ) return -1;
+
+    if ( ftruncate( t_seg->fd, t_seg->size ) < 0 || seg_map( t_seg, t_flags, t_numa, t_nodes ) < 0 )
+    {
+        int l_err = errno;
+        close( t_seg->fd );
+        if ( t_type == SEG_SHM ) shm_unlink( t_seg->name );
+        if ( t_type == SEG_HUGETLBFS || t_type == SEG_FILE ) unlink( t_seg->name );
+        errno = l_err;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Attach existing named segment (SEG_SHM, SEG_HUGETLBFS or SEG_FILE), size is taken from file.
+static inline int shm_segment_attach( shm_segment *t_seg, const char *t_name, int t_type, int t_flags = 0 )
+{
+    bzero( t_seg, sizeof( *t_seg ) );
+    t_seg->type = t_type;
+
+    if ( t_type == SEG_SHM )
+    {
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s", t_name );
+        t_seg->fd = shm_open( t_name, O_RDWR, 0660 );
+    }
+    else if ( t_type == SEG_HUGETLBFS )
+    {
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s%s", SEG_HUGETLBFS_DIR, t_name );
+        t_seg->fd = open( t_seg->name, O_RDWR, 0660 );
+    }
+    else if ( t_type == SEG_FILE )
+    {
+        snprintf( t_seg->name, sizeof( t_seg->name ), "%s", t_name );
+        t_seg->fd = open( t_seg->name, O_RDWR, 0660 );
+    }
+    else
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if ( t_seg->fd < 0 ) return -1;
+
+    struct stat l_st;
+    if ( fstat( t_seg->fd, &l_st ) < 0 ) l_st.st_size = 0;
+    else if ( !l_st.st_size ) errno = EINVAL;   // empty segment can not be mapped
+    t_seg->size = l_st.st_size;
+
+    if ( !t_seg->size || seg_map( t_seg, t_flags, SEG_NUMA_DEFAULT, 0 ) < 0 )
+    {
+        int l_err = errno;
+        close( t_seg->fd );
+        errno = l_err;
+        return -1;
+    }
+
+    return 0;
+}
+
+// Attach memfd segment received from other process, size is taken from descriptor.
+// Segment must be sealed against shrinking, otherwise access could end by SIGBUS.
+static inline int shm_segment_attach_fd( shm_segment *t_seg, int t_fd, int t_flags = 0 )
+{
+    bzero( t_seg, sizeof( *t_seg ) );
+    t_seg->type = SEG_MEMFD;
+    t_seg->fd = t_fd;
+
+    struct stat l_st;
+    if ( !fstat( t_fd, &l_st ) ) t_seg->size = l_st.st_size;
+
+    int l_seals = fcntl( t_fd, F_GET_SEALS );
+    if ( l_seals < 0 || !( l_seals & F_SEAL_SHRINK ) )
+    {
+        errno = EPERM;
+        return -1;
+    }
+
+    if ( !t_seg->size || seg_map( t_seg, t_flags, SEG_NUMA_DEFAULT, 0 ) < 0 )
+        return -1;
+
+    return 0;
+}
+
+// Fix size of memfd segment, nobody can shrink or grow it and seals cannot be changed.
+static inline int shm_segment_seal( shm_segment *t_seg )
+{
+    return fcntl( t_seg->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL );
+}
+
+// unmap segment, t_remove removes name of segment too
+static inline void shm_segment_close( shm_segment *t_seg, int t_remove = 0 )
+{
+    if ( t_seg->addr ) munmap( t_seg->addr, t_seg->size );
+    if ( t_seg->fd >= 0 ) close( t_seg->fd );
+    t_seg->addr = nullptr;
+    t_seg->fd = -1;
+
+    if ( !t_remove ) return;
+
+    if ( t_seg->type == SEG_SHM ) shm_unlink( t_seg->name );
+    if ( t_seg->type == SEG_HUGETLBFS || t_seg->type == SEG_FILE ) unlink( t_seg->name );
+}
+
+#endif // __SHM_SEGMENT_H
@@ -0,0 +1,106 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Seqlock for snapshots of POD structure in shared memory.
+//
+// Writer makes sequence odd, updates data and makes sequence even again.
+// Reader copies data and repeats copy when sequence was odd or when it
+// was changed during copy. Readers never block writer and they do not
+// write to shared memory at all.
+//
+// Data is stored as array of atomic words, so concurrent copy is
+// not a data race.
+//
+//***************************************************************************
+
+#ifndef __SHM_SEQLOCK_H
+#define __SHM_SEQLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <atomic>
+#include <type_traits>
+
+#include "futex.h"
+
+template<class T> struct shm_seqlock
+{
+    static_assert( std::is_trivially_copyable<T>::value, "Seqlock data must be POD!" );
+
+    enum { WORDS = ( sizeof( T ) + 7 ) / 8 };
+
+    alignas( CACHE_LINE ) std::atomic<uint32_t> seq;
+    std::atomic<uint64_t> words[ WORDS ];
+};
+
+template<class T> static inline void seqlock_init( shm_seqlock<T> *t_lock, const T &t_data )
+{
+    uint64_t l_buf[ shm_seqlock<T>::WORDS ] = { 0 };
+    memcpy( l_buf, &t_data, sizeof( T ) );
+    for ( int i = 0; i < shm_seqlock<T>::WORDS; i++ )
+        t_lock->words[ i ].store( l_buf[ i ], std::memory_order_relaxed );
+    t_lock->seq.store( 0, std::memory_order_release );
+}
+
+// Publish new snapshot. More writers are serialized by odd sequence.
+template<class T> static inline void seqlock_write( shm_seqlock<T> *t_lock, const T &t_data )
+{
+    uint64_t l_buf[ shm_seqlock<T>::WORDS ] = { 0 };
+    memcpy( l_buf, &t_data, sizeof( T ) );
+
+    // acquire pairs with release of previous writer, its words are ordered before ours
+    uint32_t l_seq = t_lock->seq.load( std::memory_order_relaxed );
+    while ( l_seq & 1 || !t_lock->seq.compare_exchange_weak( l_seq, l_seq + 1, std::memory_order_acquire,
+                                                             std::memory_order_relaxed ) )
+    {
+        cpu_relax();
+        l_seq = t_lock->seq.load( std::memory_order_relaxed );
+    }
+    // data stores must not be visible before odd sequence
+    std::atomic_thread_fence( std::memory_order_release );
+
+    for ( int i = 0; i < shm_seqlock<T>::WORDS; i++ )
+        t_lock->words[ i ].store( l_buf[ i ], std::memory_order_relaxed );
+
+    t_lock->seq.store( l_seq + 2, std::memory_order_release );
+}
+
+// One attempt to read snapshot, returns false when writer interfered.
+template<class T> static inline bool seqlock_try_read( shm_seqlock<T> *t_lock, T *t_data )
+{
+    uint64_t l_buf[ shm_seqlock<T>::WORDS ];
+
+    uint32_t l_seq = t_lock->seq.load( std::memory_order_acquire );
+    if ( l_seq & 1 ) return false;
+
+    for ( int i = 0; i < shm_seqlock<T>::WORDS; i++ )
+        l_buf[ i ] = t_lock->words[ i ].load( std::memory_order_relaxed );
+
+    // data loads must be finished before sequence is checked again
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( t_lock->seq.load( std::memory_order_relaxed ) != l_seq ) return false;
+
+    memcpy( t_data, l_buf, sizeof( T ) );
+    return true;
+}
+
+// Read consistent snapshot, returns number of retries.
+template<class T> static inline int seqlock_read( shm_seqlock<T> *t_lock, T *t_data )
+{
+    int l_retry = 0;
+    while ( !seqlock_try_read( t_lock, t_data ) )
+    {
+        // writer can be preempted in the middle of update
+        if ( !( ++l_retry % 64 ) )
+            sched_yield();
+        else
+            cpu_relax();
+    }
+    return l_retry;
+}
+
+#endif // __SHM_SEQLOCK_H
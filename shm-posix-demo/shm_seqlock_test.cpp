@@ -0,0 +1,267 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Example of seqlock in shared memory.
+//
+// One writer process updates statistics block, reader processes read it
+// as fast as possible. All fields of block are changed together, so
+// reader can detect torn (inconsistent) snapshot. Block is read
+// directly (naive) and through seqlock.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "shm_seqlock.h"
+
+#define SHM_NAME        "/shm_seqlock"
+
+// statistics block, consistent when all values derive from counter
+struct stats
+{
+    int num_of_process;
+    int counter;
+    long total;
+    long check;
+    char desc[ 32 ];
+};
+
+// data structure for shared memory
+struct shm_data
+{
+    std::atomic<int> stop;
+    std::atomic<long> reads;
+    std::atomic<long> torn;
+    std::atomic<long> retries;
+    alignas( CACHE_LINE ) volatile stats naive;
+    shm_seqlock<stats> locked;
+};
+
+// parameters of test
+int g_readers = 4;
+int g_seconds = 2;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Seqlock snapshots in shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p readers] [-t seconds]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  number of reader processes (default %d)\n"
+        "    -t  duration of one test in seconds (default %d)\n"
+        "\n", t_name, g_readers, g_seconds );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void make_stats( stats *t_st, int t_counter )
+{
+    t_st->counter = t_counter;
+    t_st->num_of_process = t_counter % 1000;
+    t_st->total = t_counter * 3L;
+    t_st->check = t_st->num_of_process + t_st->total;
+    snprintf( t_st->desc, sizeof( t_st->desc ), "%d", t_counter );
+}
+
+int consistent( const stats *t_st )
+{
+    return t_st->num_of_process == t_st->counter % 1000 && t_st->total == t_st->counter * 3L &&
+           t_st->check == t_st->num_of_process + t_st->total && atoi( t_st->desc ) == t_st->counter;
+}
+
+void writer( shm_data *t_data, int t_naive )
+{
+    stats l_st;
+    for ( int i = 1; !t_data->stop.load( std::memory_order_relaxed ); i++ )
+    {
+        make_stats( &l_st, i );
+        if ( t_naive )
+            memcpy( ( void * ) &t_data->naive, &l_st, sizeof( l_st ) );
+        else
+            seqlock_write( &t_data->locked, l_st );
+    }
+    exit( 0 );
+}
+
+void reader( shm_data *t_data, int t_naive )
+{
+    stats l_st;
+    long l_reads = 0, l_torn = 0, l_retries = 0;
+
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        if ( t_naive )
+            memcpy( &l_st, ( void * ) &t_data->naive, sizeof( l_st ) );
+        else
+            l_retries += seqlock_read( &t_data->locked, &l_st );
+
+        if ( !consistent( &l_st ) ) l_torn++;
+        l_reads++;
+    }
+
+    t_data->reads += l_reads;
+    t_data->torn += l_torn;
+    t_data->retries += l_retries;
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_naive )
+{
+    stats l_st;
+    make_stats( &l_st, 0 );
+    memcpy( ( void * ) &t_data->naive, &l_st, sizeof( l_st ) );
+    seqlock_init( &t_data->locked, l_st );
+    t_data->stop = 0;
+    t_data->reads = 0;
+    t_data->torn = 0;
+    t_data->retries = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i <= g_readers; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+        {
+            if ( i == 0 )
+                writer( t_data, t_naive );
+            else
+                reader( t_data, t_naive );
+        }
+    }
+
+    sleep( g_seconds );
+    t_data->stop = 1;
+
+    for ( int i = 0; i <= g_readers; i++ )
+        wait( nullptr );
+
+    printf( "%-8s %3d readers  %12.0f reads/s  torn %ld  retries %ld\n",
+            t_naive ? "naive" : "seqlock", g_readers, ( double ) t_data->reads / g_seconds,
+            t_data->torn.load(), t_data->retries.load() );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_readers = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-t" ) ) g_seconds = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_readers <= 0 || g_seconds <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory." );
+        exit( 1 );
+    }
+    if ( ftruncate( l_fd, sizeof( shm_data ) ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+
+    run_test( l_data, 1 );
+    run_test( l_data, 0 );
+
+    munmap( l_data, sizeof( shm_data ) );
+    shm_unlink( SHM_NAME );
+
+    return 0;
+}
@@ -0,0 +1,266 @@
+//***************************************************************************
+//
+// Program example for subject Operating Systems
+//
+// Petr Olivka, Dept. of Computer Science, petr.olivka@vsb.cz, 2021
+//
+// Polling versus futex waiting for change in shared memory.
+//
+// Writer process changes counter in shared memory in regular intervals
+// and stores time of change. Watcher processes react to changes
+// by busy polling, polling with sleep, or sleeping on futex.
+// Wake-up latency and CPU time of watchers are reported.
+//
+//***************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "shm_event.h"
+
+#define SHM_NAME        "/shm_wait"
+
+#define MODE_BUSY       0
+#define MODE_SLEEP      1
+#define MODE_FUTEX      2
+
+// data structure for shared memory
+struct shm_data
+{
+    std::atomic<int> counter;
+    std::atomic<int> waiters;
+    std::atomic<int> stop;
+    std::atomic<long long> changed;             // time of last change
+    std::atomic<long long> lat_sum;
+    std::atomic<long long> lat_max;
+    std::atomic<long> wakeups;
+};
+
+// parameters of test
+int g_watchers = 4;
+int g_changes = 1000;
+int g_interval_us = 1000;
+int g_poll_us = 100;
+
+//***************************************************************************
+// log messages
+
+#define LOG_ERROR               0       // errors
+#define LOG_INFO                1       // information and notifications
+#define LOG_DEBUG               2       // debug messages
+
+// debug flag
+int g_debug = LOG_INFO;
+
+void log_msg( int t_log_level, const char *t_form, ... )
+{
+    const char *out_fmt[] = {
+            "ERR: (%d-%s) %s\n",
+            "INF: %s\n",
+            "DEB: %s\n" };
+
+    if ( t_log_level && t_log_level > g_debug ) return;
+
+    char l_buf[ 1024 ];
+    va_list l_arg;
+    va_start( l_arg, t_form );
+    vsprintf( l_buf, t_form, l_arg );
+    va_end( l_arg );
+
+    switch ( t_log_level )
+    {
+    case LOG_INFO:
+    case LOG_DEBUG:
+        fprintf( stdout, out_fmt[ t_log_level ], l_buf );
+        break;
+
+    case LOG_ERROR:
+        fprintf( stderr, out_fmt[ t_log_level ], errno, strerror( errno ), l_buf );
+        break;
+    }
+}
+
+//***************************************************************************
+// help
+
+void help( char *t_name )
+{
+    printf(
+        "\n"
+        "  Polling versus futex waiting for change of shared memory.\n"
+        "\n"
+        "  Use: %s [-h -d -r] [-p watchers] [-n changes] [-i interval_us] [-s poll_us]\n"
+        "\n"
+        "    -h  this help\n"
+        "    -d  debug mode \n"
+        "    -r  clean shared memory \n"
+        "    -p  number of watching processes (default %d)\n"
+        "    -n  number of changes (default %d)\n"
+        "    -i  interval between changes in us (default %d)\n"
+        "    -s  sleep of polling watcher in us (default %d)\n"
+        "\n", t_name, g_watchers, g_changes, g_interval_us, g_poll_us );
+
+    exit( 0 );
+}
+
+//***************************************************************************
+
+void watcher( shm_data *t_data, int t_mode )
+{
+    int l_old = t_data->counter;
+
+    while ( !t_data->stop.load( std::memory_order_relaxed ) )
+    {
+        int l_cur;
+        switch ( t_mode )
+        {
+        case MODE_BUSY:
+            l_cur = t_data->counter.load( std::memory_order_acquire );
+            break;
+        case MODE_SLEEP:
+            l_cur = t_data->counter.load( std::memory_order_acquire );
+            if ( l_cur == l_old ) usleep( g_poll_us );
+            break;
+        default:
+            // timeout only to check stop flag
+            l_cur = shm_wait_change( &t_data->counter, &t_data->waiters, l_old, 100 );
+            break;
+        }
+
+        if ( l_cur == l_old ) continue;
+
+        long long l_lat = time_ns() - t_data->changed.load( std::memory_order_relaxed );
+        t_data->lat_sum += l_lat;
+        long long l_max = t_data->lat_max;
+        while ( l_lat > l_max && !t_data->lat_max.compare_exchange_weak( l_max, l_lat ) );
+        t_data->wakeups++;
+        l_old = l_cur;
+    }
+    exit( 0 );
+}
+
+void run_test( shm_data *t_data, int t_mode )
+{
+    const char *l_names[] = { "busy poll", "poll+usleep", "futex" };
+
+    t_data->counter = 0;
+    t_data->waiters = 0;
+    t_data->stop = 0;
+    t_data->lat_sum = 0;
+    t_data->lat_max = 0;
+    t_data->wakeups = 0;
+
+    fflush( stdout );
+    for ( int i = 0; i < g_watchers; i++ )
+    {
+        int l_pid = fork();
+        if ( l_pid < 0 )
+        {
+            log_msg( LOG_ERROR, "Unable to create new process!" );
+            exit( 1 );
+        }
+        if ( l_pid == 0 )
+            watcher( t_data, t_mode );
+    }
+
+    usleep( 100000 );
+    long long l_start = time_ns();
+
+    for ( int i = 0; i < g_changes; i++ )
+    {
+        usleep( g_interval_us );
+        t_data->changed.store( time_ns(), std::memory_order_relaxed );
+        shm_add_notify( &t_data->counter, &t_data->waiters );
+    }
+
+    usleep( g_interval_us );
+    t_data->stop = 1;
+    double l_sec = ( time_ns() - l_start ) / 1e9;
+
+    // CPU time of all watchers
+    double l_cpu = 0;
+    for ( int i = 0; i < g_watchers; i++ )
+    {
+        rusage l_ru;
+        wait4( -1, nullptr, 0, &l_ru );
+        l_cpu += l_ru.ru_utime.tv_sec + l_ru.ru_stime.tv_sec + ( l_ru.ru_utime.tv_usec + l_ru.ru_stime.tv_usec ) / 1e6;
+    }
+
+    long l_wakeups = t_data->wakeups;
+    printf( "%-12s %3d watchers  CPU %6.1f %% per watcher  wake-ups %6ld  latency avg %9.0f ns  max %10lld ns\n",
+            l_names[ t_mode ], g_watchers, 100.0 * l_cpu / l_sec / g_watchers, l_wakeups,
+            l_wakeups ? ( double ) t_data->lat_sum / l_wakeups : 0.0, t_data->lat_max.load() );
+}
+
+int main( int t_narg, char **t_args )
+{
+    for ( int i = 1; i < t_narg; i++ )
+    {
+        if ( !strcmp( t_args[ i ], "-h" ) )
+            help( *t_args );
+
+        if ( !strcmp( t_args[ i ], "-d" ) )
+            g_debug = LOG_DEBUG;
+
+        if ( !strcmp( t_args[ i ], "-r" ) )
+        {
+            shm_unlink( SHM_NAME );
+            log_msg( LOG_INFO, "Shared memory cleaned." );
+            exit( 0 );
+        }
+
+        if ( i + 1 < t_narg )
+        {
+            if ( !strcmp( t_args[ i ], "-p" ) ) g_watchers = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-n" ) ) g_changes = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-i" ) ) g_interval_us = atoi( t_args[ ++i ] );
+            else if ( !strcmp( t_args[ i ], "-s" ) ) g_poll_us = atoi( t_args[ ++i ] );
+        }
+    }
+
+    if ( g_watchers <= 0 || g_changes <= 0 || g_interval_us <= 0 || g_poll_us <= 0 )
+    {
+        log_msg( LOG_INFO, "Bad parameters!" );
+        help( *t_args );
+    }
+
+    int l_fd = shm_open( SHM_NAME, O_RDWR | O_CREAT, 0660 );
+    if ( l_fd < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to create file for shared memory." );
+        exit( 1 );
+    }
+    if ( ftruncate( l_fd, sizeof( shm_data ) ) < 0 )
+    {
+        log_msg( LOG_ERROR, "Unable to set size of shared memory." );
+        exit( 1 );
+    }
+
+    shm_data *l_data = ( shm_data * ) mmap( nullptr, sizeof( shm_data ), PROT_READ | PROT_WRITE, MAP_SHARED, l_fd, 0 );
+    close( l_fd );
+    if ( l_data == MAP_FAILED )
+    {
+        log_msg( LOG_ERROR, "Unable to attach shared memory!" );
+        shm_unlink( SHM_NAME );
+        exit( 1 );
+    }
+
+    for ( int l_mode = MODE_BUSY; l_mode <= MODE_FUTEX; l_mode++ )
+        run_test( l_data, l_mode );
+
+    munmap( l_data, sizeof( shm_data ) );
+    shm_unlink( SHM_NAME );
+
+    return 0;
+}